@@ -41,6 +41,9 @@ local hooks = require("r.hooks")
 ---an item is selected
 ---@field doc_width? integer
 ---
+---Maximum number of completion items sent at once (0 means no limit)
+---@field max_items? integer
+---
 ---List of functions that are expected to receive a data.frame is the first
 ---argument
 ---@field fun_data_1? string[]
@@ -166,7 +169,7 @@ local hooks = require("r.hooks")
 ---
 ---Options for fine-grained control of the object browser. Do `:help compl_data`
 ---for more information.
----@field compl_data? { max_list_len: integer, max_depth: integer, max_size: integer, max_time: integer }
+---@field compl_data? { max_list_len: integer, max_depth: integer, max_size: integer, max_time: integer, lazy_list: boolean }
 ---
 ---Options for the r_ls (R.nvim's built-in language server)
 ---@field r_ls? RLSConfigOpts
@@ -440,6 +443,11 @@ local hooks = require("r.hooks")
 ---information.
 ---@field tmpdir? string
 ---
+---If `true`, R and rnvimserver communicate through a Unix-domain socket
+---instead of a TCP port; defaults to `false`. Do `:help unix_socket` for more
+---information.
+---@field unix_socket? boolean
+---
 --Internal variable used to store the user login name.
 --@field private user_login? string
 --
@@ -503,6 +511,7 @@ local config = {
         max_depth = 3,
         max_size = 1000000,
         max_time = 100,
+        lazy_list = false,
     },
     r_ls = {
         completion = true,
@@ -517,6 +526,7 @@ local config = {
         document_highlight = true,
         rename = true,
         doc_width = 0,
+        max_items = 0,
         fun_data_1 = { "select", "rename", "mutate", "filter" },
         fun_data_2 = { ggplot = { "aes" }, with = { "*" } },
         fun_data_formula = { ggplot = { "facet_wrap", "facet_grid", "vars" } },
@@ -602,6 +612,7 @@ local config = {
     synctex = true,
     texerr = true,
     tmpdir = "",
+    unix_socket = false,
     user_login = "",
     user_maps_only = false,
     view_df = {
@@ -984,6 +995,10 @@ local check_readme = function()
             "",
             "When you load a new version of a library, their files are replaced.",
             "",
+            "The bincache_ files are built by rnvimserver from the objls_, args_,",
+            "alias_, and srcref_ files to be mapped in memory without parsing. They",
+            "are rebuilt whenever the corresponding text files change.",
+            "",
             "Files corresponding to uninstalled libraries are not automatically deleted.",
             "You should manually delete them if you want to save disk space.",
             "",
@@ -75,6 +75,9 @@ start_R2 = function()
         "options(nvimcom.max_depth = " .. tostring(config.compl_data.max_depth) .. ")",
         "options(nvimcom.max_size = " .. tostring(config.compl_data.max_size) .. ")",
         "options(nvimcom.max_time = " .. tostring(config.compl_data.max_time) .. ")",
+        "options(nvimcom.lazy_list = "
+            .. (config.compl_data.lazy_list and "TRUE" or "FALSE")
+            .. ")",
         'options(nvimcom.set_params = "' .. config.set_params .. '")',
     }
     local cmpd
@@ -186,7 +189,7 @@ end
 M.get_r_args = function() return r_args end
 
 --- Register rnvimserver port in a environment variable
----@param p string
+---@param p string Either a TCP port number or "unix:" and the socket path
 M.set_rns_port = function(p)
     vim.g.R_Nvim_status = 5
     vim.env.RNVIM_PORT = p
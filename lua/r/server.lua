@@ -118,6 +118,11 @@ local start_rnvimserver = function()
     if config.objbr_allnames then rns_env.RNVIM_OBJBR_ALLNAMES = "TRUE" end
     rns_env.RNVIM_RPATH = config.R_cmd
     rns_env.RNVIM_MAX_DEPTH = tostring(config.compl_data.max_depth)
+    if config.compl_data.lazy_list then rns_env.RNVIM_LAZY_LIST = "TRUE" end
+    if config.unix_socket and not config.is_windows and config.remote_R_host == "" then
+        rns_env.RNVIM_UNIX_SOCKET = "TRUE"
+    end
+    rns_env.R_LS_MAX_ITEMS = tostring(config.r_ls.max_items)
     local disable_parts = {}
     if not config.r_ls.completion then table.insert(disable_parts, "completion") end
     if not config.r_ls.signature then table.insert(disable_parts, "signature") end
@@ -139,7 +139,7 @@ M.start = function()
         .. " RNVIM_SECRET="
         .. vim.env.RNVIM_SECRET
         .. " RNVIM_PORT="
-        .. vim.env.RNVIM_PORT
+        .. vim.env.RNVIM_PORT:gsub(" ", "\\ ")
         .. " R_DEFAULT_PACKAGES="
         .. vim.env.R_DEFAULT_PACKAGES
         .. " "
@@ -1,6 +1,25 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <stdint.h>
+
+// Header of the memory region through which nvimcom sends large messages to
+// rnvimserver. `seq` works as a sequence lock: it is odd while a message is
+// being written and is incremented again when the message is complete.
+typedef struct shm_header_ {
+    char secret[32];     // RNVIM_SECRET, to check that the region is right
+    uint64_t secret_len; // Length of the secret (less than 32)
+    uint64_t seq;        // Sequence number of the message
+    uint64_t size;       // Size of the region, including this header
+    uint64_t len;        // Length of the message
+} ShmHeader;
+
+#define SHM_MIN_MSG 65536 // Smaller messages are sent through TCP
+
+// Prefix of RNVIM_PORT when rnvimserver listens on a Unix-domain socket
+#define UNIX_SOCK_PREFIX "unix:"
+#define UNIX_SOCK_PREFIX_LEN 5
+
 char *str_cat(char *dest, const char *src);
 int str_here(const char *string, const char *substring);
 void format(const char *orig, char *dest, char delim, char nl);
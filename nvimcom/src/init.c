@@ -11,7 +11,7 @@ static const R_CMethodDef CEntries[] = {
     {NULL, NULL, 0}};
 
 static const R_CallMethodDef CallEntries[] = {
-    {"nvimcom_Start", (DL_FUNC)&nvimcom_Start, 9},
+    {"nvimcom_Start", (DL_FUNC)&nvimcom_Start, 11},
     {"rd2md", (DL_FUNC)&rd2md, 1},
     {"get_section", (DL_FUNC)&get_section, 1},
     {"fmt_txt", (DL_FUNC)&fmt_txt, 1},
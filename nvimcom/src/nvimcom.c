@@ -39,11 +39,14 @@
 #endif
 #else
 #include <arpa/inet.h> // inet_addr()
+#include <fcntl.h>
 #include <netdb.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #endif
 
 #ifndef WIN32
@@ -55,6 +58,7 @@ static int (*save_ptr_R_ReadConsole)(const char *, unsigned char *, int, int);
 static int debugging;           // Is debugging a function now?
 LibExtern SEXP R_SrcfileSymbol; // R internal variable defined in Defn.h.
 static void SrcrefInfo(void);
+static void nvimcom_fire(void);
 #endif
 
 static int debug_r; // Should detect when `browser()` is running and start
@@ -70,10 +74,10 @@ static int allnames = 0; // Show hidden objects in auto completion and
 static int fun_args = 1; // Complete arguments of .GlovalEnv functions?
 static int nlibs = 0;    // Number of loaded libraries.
 
-static char rns_addr[32]; // rnvimserver ip address.
-static char rns_port[16]; // rnvimserver port.
-static char nvimsecr[32]; // Random string used to increase the safety of TCP
-                          // communication.
+static char rns_addr[32];  // rnvimserver ip address.
+static char rns_port[128]; // rnvimserver port or Unix-domain socket.
+static char nvimsecr[32];  // Random string used to increase the safety of TCP
+                           // communication.
 
 static char *glbnvbuf1;   // Temporary buffer used to store the list of
                           // .GlobalEnv objects.
@@ -82,6 +86,10 @@ static char *glbnvbuf2;   // Temporary buffer used to store the list of
 static char *send_ge_buf; // Temporary buffer used to store the list of
                           // .GlobalEnv objects.
 
+static unsigned glbnv_seq; // Number of edits sent since the last whole list
+                           // of .GlobalEnv objects.
+static int glbnv_full = 1; // Send the whole list next time?
+
 static unsigned long lastglbnvbsz;         // Previous size of glbnvbuf2.
 static unsigned long glbnvbufsize = 32768; // Current size of glbnvbuf2.
 
@@ -99,6 +107,64 @@ static int maxdepth = 12; // How many levels to parse in lists and S4 objects
 // the listing is too slow.
 static int curdepth = 0; // Current level of the list or S4 object being parsed
                          // for auto-completion.
+static int lazy_list;    // List only the elements of lists in `expanded`?
+static char **expanded;  // Lists whose elements rnvimserver requested
+static int nexpanded;    // Number of elements in expanded
+static int expanded_sz;  // Allocated size of expanded
+#ifndef WIN32
+// Lists requested by rnvimserver that were not added to `expanded` yet. They
+// are received by client_loop_thread, but `expanded` is only used by the main
+// thread (see take_expansions()).
+static pthread_mutex_t exp_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *exp_pending; // Paths, each one followed by '\n'
+static size_t exp_len;    // Length of exp_pending
+#endif
+
+// Lines of a .GlobalEnv binding in the last list of objects. They are
+// reused if the object has the same signature (see obj_sig()).
+typedef struct glb_memo_ {
+    char *name;   // Name of the binding
+    uint64_t sig; // Signature of the object
+    size_t off;   // Offset of the lines in glbnvbuf1
+    size_t len;   // Length of the lines
+    int depth;    // Deepest level of the object that was listed
+} GlbMemo;
+
+static GlbMemo *memo;      // Bindings in the last list of objects
+static int nmemo;          // Number of elements in memo
+static int *memo_ht;       // Hash table of memo (index + 1; 0 = empty)
+static int memo_ht_sz;     // Size of memo_ht (a power of 2)
+static int memo_maxdepth;  // maxdepth when memo was built
+static int memo_fun_args;  // fun_args when memo was built
+static int memo_nexpanded; // nexpanded when memo was built
+static GlbMemo *new_memo;  // Bindings of the list being built
+static int new_nmemo;      // Number of elements in new_memo
+static int new_memo_sz;    // Allocated size of new_memo
+
+#define GLBNV_SLICE 20    // Maximum time (ms) of a slice of the list of objects
+static SEXP glbnv_names;  // Names of the objects being listed (or NULL)
+static int glbnv_next;    // Index of the next name to be listed
+static double glbnv_tm;   // Time spent listing objects (clock ticks)
+
+// Arguments of a function, as returned by nvim.args(). They are reused while
+// the closure, its formals and its body are the same objects.
+typedef struct args_memo_ {
+    SEXP fun;     // The closure
+    SEXP formals; // FORMALS(fun) when the arguments were got
+    SEXP body;    // BODY(fun) when the arguments were got
+    char *name;   // Name of the function
+    char *args;   // The arguments
+    int pass;     // Last list of objects in which the function was listed
+} ArgsMemo;
+
+#define ARGS_MAX_AGE 32    // Lists of objects before an unused entry expires
+static ArgsMemo *amemo;    // Cached arguments of functions
+static int namemo;         // Number of elements in amemo
+static int amemo_sz;       // Allocated size of amemo
+static int *amemo_ht;      // Hash table of amemo (index + 1; 0 = empty)
+static int amemo_ht_sz;    // Size of amemo_ht (a power of 2)
+static int glbnv_pass;     // Number of lists of objects built
+static double args_tm;     // Time spent getting arguments not cached yet
 
 static char tmpdir[512]; // The environment variable RNVIM_TMPDIR.
 static int setwidth = 0; // Set the option width after each command is executed
@@ -255,7 +321,9 @@ static void send_to_nvim(char *msg) {
          used in any R code. It would be slower to escape special characters.
 
        - The time to save the file at /dev/shm is bigger than the time to send
-         the buffer through a TCP connection.
+         the buffer through a TCP connection. However, large lists of objects
+         are written in a region of memory shared with rnvimserver, when
+         possible, to avoid copying them (see send_shm()).
 
        - When the msg is very big, it's faster to send the final message in
          three pieces than to call snprintf() to assemble everything in a
@@ -303,6 +371,125 @@ static void send_to_nvim(char *msg) {
         REprintf("Error sending final byte to R.nvim: 1 x %zu\n", sent);
 }
 
+#ifndef WIN32
+// Memory region shared with rnvimserver. It is a file in RNVIM_TMPDIR,
+// which is in /dev/shm on Linux.
+static struct {
+    char path[576]; // Path of the file (empty after it is unlinked)
+    int fd;         // File descriptor
+    ShmHeader *h;   // The region
+    size_t size;    // Size of the region
+    int ok;         // Did rnvimserver map the region?
+} shm = {.fd = -1};
+
+// Create the region and offer it to rnvimserver, which will reply "S" if it
+// can map it (it cannot if R is running in a remote machine).
+static void shm_create(void) {
+    // The whole secret must fit in the header; otherwise, rnvimserver could
+    // only check a prefix of it.
+    const char *secr = getenv("RNVIM_SECRET");
+    size_t slen = secr ? strlen(secr) : 0;
+    if (slen == 0 || slen >= sizeof(shm.h->secret))
+        return;
+
+    snprintf(shm.path, 575, "%s/nvimcom_shm_%d", tmpdir, getpid());
+    shm.fd = open(shm.path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (shm.fd == -1) {
+        *shm.path = 0;
+        return;
+    }
+    shm.size = 4 * SHM_MIN_MSG;
+    if (ftruncate(shm.fd, shm.size) != 0 ||
+        (shm.h = mmap(NULL, shm.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      shm.fd, 0)) == MAP_FAILED) {
+        shm.h = NULL;
+        close(shm.fd);
+        shm.fd = -1;
+        unlink(shm.path);
+        *shm.path = 0;
+        return;
+    }
+    memset(shm.h, 0, sizeof(ShmHeader));
+    memcpy(shm.h->secret, secr, slen);
+    shm.h->secret_len = slen;
+    shm.h->size = shm.size;
+
+    char b[600];
+    snprintf(b, 599, "+M%s", shm.path);
+    send_to_nvim(b);
+}
+
+// rnvimserver has mapped the region (called by the thread receiving
+// messages from rnvimserver)
+static void shm_accepted(void) {
+    if (*shm.path) {
+        unlink(shm.path);
+        *shm.path = 0;
+    }
+    __atomic_store_n(&shm.ok, 1, __ATOMIC_RELEASE);
+}
+
+static void shm_close(void) {
+    if (shm.h)
+        munmap(shm.h, shm.size);
+    if (shm.fd != -1)
+        close(shm.fd);
+    if (*shm.path)
+        unlink(shm.path);
+    shm.h = NULL;
+    shm.fd = -1;
+    *shm.path = 0;
+}
+
+/**
+ * @brief Send a large message through the shared memory region. The message
+ * is `head` followed by `body`. Only a notification with the sequence number
+ * of the message ("+Z<seq>") is sent through TCP. rnvimserver ignores the
+ * message if it was overwritten by a newer one before being read.
+ *
+ * @return 1 if the message was sent and 0 if it must be sent through TCP.
+ */
+static int send_shm(const char *head, const char *body, size_t blen) {
+    if (!__atomic_load_n(&shm.ok, __ATOMIC_ACQUIRE) || !shm.h ||
+        blen < SHM_MIN_MSG)
+        return 0;
+
+    size_t hlen = strlen(head);
+    size_t need = sizeof(ShmHeader) + hlen + blen;
+    if (need > shm.size) {
+        size_t nsz = shm.size;
+        while (nsz < need)
+            nsz *= 2;
+        // The region only grows: rnvimserver might still be reading it
+        if (ftruncate(shm.fd, nsz) != 0)
+            return 0;
+        ShmHeader *h =
+            mmap(NULL, nsz, PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+        if (h == MAP_FAILED)
+            return 0;
+        munmap(shm.h, shm.size);
+        shm.h = h;
+        shm.size = nsz;
+        __atomic_store_n(&shm.h->size, nsz, __ATOMIC_RELAXED);
+    }
+
+    uint64_t seq = shm.h->seq + 1;
+    __atomic_store_n(&shm.h->seq, seq, __ATOMIC_RELAXED); // Odd: writing
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    char *data = (char *)(shm.h + 1);
+    memcpy(data, head, hlen);
+    memcpy(data + hlen, body, blen);
+    shm.h->len = hlen + blen;
+    seq++;
+    __atomic_store_n(&shm.h->seq, seq, __ATOMIC_RELEASE);
+
+    char b[32];
+    snprintf(b, 31, "+Z%" PRIu64, seq);
+    send_to_nvim(b);
+    return 1;
+}
+#endif
+
 /**
  * @brief Function called by R code to send message to rnvimserver.
  *
@@ -425,11 +612,180 @@ static LibInfo *nvimcom_get_lib(const char *nm) {
  *
  * @return The pointer p updated after the insertion of the new line.
  */
+static unsigned amemo_hash(SEXP fun) {
+    uintptr_t h = (uintptr_t)fun;
+    return (unsigned)((h >> 4) ^ (h >> 20));
+}
+
+static void amemo_rehash(void) {
+    free(amemo_ht);
+    amemo_ht_sz = 64;
+    while (amemo_ht_sz < 2 * amemo_sz)
+        amemo_ht_sz *= 2;
+    amemo_ht = (int *)calloc(amemo_ht_sz, sizeof(int));
+    unsigned mask = amemo_ht_sz - 1;
+    for (int k = 0; k < namemo; k++) {
+        unsigned i = amemo_hash(amemo[k].fun) & mask;
+        while (amemo_ht[i])
+            i = (i + 1) & mask;
+        amemo_ht[i] = k + 1;
+    }
+}
+
+/**
+ * @brief Get the cached arguments of a closure.
+ * @return The arguments or NULL if they are not cached or the closure
+ * changed.
+ */
+static const char *amemo_get(SEXP fun, const char *name) {
+    if (!amemo_ht)
+        return NULL;
+    unsigned mask = amemo_ht_sz - 1;
+    for (unsigned i = amemo_hash(fun) & mask; amemo_ht[i];
+         i = (i + 1) & mask) {
+        ArgsMemo *a = &amemo[amemo_ht[i] - 1];
+        if (a->fun == fun && a->formals == FORMALS(fun) &&
+            a->body == BODY(fun) && strcmp(a->name, name) == 0) {
+            a->pass = glbnv_pass;
+            return a->args;
+        }
+    }
+    return NULL;
+}
+
+static void amemo_put(SEXP fun, const char *name, const char *args) {
+    if (namemo == amemo_sz) {
+        amemo_sz = amemo_sz ? 2 * amemo_sz : 128;
+        amemo = (ArgsMemo *)realloc(amemo, amemo_sz * sizeof(ArgsMemo));
+    }
+    ArgsMemo *a = &amemo[namemo++];
+    a->fun = fun;
+    a->formals = FORMALS(fun);
+    a->body = BODY(fun);
+    a->name = (char *)malloc(strlen(name) + 1);
+    strcpy(a->name, name);
+    a->args = (char *)malloc(strlen(args) + 1);
+    strcpy(a->args, args);
+    a->pass = glbnv_pass;
+
+    if (2 * namemo > amemo_ht_sz) {
+        amemo_rehash();
+    } else {
+        unsigned mask = amemo_ht_sz - 1;
+        unsigned i = amemo_hash(fun) & mask;
+        while (amemo_ht[i])
+            i = (i + 1) & mask;
+        amemo_ht[i] = namemo;
+    }
+}
+
+// Forget the functions that were not listed recently. They were probably
+// deleted and their addresses might be reused by new objects.
+static void amemo_expire(void) {
+    int n = 0;
+    for (int k = 0; k < namemo; k++) {
+        if (glbnv_pass - amemo[k].pass > ARGS_MAX_AGE) {
+            free(amemo[k].name);
+            free(amemo[k].args);
+        } else {
+            amemo[n++] = amemo[k];
+        }
+    }
+    if (n < namemo) {
+        namemo = n;
+        amemo_rehash();
+    }
+}
+
+static void amemo_free(void) {
+    for (int k = 0; k < namemo; k++) {
+        free(amemo[k].name);
+        free(amemo[k].args);
+    }
+    free(amemo);
+    free(amemo_ht);
+    amemo = NULL;
+    amemo_ht = NULL;
+    namemo = 0;
+    amemo_sz = 0;
+}
+
+/**
+ * @brief Check whether the elements of a list, data.frame or S4 object should
+ * be listed. They are listed if the object is not deeper than max_depth,
+ * unless in lazy mode, or if rnvimserver requested them.
+ *
+ * @param curenv The name of the parent followed by '$' or '@', if any.
+ * @param xname The name of the object, escaped.
+ * @param depth The depth of the object.
+ * @return 1 if the elements should be listed and 0 otherwise.
+ */
+static int list_elements(const char *curenv, const char *xname, int depth) {
+    if (!lazy_list && depth < maxdepth)
+        return 1;
+    if (nexpanded == 0)
+        return 0;
+    char path[640];
+    snprintf(path, 639, "%s%s", curenv, xname);
+    for (int i = 0; i < nexpanded; i++)
+        if (strcmp(expanded[i], path) == 0)
+            return 1;
+    return 0;
+}
+
+// Include the elements of a list in the list of objects from now on
+static void expand_list(const char *path) {
+    for (int i = 0; i < nexpanded; i++)
+        if (strcmp(expanded[i], path) == 0)
+            return;
+    if (nexpanded == expanded_sz) {
+        expanded_sz = expanded_sz ? 2 * expanded_sz : 16;
+        expanded = (char **)realloc(expanded, expanded_sz * sizeof(char *));
+    }
+    expanded[nexpanded] = (char *)malloc(strlen(path) + 1);
+    strcpy(expanded[nexpanded], path);
+    nexpanded++;
+}
+
+#ifndef WIN32
+// Keep a path received from rnvimserver for take_expansions()
+static void request_expansion(const char *path) {
+    size_t len = strlen(path);
+    pthread_mutex_lock(&exp_lock);
+    char *p = (char *)realloc(exp_pending, exp_len + len + 2);
+    if (p) {
+        exp_pending = p;
+        memcpy(exp_pending + exp_len, path, len);
+        exp_len += len;
+        exp_pending[exp_len++] = '\n';
+        exp_pending[exp_len] = 0;
+    }
+    pthread_mutex_unlock(&exp_lock);
+}
+
+// Add the paths kept by request_expansion() to `expanded`. Called by the main
+// thread before a new list of objects is started.
+static void take_expansions(void) {
+    pthread_mutex_lock(&exp_lock);
+    char *b = exp_pending;
+    exp_pending = NULL;
+    exp_len = 0;
+    pthread_mutex_unlock(&exp_lock);
+    if (!b)
+        return;
+    char *p = b;
+    char *nl;
+    while ((nl = strchr(p, '\n'))) {
+        *nl = 0;
+        expand_list(p);
+        p = nl + 1;
+    }
+    free(b);
+}
+#endif
+
 static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
                                 char *p, int depth) {
-    if (depth > maxdepth)
-        return p;
-
     if (depth > curdepth)
         curdepth = depth;
 
@@ -497,11 +853,18 @@ static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
 
     p = str_cat(p, "\006.GlobalEnv\006");
 
-    if (xgroup == 1 && fun_args) {
+    const char *cargs = NULL;
+    if (xgroup == 1 && fun_args && TYPEOF(*x) == CLOSXP) {
+        cargs = amemo_get(*x, xname);
+        if (cargs)
+            p = str_cat(p, cargs);
+    }
+    if (xgroup == 1 && fun_args && !cargs) {
         SEXP cmdSexp, cmdexpr, ans;
         ParseStatus status;
         int er = 0;
         char b[64];
+        double tm = clock();
         snprintf(b, 63, "nvimcom:::nvim.args('%s')", xname);
         PROTECT(cmdSexp = allocVector(STRSXP, 1));
         SET_STRING_ELT(cmdSexp, 0, mkChar(b));
@@ -512,12 +875,15 @@ static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
                 p = str_cat(p, ">ERROR<");
             } else {
                 p = str_cat(p, CHAR(STRING_ELT(ans, 0)));
+                if (TYPEOF(*x) == CLOSXP)
+                    amemo_put(*x, xname, CHAR(STRING_ELT(ans, 0)));
             }
             UNPROTECT(1);
         } else {
             p = str_cat(p, ">INVALID<");
         }
         UNPROTECT(2);
+        args_tm += (double)clock() - tm;
     }
 
     // Add label
@@ -603,7 +969,7 @@ static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
     // finish the line
     p = str_cat(p, "\006\n");
 
-    if (xgroup > 1) {
+    if (xgroup > 1 && list_elements(curenv, ebuf, depth)) {
         char newenv[576];
         SEXP elmt;
         const char *ename;
@@ -676,6 +1042,193 @@ static char *nvimcom_glbnv_line(SEXP *x, const char *xname, const char *curenv,
     return p;
 }
 
+static uint64_t sig_mix(uint64_t h, uint64_t v) {
+    return (h ^ v) * 0x100000001b3ULL;
+}
+
+/**
+ * @brief Compute a signature of an object from the information that
+ * nvimcom_glbnv_line() uses: the addresses, types and lengths of the object,
+ * its attributes (class, label, names and S4 slots) and its elements, down to
+ * the deepest level that might be listed (`maxdepth` plus one level for each
+ * list expanded by rnvimserver). R does not modify an object in place without
+ * keeping its address, but it may modify its elements or attributes; hence,
+ * they are checked too. Values of atomic vectors are not listed and are
+ * ignored.
+ */
+static uint64_t obj_sig(SEXP x, uint64_t h, int depth) {
+    h = sig_mix(h, (uintptr_t)x);
+    h = sig_mix(h, TYPEOF(x));
+    // Growable vectors change their length in place
+    if (isVector(x))
+        h = sig_mix(h, XLENGTH(x));
+    if (depth > maxdepth + nexpanded)
+        return h;
+    for (SEXP a = ATTRIB(x); a != R_NilValue; a = CDR(a)) {
+        h = sig_mix(h, (uintptr_t)TAG(a));
+        h = obj_sig(CAR(a), h, depth + 1);
+        if (TYPEOF(CAR(a)) == STRSXP && XLENGTH(CAR(a)) > 0)
+            h = sig_mix(h, (uintptr_t)STRING_ELT(CAR(a), 0));
+    }
+    if (TYPEOF(x) == VECSXP) {
+        R_xlen_t n = XLENGTH(x);
+        if (n < maxlslen)
+            for (R_xlen_t i = 0; i < n; i++)
+                h = obj_sig(VECTOR_ELT(x, i), h, depth + 1);
+    }
+    return h;
+}
+
+static unsigned memo_hash(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static const GlbMemo *memo_find(const char *nm) {
+    if (!memo_ht || memo_maxdepth != maxdepth || memo_fun_args != fun_args ||
+        memo_nexpanded != nexpanded)
+        return NULL;
+    unsigned mask = memo_ht_sz - 1;
+    for (unsigned i = memo_hash(nm) & mask; memo_ht[i]; i = (i + 1) & mask)
+        if (strcmp(memo[memo_ht[i] - 1].name, nm) == 0)
+            return &memo[memo_ht[i] - 1];
+    return NULL;
+}
+
+// Replace the memo with the bindings of the list just built
+static void memo_swap(void) {
+    for (int i = 0; i < nmemo; i++)
+        free(memo[i].name);
+    free(memo);
+    free(memo_ht);
+    memo = new_memo;
+    nmemo = new_nmemo;
+    new_memo = NULL;
+    new_nmemo = 0;
+    new_memo_sz = 0;
+    memo_maxdepth = maxdepth;
+    memo_fun_args = fun_args;
+    memo_nexpanded = nexpanded;
+
+    memo_ht_sz = 16;
+    while (memo_ht_sz < 2 * nmemo)
+        memo_ht_sz *= 2;
+    memo_ht = (int *)calloc(memo_ht_sz, sizeof(int));
+    unsigned mask = memo_ht_sz - 1;
+    for (int k = 0; k < nmemo; k++) {
+        unsigned i = memo_hash(memo[k].name) & mask;
+        while (memo_ht[i])
+            i = (i + 1) & mask;
+        memo_ht[i] = k + 1;
+    }
+}
+
+/**
+ * @brief Add the lines of a .GlobalEnv binding to glbnvbuf2, copying them
+ * from the previous list if the object did not change.
+ *
+ * @param p A pointer to the NULL byte terminating glbnvbuf2.
+ * @return The pointer p updated after the insertion of the lines.
+ */
+static char *nvimcom_glbnv_binding(SEXP *x, const char *xname, char *p) {
+    uint64_t sig = obj_sig(*x, 14695981039346656037ULL, 0);
+    size_t off = p - glbnvbuf2;
+    int depth;
+
+    const GlbMemo *m = memo_find(xname);
+    if (m && m->sig == sig) {
+        while (off + m->len + 1024 >= glbnvbufsize)
+            p = nvimcom_grow_buffers();
+        memcpy(p, glbnvbuf1 + m->off, m->len);
+        p += m->len;
+        *p = 0;
+        depth = m->depth;
+        if (depth > curdepth)
+            curdepth = depth;
+    } else {
+        int cd = curdepth;
+        curdepth = 0;
+        p = nvimcom_glbnv_line(x, xname, "", p, 0);
+        depth = curdepth;
+        if (cd > curdepth)
+            curdepth = cd;
+    }
+
+    if (new_nmemo == new_memo_sz) {
+        new_memo_sz = new_memo_sz ? 2 * new_memo_sz : 256;
+        new_memo =
+            (GlbMemo *)realloc(new_memo, new_memo_sz * sizeof(GlbMemo));
+    }
+    GlbMemo *nm = &new_memo[new_nmemo++];
+    nm->name = (char *)malloc(strlen(xname) + 1);
+    strcpy(nm->name, xname);
+    nm->sig = sig;
+    nm->off = off;
+    nm->len = (p - glbnvbuf2) - off;
+    nm->depth = depth;
+    return p;
+}
+
+/**
+ * @brief Send to rnvimserver only the lines of the list of objects in
+ * .GlobalEnv that changed. The message is "+gseq|skip|del|lines", where
+ * `skip` is the number of unchanged lines at the beginning of the list and
+ * `del` the number of old lines replaced by `lines`.
+ *
+ * @return 0 if the whole list should be sent instead.
+ */
+static int send_glb_edit(void) {
+    const char *a = glbnvbuf1;
+    const char *b = glbnvbuf2;
+    size_t len1 = strlen(a);
+    size_t len2 = strlen(b);
+
+    // Unchanged lines at the beginning
+    size_t pre = 0;
+    unsigned skip = 0;
+    for (size_t i = 0; i < len1 && i < len2 && a[i] == b[i]; i++) {
+        if (a[i] == '\n') {
+            pre = i + 1;
+            skip++;
+        }
+    }
+
+    // Unchanged lines at the end
+    size_t suf = 0;
+    for (size_t i = 1; i <= len1 - pre && i <= len2 - pre; i++) {
+        if (a[len1 - i] != b[len2 - i])
+            break;
+        if ((len1 - i == pre || a[len1 - i - 1] == '\n') &&
+            (len2 - i == pre || b[len2 - i - 1] == '\n'))
+            suf = i;
+    }
+
+    size_t nlen = len2 - pre - suf;
+    if (nlen > len2 / 2)
+        return 0;
+
+    unsigned del = 0;
+    for (size_t i = pre; i < len1 - suf; i++)
+        if (a[i] == '\n')
+            del++;
+
+    char head[64];
+    int hlen = snprintf(head, 63, "+g%u|%u|%u|", glbnv_seq, skip, del);
+#ifndef WIN32
+    if (!send_shm(head, b + pre, nlen))
+#endif
+    {
+        memcpy(send_ge_buf, head, hlen);
+        memcpy(send_ge_buf + hlen, b + pre, nlen);
+        send_ge_buf[hlen + nlen] = 0;
+        send_to_nvim(send_ge_buf);
+    }
+    glbnv_seq++;
+    return 1;
+}
+
 /**
  * @brief Send to R.nvim the string containing the list of objects in
  * .GlobalEnv.
@@ -685,9 +1238,18 @@ static void send_glb_env(void) {
 
     t1 = clock();
 
-    strcpy(send_ge_buf, "+G");
-    strcat(send_ge_buf, glbnvbuf2);
-    send_to_nvim(send_ge_buf);
+    if (glbnv_full || !send_glb_edit()) {
+#ifndef WIN32
+        if (!send_shm("+G", glbnvbuf2, strlen(glbnvbuf2)))
+#endif
+        {
+            strcpy(send_ge_buf, "+G");
+            strcat(send_ge_buf, glbnvbuf2);
+            send_to_nvim(send_ge_buf);
+        }
+        glbnv_seq = 0;
+        glbnv_full = 0;
+    }
 
     if (verbose > 3)
         REprintf("Time to send message to R.nvim: %f\n",
@@ -706,50 +1268,32 @@ static void decrease_max_depth(int md) {
     REprintf("    New max_depth: %d\n", maxdepth);
 }
 
-/**
- * @brief Generate a list of objects in .GlobalEnv and store it in the
- * glbnvbuf2 buffer. The string stored in glbnvbuf2 represents a file with the
- * same format of the `objls_` files in R.nvim's cache directory.
- */
-static void nvimcom_globalenv_list(void) {
-    if (verbose > 4)
-        REprintf("nvimcom_globalenv_list()\n");
-    const char *varName;
-    SEXP envVarsSEXP, varSEXP;
-
-    if (tmpdir[0] == 0)
-        return;
-
-    double tm = clock();
-
-    memset(glbnvbuf2, 0, glbnvbufsize);
-    char *p = glbnvbuf2;
-
-    curdepth = 0;
-
+// Start a new list of objects in .GlobalEnv
+static void glbnv_begin(void) {
+    if (glbnv_names)
+        R_ReleaseObject(glbnv_names);
 #if defined(R_VERSION) && R_VERSION >= R_Version(4, 6, 0)
-    PROTECT(envVarsSEXP = R_lsInternal3(R_GlobalEnv, allnames, TRUE));
+    glbnv_names = R_lsInternal3(R_GlobalEnv, allnames, TRUE);
 #else
-    PROTECT(envVarsSEXP = R_lsInternal(R_GlobalEnv, allnames));
+    glbnv_names = R_lsInternal(R_GlobalEnv, allnames);
 #endif
-    for (int i = 0; i < Rf_length(envVarsSEXP); i++) {
-        varName = CHAR(STRING_ELT(envVarsSEXP, i));
-        if (R_BindingIsActive(Rf_install(varName), R_GlobalEnv)) {
-            // See: https://github.com/jalvesaq/Vim-R/issues/686
-            PROTECT(varSEXP = R_ActiveBindingFunction(Rf_install(varName),
-                                                      R_GlobalEnv));
-        } else {
-            PROTECT(varSEXP = Rf_findVar(Rf_install(varName), R_GlobalEnv));
-        }
-        if (varSEXP != R_UnboundValue) {
-            // should never be unbound
-            p = nvimcom_glbnv_line(&varSEXP, varName, "", p, 0);
-        } else {
-            REprintf("nvimcom_globalenv_list: Unexpected R_UnboundValue.\n");
-        }
-        UNPROTECT(1);
-    }
-    UNPROTECT(1);
+    R_PreserveObject(glbnv_names);
+    glbnv_next = 0;
+    glbnv_tm = 0;
+    args_tm = 0;
+    curdepth = 0;
+    memset(glbnvbuf2, 0, glbnvbufsize);
+
+    // Discard what was done in an interrupted list
+    for (int i = 0; i < new_nmemo; i++)
+        free(new_memo[i].name);
+    new_nmemo = 0;
+}
+
+// Send the list of objects, if it changed, and check the limits
+static void glbnv_finish(void) {
+    R_ReleaseObject(glbnv_names);
+    glbnv_names = NULL;
 
     size_t len1 = strlen(glbnvbuf1);
     size_t len2 = strlen(glbnvbuf2);
@@ -765,11 +1309,18 @@ static void nvimcom_globalenv_list(void) {
         }
     }
 
-    if (changed)
+    if (changed || glbnv_full)
         send_glb_env();
-
-    double tmdiff = 1000 * ((double)clock() - tm) / CLOCKS_PER_SEC;
-    if (tmdiff > timelimit) {
+    // The new list is now in glbnvbuf1 (or it is equal to glbnvbuf1)
+    memo_swap();
+    glbnv_pass++;
+    amemo_expire();
+
+    double tmdiff = 1000 * glbnv_tm / CLOCKS_PER_SEC;
+    // Getting the arguments of new functions is slow, but they are cached
+    // and will not delay the next list.
+    double argsdiff = fun_args ? 1000 * args_tm / CLOCKS_PER_SEC : 0;
+    if (tmdiff - argsdiff > timelimit) {
         REprintf(
             "nvimcom:\n"
             "    Time to build list of objects: %g ms (max_time = %g ms).\n",
@@ -791,6 +1342,73 @@ static void nvimcom_globalenv_list(void) {
     }
 }
 
+/**
+ * @brief Add to glbnvbuf2 the objects of .GlobalEnv not listed yet, for at
+ * most GLBNV_SLICE milliseconds.
+ * @return 1 if the list is complete and 0 otherwise.
+ */
+static int glbnv_step(void) {
+    const char *varName;
+    SEXP varSEXP;
+    double tm = clock();
+    double tmax = tm + GLBNV_SLICE * (double)CLOCKS_PER_SEC / 1000;
+    char *p = glbnvbuf2 + strlen(glbnvbuf2);
+
+    int n = Rf_length(glbnv_names);
+    while (glbnv_next < n && clock() < tmax) {
+        varName = CHAR(STRING_ELT(glbnv_names, glbnv_next));
+        glbnv_next++;
+        if (R_BindingIsActive(Rf_install(varName), R_GlobalEnv)) {
+            // See: https://github.com/jalvesaq/Vim-R/issues/686
+            PROTECT(varSEXP = R_ActiveBindingFunction(Rf_install(varName),
+                                                      R_GlobalEnv));
+        } else {
+            PROTECT(varSEXP = Rf_findVar(Rf_install(varName), R_GlobalEnv));
+        }
+        // The object might have been removed after the list began
+        if (varSEXP != R_UnboundValue)
+            p = nvimcom_glbnv_binding(&varSEXP, varName, p);
+        UNPROTECT(1);
+    }
+    glbnv_tm += (double)clock() - tm;
+
+    if (glbnv_next < n)
+        return 0;
+    glbnv_finish();
+    return 1;
+}
+
+/**
+ * @brief Generate a list of objects in .GlobalEnv and store it in the
+ * glbnvbuf2 buffer. The string stored in glbnvbuf2 represents a file with the
+ * same format of the `objls_` files in R.nvim's cache directory.
+ *
+ * The objects are listed in slices of GLBNV_SLICE milliseconds and, if the
+ * list is not complete after the first slice, the remaining objects are
+ * listed when R is idle (see nvimcom_exec()), so that R returns to the prompt
+ * immediately. A new call restarts the list because .GlobalEnv might have
+ * changed.
+ */
+static void nvimcom_globalenv_list(void) {
+    if (verbose > 4)
+        REprintf("nvimcom_globalenv_list()\n");
+
+    if (tmpdir[0] == 0)
+        return;
+
+#ifndef WIN32
+    take_expansions();
+#endif
+    glbnv_begin();
+#ifdef WIN32
+    while (!glbnv_step())
+        ;
+#else
+    if (!glbnv_step())
+        nvimcom_fire();
+#endif
+}
+
 static char *unscape_str(const char *a) {
     size_t l = strlen(a);
     char *b = (char *)calloc(2 * l + 32, sizeof(char));
@@ -984,6 +1602,8 @@ static void nvimcom_exec(__attribute__((unused)) void *nothing) {
     if (flag_glbenv) {
         nvimcom_globalenv_list();
         flag_glbenv = 0;
+    } else if (glbnv_names) {
+        glbnv_step();
     }
     if (flag_debug) {
         SrcrefInfo();
@@ -1009,6 +1629,9 @@ static void nvimcom_uih(__attribute__((unused)) void *data) {
         REprintf("nvimcom error: read < 1\n");
     R_ToplevelExec(nvimcom_exec, NULL);
     fired = 0;
+    // Continue the list of objects in the next idle cycle
+    if (glbnv_names)
+        nvimcom_fire();
 }
 
 /**
@@ -1186,6 +1809,33 @@ static void nvimcom_parse_received_msg(char *buf) {
             REprintf("\nvimcom: received invalid RNVIM_ID.\n");
         }
         break;
+    case 'A': // rnvimserver needs the whole list of .GlobalEnv objects
+        glbnv_full = 1;
+#ifdef WIN32
+        if (!r_is_busy)
+            nvimcom_globalenv_list();
+#else
+        flag_glbenv = 1;
+        nvimcom_fire();
+#endif
+        break;
+    case 'X': // rnvimserver needs the elements of a list
+#ifdef WIN32
+        expand_list(buf + 1);
+        if (!r_is_busy)
+            nvimcom_globalenv_list();
+#else
+        // `expanded` may be in use by the main thread
+        request_expansion(buf + 1);
+        flag_glbenv = 1;
+        nvimcom_fire();
+#endif
+        break;
+#ifndef WIN32
+    case 'S': // rnvimserver mapped the shared memory region
+        shm_accepted();
+        break;
+#endif
     case 'D':
         p = buf;
         p++;
@@ -1272,12 +1922,15 @@ static void *client_loop_thread(__attribute__((unused)) void *arg)
  * @param age Should the list of objects in .GlobalEnv be automatically
  * updated? (`R_objbr_allnames` in init.vim)
  *
+ * @param lzl Should the elements of lists be listed only when rnvimserver
+ * requests them? (`compl_data.lazy_list` in R.nvim config)
+ *
  * @param nvv nvimcom version
  *
  * @param rinfo Information on R to be passed to nvim.
  */
 SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
-                   SEXP tml, SEXP dbg, SEXP nvv, SEXP rinfo) {
+                   SEXP tml, SEXP lzl, SEXP dbg, SEXP nvv, SEXP rinfo) {
     verbose = *INTEGER(vrb);
     allnames = *INTEGER(anm);
     setwidth = *INTEGER(swd);
@@ -1285,6 +1938,7 @@ SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
     maxdepth = *INTEGER(imd);
     sizelimit = *INTEGER(szl);
     timelimit = (double)*INTEGER(tml);
+    lazy_list = *INTEGER(lzl);
     debug_r = *INTEGER(dbg);
 
 #ifdef WIN32
@@ -1313,7 +1967,7 @@ SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
     }
 
     if (getenv("RNVIM_PORT"))
-        strncpy(rns_port, getenv("RNVIM_PORT"), 15);
+        strncpy(rns_port, getenv("RNVIM_PORT"), 127);
 
     set_doc_width(getenv("R_LS_DOC_WIDTH"));
 
@@ -1364,7 +2018,13 @@ SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
 
     static int failure = 0;
 
-    if (atoi(rns_port) > 0) {
+#ifdef WIN32
+    int unix_sock = 0;
+#else
+    int unix_sock =
+        strncmp(rns_port, UNIX_SOCK_PREFIX, UNIX_SOCK_PREFIX_LEN) == 0;
+#endif
+    if (atoi(rns_port) > 0 || unix_sock) {
         struct sockaddr_in servaddr;
 #ifdef WIN32
         WSADATA d;
@@ -1374,18 +2034,32 @@ SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
         }
 #endif
         // socket create and verification
-        sfd = socket(AF_INET, SOCK_STREAM, 0);
+        sfd = socket(unix_sock ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
         if (sfd != -1) {
-            memset(&servaddr, '\0', sizeof(servaddr));
+            int res;
+#ifndef WIN32
+            if (unix_sock) {
+                struct sockaddr_un unaddr;
+                memset(&unaddr, '\0', sizeof(unaddr));
+                unaddr.sun_family = AF_UNIX;
+                strncpy(unaddr.sun_path, rns_port + UNIX_SOCK_PREFIX_LEN,
+                        sizeof(unaddr.sun_path) - 1);
+                res = connect(sfd, (struct sockaddr *)&unaddr, sizeof(unaddr));
+            } else
+#endif
+            {
+                memset(&servaddr, '\0', sizeof(servaddr));
 
-            // assign IP, PORT
-            servaddr.sin_family = AF_INET;
-            servaddr.sin_addr.s_addr = inet_addr(rns_addr);
-            servaddr.sin_port = htons(atoi(rns_port));
+                // assign IP, PORT
+                servaddr.sin_family = AF_INET;
+                servaddr.sin_addr.s_addr = inet_addr(rns_addr);
+                servaddr.sin_port = htons(atoi(rns_port));
 
-            // connect the client socket to server socket
-            if (connect(sfd, (struct sockaddr *)&servaddr, sizeof(servaddr)) ==
-                0) {
+                // connect the client socket to server socket
+                res = connect(sfd, (struct sockaddr *)&servaddr,
+                              sizeof(servaddr));
+            }
+            if (res == 0) {
 #ifdef WIN32
                 DWORD ti;
                 tid = CreateThread(NULL, 0, client_loop_thread, NULL, 0, &ti);
@@ -1393,6 +2067,8 @@ SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
                                           CHAR(STRING_ELT(nvv, 0)));
 #else
                 pthread_create(&tid, NULL, client_loop_thread, NULL);
+                if (!getenv("RNVIM_REMOTE_R"))
+                    shm_create();
                 snprintf(flag_eval, 510, "nvimcom:::send_nvimcom_info('%d')",
                          getpid());
                 nvimcom_fire();
@@ -1403,7 +2079,7 @@ SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP lsl, SEXP imd, SEXP szl,
                 failure = 1;
             }
         } else {
-            REprintf("nvimcom: socket creation failed (%d)\n", atoi(rns_port));
+            REprintf("nvimcom: socket creation failed (%s)\n", rns_port);
             failure = 1;
         }
     }
@@ -1457,6 +2133,7 @@ void nvimcom_Stop(void) {
         close(sfd);
         pthread_cancel(tid);
         pthread_join(tid, NULL);
+        shm_close();
 #endif
 
         LibInfo *lib = libList;
@@ -1474,6 +2151,24 @@ void nvimcom_Stop(void) {
             free(glbnvbuf2);
         if (send_ge_buf)
             free(send_ge_buf);
+        for (int i = 0; i < nmemo; i++)
+            free(memo[i].name);
+        free(memo);
+        free(memo_ht);
+        for (int i = 0; i < new_nmemo; i++)
+            free(new_memo[i].name);
+        free(new_memo);
+        if (glbnv_names)
+            R_ReleaseObject(glbnv_names);
+        amemo_free();
+        for (int i = 0; i < nexpanded; i++)
+            free(expanded[i]);
+        free(expanded);
+#ifndef WIN32
+        free(exp_pending);
+        exp_pending = NULL;
+        exp_len = 0;
+#endif
         if (verbose)
             REprintf("nvimcom stopped\n");
     }
@@ -4,7 +4,7 @@
 #include <Rdefines.h>
 
 SEXP nvimcom_Start(SEXP vrb, SEXP anm, SEXP swd, SEXP age, SEXP imd, SEXP szl,
-                   SEXP tml, SEXP nvv, SEXP rinfo);
+                   SEXP tml, SEXP lzl, SEXP dbg, SEXP nvv, SEXP rinfo);
 void nvimcom_Stop(void);
 void nvimcom_msg_to_nvim(char **cmd);
 void nvimcom_task(void);
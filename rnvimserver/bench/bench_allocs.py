@@ -0,0 +1,104 @@
+"""Memory allocations per request.
+
+Builds malloc_count.c, starts rnvimserver with it preloaded and counts the
+calls to malloc(), calloc() and realloc() made while answering cycles of
+requests: hover, signature help, completion of function arguments and
+completion of object names. Reports the allocations per cycle and per kind
+of request. The "null" requests are hovers of unknown words; they show the
+allocations of handling any request, as opposed to building its reply.
+
+Usage: python3 bench_allocs.py RNVIMSERVER [NCYCLES]
+
+Requires a C compiler and glibc.
+"""
+
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+import rns
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def build(tmp):
+    so = os.path.join(tmp, "malloc_count.so")
+    cc = os.environ.get("CC", "cc")
+    src = os.path.join(HERE, "malloc_count.c")
+    subprocess.check_call([cc, "-O2", "-shared", "-fPIC", src, "-o", so])
+    return so
+
+
+def main():
+    binary = sys.argv[1]
+    ncycles = int(sys.argv[2]) if len(sys.argv) > 2 else 1000
+    tmp = tempfile.mkdtemp(prefix="rnsallocs")
+    so = build(tmp)
+    cnt = os.path.join(tmp, "count")
+    names = ["fun%d" % i for i in range(100)]
+
+    def setup(d):
+        objs = [
+            (nm, "F", "function", "x\x05y\x04NULL\x05...\x05", "Title", "Descr")
+            for nm in names
+        ]
+        objs += [
+            ("obj%d" % i, "n", "numeric", "", "Title", "Descr") for i in range(1000)
+        ]
+        rns.write_package(d, "allocbench", objs)
+
+    env = {"LD_PRELOAD": so, "MALLOC_COUNT_FILE": cnt}
+    srv = rns.Server(binary, libs=["allocbench"], setup=setup, env=env)
+
+    def count():
+        with open(cnt, "rb") as f:
+            return struct.unpack("=Q", f.read(8))[0]
+
+    def hover(w):
+        i = srv.request("textDocument/hover", {}, wait=False)
+        srv.notify("exeRnvimCmd", {"code": "H", "orig_id": i, "word": w})
+        srv.until_id(i)
+
+    def signature(w):
+        i = srv.request("textDocument/signatureHelp", {}, wait=False)
+        srv.notify("exeRnvimCmd", {"code": "S", "orig_id": i, "word": w})
+        srv.until_id(i)
+
+    kinds = [
+        # The reply is null: cost of receiving, dispatching and answering
+        ("null", lambda w: hover("no_such_" + w)),
+        ("hover", hover),
+        ("signature", signature),
+        ("arguments", lambda w: srv.complete(fnm=w)),
+        ("objects", lambda w: srv.complete(base="obj1")),
+    ]
+
+    # Warm up the buffers that are kept between requests
+    for _, fn in kinds:
+        for w in names:
+            fn(w)
+    srv.sync()
+
+    total = 0
+    for kind, fn in kinds:
+        c0 = count()
+        for k in range(ncycles):
+            fn(names[k % len(names)])
+        srv.sync()
+        # sync() itself allocates, so its cost is measured and subtracted
+        c1 = count()
+        srv.sync()
+        n = c1 - c0 - (count() - c1)
+        if kind != "null":
+            total += n
+        print("%-10s %6.2f allocations per request" % (kind, n / ncycles))
+    srv.close()
+    shutil.rmtree(tmp, ignore_errors=True)
+    print("cycle      %6.2f allocations" % (total / ncycles))
+
+
+if __name__ == "__main__":
+    main()
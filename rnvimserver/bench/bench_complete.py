@@ -0,0 +1,75 @@
+"""Completion ranking on a large workspace.
+
+Loads packages with 200k symbols in total and measures how many candidates
+per second the completion of a few typed words goes through (every symbol is
+a candidate of fuzzy matching).
+
+Usage: python3 bench_complete.py RNVIMSERVER [NSYMBOLS]
+"""
+
+import random
+import statistics
+import sys
+
+import rns
+
+WORDS = (
+    "read write table data frame model fit plot summary print list apply "
+    "select filter matrix vector test value method object class csv json "
+    "group mutate join split"
+).split()
+BASES = ["rdcsv", "plt", "dfm", "mdlfit", "gsum", "as.d", "wrtj"]
+NPKGS = 4
+
+
+def names(n, seed):
+    rnd = random.Random(seed)
+    out = set()
+    while len(out) < n:
+        w = [rnd.choice(WORDS) for _ in range(rnd.randint(1, 3))]
+        sep = rnd.choice("._")
+        nm = sep.join(w)
+        if rnd.random() < 0.3:
+            nm = w[0] + "".join(x.capitalize() for x in w[1:])
+        out.add(nm + str(rnd.randint(0, 999)))
+    return sorted(out)
+
+
+def main():
+    binary = sys.argv[1]
+    nsym = int(sys.argv[2]) if len(sys.argv) > 2 else 200000
+    pkgs = ["bench%d" % i for i in range(NPKGS)]
+
+    def setup(d):
+        for i, p in enumerate(pkgs):
+            objs = [
+                (nm, "F", "function", "x\x05", "Title", "Descr")
+                for nm in names(nsym // NPKGS, i)
+            ]
+            rns.write_package(d, p, objs)
+
+    srv = rns.Server(binary, libs=pkgs, setup=setup)
+    srv.complete(base="warmup")
+
+    total_t = 0.0
+    total_n = 0
+    rates = []
+    for b in BASES:
+        items = [0]
+
+        def run():
+            items[0] = len(srv.complete(base=b)["result"]["items"])
+
+        t = rns.best_of(5, run)
+        print("%-8s %6d items %8.2f ms" % (b, items[0], t * 1000))
+        total_t += t
+        total_n += nsym
+        rates.append(nsym / t)
+    srv.close()
+    # The words that match many names are dominated by the size of the reply
+    print("candidates/s: %.1f M overall" % (total_n / total_t / 1e6))
+    print("candidates/s: %.1f M median" % (statistics.median(rates) / 1e6))
+
+
+if __name__ == "__main__":
+    main()
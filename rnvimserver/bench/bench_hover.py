@@ -0,0 +1,90 @@
+"""Hover documentation of functions with large descriptions.
+
+Loads a package whose functions have descriptions of 10 to 60 kB (with quotes,
+backslashes and tabs to be escaped) and requests the hover documentation of
+each one, as Neovim does, one request at a time. Reports responses per
+second and MB per second of responses, and the user CPU time of rnvimserver
+per response (less affected by the time spent in Python).
+
+Usage: python3 bench_hover.py RNVIMSERVER [NFUNCTIONS]
+"""
+
+import random
+import sys
+import time
+
+import rns
+
+WORDS = (
+    'the value of "x" is a numeric vector or a data.frame with columns; see '
+    "\\code{summary} and the argument 'na.rm' for\tdetails (default TRUE)."
+).split(" ")
+
+
+def descr(rnd, size):
+    out = []
+    n = 0
+    while n < size:
+        w = rnd.choice(WORDS)
+        if rnd.random() < 0.01:
+            w += "\x14\x14"
+        out.append(w)
+        n += len(w) + 1
+    return " ".join(out)
+
+
+def main():
+    binary = sys.argv[1]
+    nfun = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+    rnd = random.Random(1)
+    names = ["fun%d" % i for i in range(nfun)]
+
+    def setup(d):
+        objs = [
+            (
+                nm,
+                "F",
+                "function",
+                "x\x05y\x04NULL\x05na.rm\x04FALSE\x05...\x05",
+                "Title of %s" % nm,
+                descr(rnd, rnd.randint(10000, 60000)),
+            )
+            for nm in names
+        ]
+        rns.write_package(d, "hoverbench", objs)
+
+    srv = rns.Server(binary, libs=["hoverbench"], setup=setup, max_decode=4096)
+
+    def hover(word):
+        i = srv.request("textDocument/hover", {}, wait=False)
+        prm = {"code": "H", "orig_id": i, "word": word}
+        srv.notify("exeRnvimCmd", prm)
+        m = srv.until_id(i)
+        if "size" not in m:
+            raise RuntimeError("unexpected reply: %s" % str(m)[:200])
+
+    for w in names:
+        hover(w)
+
+    best = None
+    cpu0 = srv.cpu_time()
+    for _ in range(20):
+        out0 = srv.out_bytes
+        t0 = time.perf_counter()
+        for w in names:
+            hover(w)
+        dt = time.perf_counter() - t0
+        if best is None or dt < best:
+            best = dt
+            mb = (srv.out_bytes - out0) / 1e6
+    cpu = (srv.cpu_time() - cpu0) / (20 * nfun)
+    srv.close()
+    print(
+        "hover: %d responses, %.1f MB in %.3f s: %.0f responses/s, %.1f MB/s"
+        % (nfun, mb, best, nfun / best, mb / best)
+    )
+    print("rnvimserver CPU time: %.0f us per response" % (cpu * 1e6))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,106 @@
+"""Memory used by the caches of many packages.
+
+Writes the cache files of 1000 synthetic packages with 50-600 objects each.
+As in real packages, the objects are documented on help pages of about
+three objects that share their title, description and arguments. Starts
+rnvimserver with all of them loaded and reports the size of the binary cache
+images built from these files and the resident memory of the server, both on
+the first start (when the images are built) and on a second start (when they
+are only mapped).
+
+Usage: python3 bench_memory.py RNVIMSERVER [NPKGS]
+
+Requires Linux (/proc).
+"""
+
+import os
+import random
+import shutil
+import sys
+import tempfile
+
+import rns
+
+WORDS = (
+    "the a of to and in data model value values object list vector matrix "
+    "function argument default numeric character logical frame column row "
+    "names method class returns optional formula fit plot print summary"
+).split()
+
+
+def text(rnd, n):
+    return " ".join(rnd.choice(WORDS) for _ in range(n))
+
+
+def package(rnd, name):
+    """Objects of a package, three per help page on average."""
+    objs = []
+    n = rnd.randint(50, 600)
+    while len(objs) < n:
+        title = text(rnd, rnd.randint(3, 8)).capitalize()
+        descr = text(rnd, rnd.randint(15, 60)) + "."
+        args = "".join(
+            "%s\x04%s\x05" % (rnd.choice(WORDS), rnd.choice(["NULL", "TRUE", "1"]))
+            if rnd.random() < 0.5
+            else rnd.choice(WORDS) + "\x05"
+            for _ in range(rnd.randint(1, 6))
+        )
+        for _ in range(rnd.randint(1, 5)):
+            nm = "%s_%s%d" % (rnd.choice(WORDS), name, len(objs))
+            if rnd.random() < 0.8:
+                objs.append((nm, "F", "function", args, title, descr))
+            else:
+                objs.append((nm, "l", "data.frame", "", title, descr))
+    return objs
+
+
+def generate(d, npkgs):
+    rnd = random.Random(1)
+    libs = []
+    for i in range(npkgs):
+        name = "pkg%d" % i
+        rns.write_package(d, name, package(rnd, name), "Package %d" % i)
+        libs.append(name)
+    return libs
+
+
+def measure(binary, compldir, libs):
+    srv = rns.Server(binary, libs=libs, compldir=compldir)
+    # Complete from every package, so that their images are read
+    srv.complete(base="a")
+    srv.complete(base="d")
+    srv.sync()
+    mem = srv.memory()
+    srv.close()
+    return mem
+
+
+def main():
+    binary = sys.argv[1]
+    npkgs = int(sys.argv[2]) if len(sys.argv) > 2 else 1000
+    compldir = tempfile.mkdtemp(prefix="rnsmemory")
+    libs = generate(compldir, npkgs)
+    objls = sum(
+        os.path.getsize(os.path.join(compldir, f))
+        for f in os.listdir(compldir)
+        if f.startswith("objls_")
+    )
+    print("objls files:    %6.1f MB" % (objls / 1e6))
+    for run in ("first start", "second start"):
+        mem = measure(binary, compldir, libs)
+        if run == "first start":
+            img = sum(
+                os.path.getsize(os.path.join(compldir, f))
+                for f in os.listdir(compldir)
+                if f.startswith("bincache_")
+            )
+            print("bincache files: %6.1f MB" % (img / 1e6))
+        print(
+            "%-13s VmRSS %6.1f MB (file-backed %6.1f MB, anonymous %6.1f MB)"
+            % (run, mem["VmRSS"] / 1e3, mem["RssFile"] / 1e3, mem["RssAnon"] / 1e3)
+        )
+    shutil.rmtree(compldir, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    main()
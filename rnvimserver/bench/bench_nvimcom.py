@@ -0,0 +1,180 @@
+"""Throughput of the messages from nvimcom (TCP connection).
+
+Plays the role of nvimcom: connects to rnvimserver and sends the listing of
+.GlobalEnv (+G) as R does after each top-level command, followed by a command
+to be forwarded to Neovim. The time is measured until this command arrives at
+stdout, that is, until every message before it was received and handled.
+
+With --edit, the listing has ten large lists (as fitted models) and a scalar
+that changes at each prompt. Either the whole listing (+G) or the edit of the
+line of the scalar (+g) is sent at each prompt, and the number of prompts per
+second is reported for both.
+
+Usage: python3 bench_nvimcom.py RNVIMSERVER [MB]
+       python3 bench_nvimcom.py RNVIMSERVER --edit [MB]
+"""
+
+import random
+import sys
+import time
+
+import rns
+
+
+def line(name, cls, tp, args="", title="", descr=""):
+    return "\x06".join([name, cls, tp, ".GlobalEnv", args, title, descr]) + "\x06\n"
+
+
+def listing(size, seed=1):
+    """Listing of about size bytes with functions, vectors and data.frames."""
+    rnd = random.Random(seed)
+    out = []
+    n = 0
+    i = 0
+    while n < size:
+        k = rnd.random()
+        if k < 0.2:
+            ln = [line("fun%d" % i, "F", "function", "x\x05y\x04NULL\x05")]
+        elif k < 0.6:
+            ln = [line("vec%d" % i, "n", "numeric")]
+        else:
+            df = "df%d" % i
+            ln = [line(df, "l", "data.frame")]
+            for j in range(rnd.randint(2, 12)):
+                ln.append(line("%s$col%d" % (df, j), "n", "numeric"))
+        out += ln
+        n += sum(len(x) for x in ln)
+        i += 1
+    return "".join(out).encode()
+
+
+def models(size):
+    """Listing of ten nested lists of about size bytes and its line count."""
+    out = []
+    n = size // 10 // 60
+    for i in range(10):
+        m = "model%d" % i
+        out.append(line(m, "l", "list"))
+        for j in range(n // 10):
+            out.append(line("%s$fit%d" % (m, j), "l", "list"))
+            for k in range(9):
+                out.append(line("%s$fit%d$coef%d" % (m, j, k), "n", "numeric"))
+    return "".join(out).encode(), len(out)
+
+
+class Client:
+    def __init__(self, binary):
+        self.srv = rns.Server(binary)
+        self.sock = self.srv.connect_nvimcom()
+        self.nmark = 0
+
+    def send(self, payload):
+        self.sock.sendall(rns.frame(payload))
+
+    def sync(self):
+        """Wait until every message sent so far was handled."""
+        self.nmark += 1
+        mark = "bench_mark(%d)" % self.nmark
+        self.send(mark.encode())
+        while True:
+            m = self.srv.msgs.get(timeout=600)
+            if m is None:
+                raise RuntimeError("rnvimserver exited")
+            if m.get("params", {}).get("command") == mark:
+                return
+
+    def rate(self, gen, reset=None):
+        """Time the handling of the messages made by gen(reps), with reps
+        increased until it takes about 1 s. reset, if given, is called
+        before each run (and not timed)."""
+        reps = 1
+        while True:
+            best = None
+            for _ in range(3):
+                if reset:
+                    reset()
+                msgs = gen(reps)
+                t0 = time.perf_counter()
+                for m in msgs:
+                    self.send(m)
+                self.sync()
+                dt = time.perf_counter() - t0
+                best = dt if best is None else min(best, dt)
+            if best > 0.5:
+                return best / reps
+            reps *= 4
+
+    def asked_full(self):
+        """Whether rnvimserver asked for the whole listing (rejected +g)."""
+        self.sock.setblocking(False)
+        try:
+            return b"A" in self.sock.recv(1 << 16)
+        except BlockingIOError:
+            return False
+        finally:
+            self.sock.setblocking(True)
+
+    def close(self):
+        self.srv.close()
+
+
+def full(cl, size):
+    glb = listing(int(size * 1e6))
+    cl.send(b"+G" + glb)
+    cl.sync()
+
+    # Two listings that differ only in the first line, so that each one
+    # replaces the other
+    msgs = [b"+G" + glb, b"+G" + glb.replace(b"fun0", b"fun_", 1)]
+    t = cl.rate(lambda reps: msgs * reps)
+    mb = sum(len(m) for m in msgs) / 1e6
+    print("+G: %.1f MB in %.3f s: %.1f MB/s" % (mb, t, mb / t))
+
+
+def edit(cl, size):
+    glb, nlines = models(int(size * 1e6))
+    scalars = [line("x", "n", "numeric"), line("x", "n", "integer")]
+    lst = [glb + s.encode() for s in scalars]
+
+    t = cl.rate(lambda reps: [b"+G" + lst[i % 2] for i in range(reps)])
+    print(
+        "+G: %.2f MB per prompt, %.1f prompts/s"
+        % (len(lst[0]) / 1e6, 1 / t)
+    )
+
+    def reset():
+        # The edits are numbered from the last whole listing
+        cl.send(b"+G" + lst[0])
+        cl.sync()
+
+    def edits(reps):
+        out = []
+        for i in range(reps):
+            e = "+g%d|%d|1|%s" % (i, nlines, scalars[(i + 1) % 2])
+            out.append(e.encode())
+        return out
+
+    t = cl.rate(edits, reset)
+    if cl.asked_full():
+        print("rnvimserver rejected an edit")
+    print(
+        "+g: %d bytes per prompt, %.1f prompts/s"
+        % (len(edits(1)[0]), 1 / t)
+    )
+
+
+def main():
+    args = sys.argv[1:]
+    binary = args.pop(0)
+    mode = full
+    if args and args[0] == "--edit":
+        mode = edit
+        args.pop(0)
+    size = float(args[0]) if args else 5
+    cl = Client(binary)
+    mode(cl, size)
+    cl.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+"""Throughput of the LSP transport (stdin of rnvimserver).
+
+Replays sessions of LSP messages and measures how fast rnvimserver reads
+them. The generated sessions are made of results that the Lua side sends
+through exeRnvimCmd for requests that were already answered (as when the user
+kept typing): rnvimserver reads them and drops them without writing anything,
+so that the time is not spent in producing and reading replies. There are two
+sessions: large results of workspace symbols (reported in MB/s) and many
+small messages (reported in messages/s). Each session is written to the pipe
+at once; the time is measured until the reply to a final request.
+
+Usage: python3 bench_stdin.py RNVIMSERVER [SESSION_FILE]
+
+If SESSION_FILE is given, it is replayed instead (it must have LSP messages
+with their Content-Length headers, as recorded from the stdin of
+rnvimserver).
+"""
+
+import random
+import sys
+
+import rns
+
+
+def symbol(rnd, i):
+    return {
+        "name": "sym_%d_%d" % (i, rnd.randint(0, 1 << 30)),
+        "kind": 12,
+        "location": {
+            "uri": "file:///home/user/project/R/file%d.R" % rnd.randint(0, 99),
+            "range": {
+                "start": {"line": i, "character": 0},
+                "end": {"line": i, "character": 10},
+            },
+        },
+    }
+
+
+def large_session():
+    rnd = random.Random(1)
+    out = []
+    for r in range(100):
+        n = int(rnd.expovariate(1 / 1500)) + 1
+        syms = [symbol(rnd, i) for i in range(n)]
+        prm = {"code": "W", "orig_id": 2000000 + r, "symbols": syms}
+        msg = {"jsonrpc": "2.0", "method": "exeRnvimCmd", "params": prm}
+        out.append(rns.Server.encode(msg))
+    return b"".join(out)
+
+
+def small_session():
+    out = []
+    for i in range(200000):
+        prm = {"code": "N%d" % (1000000 + i)}
+        msg = {"jsonrpc": "2.0", "method": "exeRnvimCmd", "params": prm}
+        out.append(rns.Server.encode(msg))
+    return b"".join(out)
+
+
+def replay(srv, data):
+    """Time the replay of data, repeated until it takes about 1 s."""
+    reps = 1
+    while True:
+        t = rns.best_of(3, lambda: (srv.write(data * reps), srv.sync()))
+        if t > 0.5:
+            return t / reps
+        reps *= 4
+
+
+def main():
+    binary = sys.argv[1]
+    srv = rns.Server(binary)
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "rb") as f:
+            data = f.read()
+        t = replay(srv, data)
+        mb = len(data) / 1e6
+        print("session: %.1f MB in %.3f s: %.1f MB/s" % (mb, t, mb / t))
+    else:
+        data = large_session()
+        t = replay(srv, data)
+        mb = len(data) / 1e6
+        print("large: %.1f MB in %.3f s: %.1f MB/s" % (mb, t, mb / t))
+        data = small_session()
+        n = data.count(b"Content-Length")
+        t = replay(srv, data)
+        print("small: %d messages in %.3f s: %.2f M/s" % (n, t, n / t / 1e6))
+    srv.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,55 @@
+/*
+ * Count the calls to malloc(), calloc() and realloc() of a process. Build it
+ * as a shared library and load it with LD_PRELOAD (glibc only):
+ *
+ *     cc -O2 -shared -fPIC malloc_count.c -o malloc_count.so
+ *     MALLOC_COUNT_FILE=/tmp/count LD_PRELOAD=./malloc_count.so program
+ *
+ * The count is kept in the first eight bytes of MALLOC_COUNT_FILE, which is
+ * mapped in memory, so that other processes can read it while the program
+ * runs.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t local_count;
+static uint64_t *count = &local_count;
+
+__attribute__((constructor)) static void map_count(void) {
+    const char *path = getenv("MALLOC_COUNT_FILE");
+    if (!path)
+        return;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return;
+    if (ftruncate(fd, sizeof(uint64_t)) == 0) {
+        void *p = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            count = p;
+    }
+    close(fd);
+}
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
@@ -0,0 +1,231 @@
+"""Helpers shared by the benchmarks of rnvimserver.
+
+Server starts an rnvimserver binary with its own temporary and cache
+directories, talks LSP with it through stdin/stdout (as Neovim does) and can
+play the role of nvimcom through the TCP connection.
+"""
+
+import json
+import os
+import queue
+import re
+import shutil
+import socket
+import subprocess
+import tempfile
+import threading
+import time
+
+SECRET = "bench"
+
+
+def write_package(compldir, name, objs, title="Title", descr="Description"):
+    """Write the cache files of a package.
+
+    objs is a list of (name, cls, type, args, title, descr) tuples. Each
+    argument ends with \\x05 and its default value, if any, follows its name
+    after \\x04, as in the files written by nvimcom.
+    """
+    lines = []
+    for nm, cls, tp, args, ttl, dsc in objs:
+        lines.append("\x06".join([nm, cls, tp, name, args, ttl, dsc]) + "\x06\n")
+    with open(os.path.join(compldir, "objls_%s_1.0" % name), "w") as f:
+        f.write("".join(lines))
+    with open(os.path.join(compldir, "alias_%s" % name), "w") as f:
+        f.write("%s\x06%s\n" % (title, descr))
+    with open(os.path.join(compldir, "args_%s" % name), "w") as f:
+        f.write("")
+
+
+def frame(payload):
+    """Frame a message from nvimcom: secret, size, payload and \\x11."""
+    return SECRET.encode() + b"%09d" % len(payload) + payload + b"\x11"
+
+
+class Server:
+    def __init__(
+        self,
+        binary,
+        libs=(),
+        setup=None,
+        env=None,
+        stderr=None,
+        max_decode=None,
+        compldir=None,
+    ):
+        """Start a server.
+
+        libs are the names of packages to be loaded; setup, if given, is
+        called with the cache directory before the server starts. Messages
+        from the server longer than max_decode bytes are not decoded: only
+        their id and size are queued, so that decoding them in Python does not
+        take most of the time of a benchmark. If compldir is given, it is used
+        as the cache directory and kept when the server is closed.
+        """
+        self.dir = tempfile.mkdtemp(prefix="rnsbench")
+        self.tmpdir = os.path.join(self.dir, "tmp")
+        os.mkdir(self.tmpdir)
+        if compldir:
+            self.compldir = compldir
+        else:
+            self.compldir = os.path.join(self.dir, "compl")
+            os.mkdir(self.compldir)
+        if setup:
+            setup(self.compldir)
+        with open(os.path.join(self.tmpdir, "libnames_B"), "w") as f:
+            f.write(",".join(libs) + "#")
+        e = dict(
+            os.environ,
+            RNVIM_TMPDIR=self.tmpdir,
+            RNVIM_COMPLDIR=self.compldir,
+            RNVIM_ID="B",
+            RNVIM_SECRET=SECRET,
+            R_LS_DOC_WIDTH="80",
+            RNVIM_MAX_DEPTH="3",
+        )
+        e.update(env or {})
+        self.p = subprocess.Popen(
+            [binary],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            stderr=stderr or subprocess.DEVNULL,
+            env=e,
+        )
+        self.msgs = queue.Queue()
+        self.out_bytes = 0
+        self.max_decode = max_decode
+        self.reader = threading.Thread(target=self._read, daemon=True)
+        self.reader.start()
+        self.nid = 0
+        self.sock = None
+
+        self.request("initialize", {})
+        self.notify("initialized", {})
+        self.notify("exeRnvimCmd", {"code": "41"})
+        self.sync()
+
+    def _read(self):
+        fd = self.p.stdout.fileno()
+        buf = b""
+        while True:
+            d = os.read(fd, 1 << 20)
+            if not d:
+                self.msgs.put(None)
+                return
+            buf += d
+            while True:
+                i = buf.find(b"\r\n\r\n")
+                if i < 0:
+                    break
+                n = int(buf[:i].split(b":")[1])
+                if len(buf) < i + 4 + n:
+                    break
+                self.out_bytes += i + 4 + n
+                body = buf[i + 4 : i + 4 + n]
+                if self.max_decode and n > self.max_decode:
+                    m = re.search(rb'"id": *(\d+)', body[:64])
+                    self.msgs.put({"id": m and int(m.group(1)), "size": n})
+                else:
+                    self.msgs.put(json.loads(body))
+                buf = buf[i + 4 + n :]
+
+    @staticmethod
+    def encode(obj):
+        b = json.dumps(obj, separators=(",", ":")).encode()
+        return b"Content-Length: %d\r\n\r\n" % len(b) + b
+
+    def write(self, data):
+        self.p.stdin.write(data)
+        self.p.stdin.flush()
+
+    def notify(self, method, params):
+        self.write(self.encode({"jsonrpc": "2.0", "method": method, "params": params}))
+
+    def next_id(self):
+        self.nid += 1
+        return self.nid
+
+    def request(self, method, params, wait=True):
+        i = self.next_id()
+        msg = {"jsonrpc": "2.0", "id": i, "method": method, "params": params}
+        self.write(self.encode(msg))
+        return self.until_id(i) if wait else i
+
+    def until_id(self, i, timeout=60):
+        while True:
+            m = self.msgs.get(timeout=timeout)
+            if m is None:
+                raise RuntimeError("rnvimserver exited")
+            if m.get("id") == i:
+                return m
+
+    def sync(self):
+        """Wait until every message sent so far was handled."""
+        self.request("initialize", {})
+
+    def complete(self, **prm):
+        pos = {"position": {"line": 0, "character": 1}}
+        i = self.request("textDocument/completion", pos, wait=False)
+        prm.update({"code": "5", "orig_id": i})
+        self.notify("exeRnvimCmd", prm)
+        return self.until_id(i)
+
+    def connect_nvimcom(self):
+        """Connect to the server as nvimcom does."""
+        self.notify("exeRnvimCmd", {"code": "1"})
+        while True:
+            m = self.msgs.get(timeout=10)
+            if m is None:
+                raise RuntimeError("rnvimserver exited")
+            s = json.dumps(m)
+            if "set_rns_port" in s:
+                port = int(s.split("set_rns_port('")[1].split("'")[0])
+                break
+        # Older versions announce the port before listening on it
+        for _ in range(100):
+            try:
+                self.sock = socket.create_connection(("127.0.0.1", port))
+                break
+            except ConnectionRefusedError:
+                time.sleep(0.05)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        return self.sock
+
+    def memory(self):
+        """Resident memory of the server (VmRSS, RssAnon and RssFile of
+        /proc/PID/status), in kB (Linux only)."""
+        m = {}
+        with open("/proc/%d/status" % self.p.pid) as f:
+            for ln in f:
+                k, _, v = ln.partition(":")
+                if k in ("VmRSS", "RssAnon", "RssFile"):
+                    m[k] = int(v.split()[0])
+        return m
+
+    def cpu_time(self):
+        """User CPU time of the server so far, in seconds (Linux only)."""
+        with open("/proc/%d/stat" % self.p.pid) as f:
+            st = f.read().rsplit(")", 1)[1].split()
+        return int(st[11]) / os.sysconf("SC_CLK_TCK")
+
+    def close(self):
+        try:
+            self.notify("exit", {})
+            self.p.stdin.close()
+            self.p.wait(timeout=10)
+        except (OSError, subprocess.TimeoutExpired):
+            self.p.kill()
+        if self.sock:
+            self.sock.close()
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+
+def best_of(n, fn):
+    """Run fn() n times and return the shortest time."""
+    best = None
+    for _ in range(n):
+        t0 = time.perf_counter()
+        fn()
+        dt = time.perf_counter() - t0
+        best = dt if best is None else min(best, dt)
+    return best
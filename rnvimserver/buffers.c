@@ -0,0 +1,81 @@
+#include <stdlib.h>
+
+#include "buffers.h"
+#include "logging.h"
+
+/*
+ * Buffers reused across requests. A StrBuf keeps its memory when it is
+ * reset, and so does an Arena, whose memory is handed out by moving an
+ * offset forward. Hence, once the buffers are big enough for the largest
+ * requests, handling a request does not allocate memory.
+ */
+
+#define ARENA_ALIGN 16       // Alignment of the memory of an arena
+#define ARENA_MIN_SIZE 16384 // Size of the first block of an arena
+#define STRBUF_MIN_SIZE 4096 // Size of the first buffer of a StrBuf
+
+/**
+ * @brief Make room for `n` more bytes (and the terminating '\0') in a
+ * string. The size is at least doubled.
+ */
+void sb_grow(StrBuf *s, size_t n) {
+    size_t sz = s->sz ? 2 * s->sz : STRBUF_MIN_SIZE;
+    while (sz <= s->len + n)
+        sz *= 2;
+    Log("\x1b[31msb_grow\x1b[0m: %zu -> %zu", s->sz, sz);
+    s->b = realloc(s->b, sz);
+    s->sz = sz;
+}
+
+/**
+ * @brief Empty a string without releasing its memory.
+ */
+void sb_reset(StrBuf *s) {
+    if (!s->b)
+        sb_grow(s, 0);
+    s->len = 0;
+    *s->b = '\0';
+}
+
+/**
+ * @brief Get memory from an arena. The memory is valid until the arena is
+ * reset.
+ * @param a The arena.
+ * @param n Number of bytes.
+ * @return Pointer to memory aligned to ARENA_ALIGN bytes.
+ */
+void *arena_alloc(Arena *a, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (a->off + n > a->sz) {
+        // Start a new block, at least twice as big as the current one. The
+        // first bytes of a block link it to the previous one.
+        size_t sz = a->sz ? 2 * a->sz : ARENA_MIN_SIZE;
+        while (sz < n + ARENA_ALIGN)
+            sz *= 2;
+        Log("\x1b[31marena_alloc\x1b[0m: new block of %zu bytes", sz);
+        if (a->b) {
+            *(char **)a->b = a->full;
+            a->full = a->b;
+        }
+        a->b = malloc(sz);
+        a->sz = sz;
+        a->off = ARENA_ALIGN;
+    }
+    void *p = a->b + a->off;
+    a->off += n;
+    return p;
+}
+
+/**
+ * @brief Release all memory got from an arena. Only the last block is kept,
+ * and the others are freed. Since each new block is bigger than the previous
+ * ones, the arena has a single block after the first requests.
+ */
+void arena_reset(Arena *a) {
+    while (a->full) {
+        char *prev = *(char **)a->full;
+        free(a->full);
+        a->full = prev;
+    }
+    a->off = ARENA_ALIGN;
+}
@@ -0,0 +1,41 @@
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include <stddef.h>
+#include <string.h>
+
+// String that tracks its length and grows geometrically. The string is
+// always terminated by '\0' (once something was added to it).
+typedef struct str_buf_ {
+    char *b;    // The string
+    size_t len; // Length of the string
+    size_t sz;  // Allocated size
+} StrBuf;
+
+// Memory for the temporary data of a request, released all at once
+typedef struct arena_ {
+    char *b;    // Current block
+    size_t off; // Offset of the free memory in the current block
+    size_t sz;  // Size of the current block
+    char *full; // Blocks filled while handling the current request
+} Arena;
+
+void sb_grow(StrBuf *s, size_t n);
+void sb_reset(StrBuf *s);
+
+static inline void sb_add(StrBuf *s, const char *str, size_t len) {
+    if (s->len + len >= s->sz)
+        sb_grow(s, len);
+    memcpy(s->b + s->len, str, len);
+    s->len += len;
+    s->b[s->len] = '\0';
+}
+
+static inline void sb_cat(StrBuf *s, const char *str) {
+    sb_add(s, str, strlen(str));
+}
+
+void *arena_alloc(Arena *a, size_t n);
+void arena_reset(Arena *a);
+
+#endif
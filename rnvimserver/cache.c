@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include "cache.h"
+#include "intern.h"
+#include "objindex.h"
+#include "logging.h"
+#include "utilities.h"
+
+/*
+ * The `objls_`, `alias_`, `args_` and `srcref_` files written by nvimcom are
+ * converted into a single `bincache_` file the first time that a package is
+ * needed. The binary file has a header, the arrays of the table of objects
+ * (see obj_arrays_size()) and the contents of the four text files with the
+ * \006 separators already replaced with NUL bytes. Repeated fields of the
+ * objls_ file are stored only once (see dedup_pool()). Hence, in subsequent
+ * sessions, the file can be mapped in memory and used without any parsing.
+ */
+
+#define CACHE_MAGIC 0x43564e52 // "RNVC"
+#define CACHE_VERSION 3
+
+enum { SRC_OBJLS, SRC_ALIAS, SRC_ARGS, SRC_SRCREF, SRC_N };
+
+typedef struct cache_header_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nobjs;       // Number of records in the objls_ file
+    uint32_t sz[SRC_N];   // Size of each string pool (0 if missing)
+    uint32_t reserved;    // Keep the int64_t fields aligned
+    int64_t mtime[SRC_N]; // Modification time of each text file
+    int64_t fsize[SRC_N]; // Size of each text file
+} CacheHeader;
+
+static void src_paths(const PkgData *pd, const char *dir, char p[][512]) {
+    snprintf(p[SRC_OBJLS], 511, "%s/objls_%s_%s", dir, pd->name, pd->version);
+    snprintf(p[SRC_ALIAS], 511, "%s/alias_%s", dir, pd->name);
+    snprintf(p[SRC_ARGS], 511, "%s/args_%s", dir, pd->name);
+    snprintf(p[SRC_SRCREF], 511, "%s/srcref_%s", dir, pd->name);
+}
+
+// Record modification time and size of the text files. Missing files have
+// both values set to -1.
+static void src_stamps(char p[][512], int64_t *mtime, int64_t *fsize) {
+    struct stat st;
+    for (int i = 0; i < SRC_N; i++) {
+        if (stat(p[i], &st) == 0) {
+            mtime[i] = (int64_t)st.st_mtime;
+            fsize[i] = (int64_t)st.st_size;
+        } else {
+            mtime[i] = -1;
+            fsize[i] = -1;
+        }
+    }
+}
+
+/**
+ * @brief Check whether a binary cache image is consistent and was built from
+ * the current versions of the text files.
+ *
+ * @param m The image.
+ * @param sz Size of the image.
+ * @param mtime Modification times of the text files.
+ * @param fsize Sizes of the text files.
+ * @return 1 if the image can be used and 0 otherwise.
+ */
+static int valid_image(const char *m, size_t sz, const int64_t *mtime,
+                       const int64_t *fsize) {
+    if (sz < sizeof(CacheHeader))
+        return 0;
+    const CacheHeader *h = (const CacheHeader *)m;
+    if (h->magic != CACHE_MAGIC || h->version != CACHE_VERSION)
+        return 0;
+    for (int i = 0; i < SRC_N; i++)
+        if (h->mtime[i] != mtime[i] || h->fsize[i] != fsize[i])
+            return 0;
+
+    size_t expected = sizeof(CacheHeader) + obj_arrays_size(h->nobjs);
+    for (int i = 0; i < SRC_N; i++)
+        expected += h->sz[i];
+    if (expected != sz)
+        return 0;
+
+    // Every string pool must be NUL terminated, every field offset must be
+    // inside the objls_ pool and the nested members of each object must be
+    // inside the table.
+    const char *pool = m + sizeof(CacheHeader) + obj_arrays_size(h->nobjs);
+    for (int i = 0; i < SRC_N; i++) {
+        if (h->sz[i] && pool[h->sz[i] - 1] != 0)
+            return 0;
+        pool += h->sz[i];
+    }
+    const uint32_t *rec = (const uint32_t *)(m + sizeof(CacheHeader));
+    for (uint32_t i = 0; i < h->nobjs * OBJ_NFIELDS; i++)
+        if (rec[i] >= h->sz[SRC_OBJLS])
+            return 0;
+    const uint32_t *end = rec + (size_t)h->nobjs * OBJ_NFIELDS;
+    for (uint32_t i = 0; i < h->nobjs; i++)
+        if (end[i] <= i || end[i] > h->nobjs)
+            return 0;
+    return 1;
+}
+
+/**
+ * @brief Point the fields of a package to the contents of a valid image.
+ */
+static void use_image(PkgData *pd, char *m, size_t sz, int mapped) {
+    const CacheHeader *h = (const CacheHeader *)m;
+    pd->map = m;
+    pd->map_sz = sz;
+    pd->mapped = mapped;
+
+    const char *p = m + sizeof(CacheHeader);
+    pd->objs.n = h->nobjs;
+    obj_arrays_bind(&pd->objs, p);
+    p += obj_arrays_size(h->nobjs);
+    pd->objs.pool = p;
+    p += h->sz[SRC_OBJLS];
+
+    if (h->sz[SRC_ALIAS]) {
+        // title\0descr\0alias...
+        const char *end = p + h->sz[SRC_ALIAS] - 1;
+        pd->title = p;
+        pd->descr = pd->title + strlen(pd->title);
+        if (pd->descr < end)
+            pd->descr++;
+        pd->alias = pd->descr + strlen(pd->descr);
+        if (pd->alias < end)
+            pd->alias++;
+    }
+    p += h->sz[SRC_ALIAS];
+    if (h->sz[SRC_ARGS])
+        pd->args = p;
+    p += h->sz[SRC_ARGS];
+    if (h->sz[SRC_SRCREF])
+        pd->srcref = p;
+}
+
+#ifndef WIN32
+static char *map_file(const char *fn, size_t *sz) {
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return NULL;
+    *sz = st.st_size;
+    return m;
+}
+#else
+static char *map_file(const char *fn, size_t *sz) {
+    FILE *f = fopen(fn, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0L, SEEK_END);
+    long n = ftell(f);
+    if (n <= 0) {
+        fclose(f);
+        return NULL;
+    }
+    rewind(f);
+    char *m = malloc(n);
+    if (1 != fread(m, n, 1, f)) {
+        free(m);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *sz = n;
+    return m;
+}
+#endif
+
+static void unmap_file(char *m, size_t sz) {
+#ifndef WIN32
+    munmap(m, sz);
+#else
+    free(m);
+#endif
+}
+
+// Validate the srcref_ file: there must be exactly 3 \006 per line
+static int check_srcref(const char *b) {
+    const char *s0 = b;
+    int n = 0;
+    for (const char *s = b; *s; s++) {
+        if (*s == '\006')
+            n++;
+        if (*s == '\n') {
+            if (n != 3) {
+                fprintf(stderr, "srcref: bad separator count: %d (%.63s)\n",
+                        n, s0);
+                fflush(stderr);
+                return 0;
+            }
+            n = 0;
+            s0 = s + 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Write the string pool of a table again keeping a single copy of the
+ * fields that are repeated, such as the package name, the class, and the
+ * arguments, title and description shared by the functions documented
+ * together. The records are not terminated by '\n' in the new pool.
+ *
+ * @param t The table. Its offsets are updated.
+ * @param len Length of the pool.
+ * @return The new pool. Its size is returned in `len`.
+ */
+static char *dedup_pool(ObjTable *t, size_t *len) {
+    char *q = malloc(*len + 1);
+    uint32_t *rec = (uint32_t *)t->rec;
+    StrSet set = {0};
+    uint32_t off = 0;
+    for (uint32_t i = 0; i < t->n; i++) {
+        for (int k = 0; k < OBJ_NFIELDS; k++) {
+            const char *f = obj_field(t, i, k);
+            size_t flen = strlen(f) + 1;
+            memcpy(q + off, f, flen);
+            uint32_t v = off;
+            if (k == OBJ_NAME || str_set_add(&set, q + off, &v))
+                off += flen;
+            rec[(size_t)k * t->n + i] = v;
+        }
+    }
+    str_set_free(&set);
+    *len = off - 1; // The last field is already terminated by '\0'
+    return q;
+}
+
+/**
+ * @brief Read the text files of a package and build the binary cache image.
+ *
+ * @param p Paths of the text files.
+ * @param mtime Modification times of the text files.
+ * @param fsize Sizes of the text files.
+ * @param sz Where to store the size of the image.
+ * @param stale Set to 1 if the files were modified while being read.
+ * @return The image or NULL if the objls_ file is missing or invalid.
+ */
+static char *build_image(char p[][512], const int64_t *mtime,
+                         const int64_t *fsize, size_t *sz, int *stale) {
+    char *b[SRC_N];
+    size_t len[SRC_N];
+    ObjTable t;
+
+    b[SRC_OBJLS] = read_file(p[SRC_OBJLS], 1);
+    b[SRC_ALIAS] = read_file(p[SRC_ALIAS], 1);
+    b[SRC_ARGS] = read_file(p[SRC_ARGS], 1);
+    b[SRC_SRCREF] = read_file(p[SRC_SRCREF], 0);
+    if (b[SRC_SRCREF] && !check_srcref(b[SRC_SRCREF])) {
+        free(b[SRC_SRCREF]);
+        b[SRC_SRCREF] = NULL;
+    }
+
+    *stale = 0;
+    for (int i = 0; i < SRC_N; i++) {
+        len[i] = b[i] ? strlen(b[i]) : 0;
+        if (b[i] && (int64_t)len[i] != fsize[i])
+            *stale = 1;
+    }
+
+    if (!b[SRC_OBJLS] || !parse_obj_table(b[SRC_OBJLS], &t)) {
+        for (int i = 0; i < SRC_N; i++)
+            free(b[i]);
+        return NULL;
+    }
+
+    if (t.n) {
+        char *q = dedup_pool(&t, &len[SRC_OBJLS]);
+        free(b[SRC_OBJLS]);
+        b[SRC_OBJLS] = q;
+    }
+
+    if (b[SRC_ALIAS]) {
+        // The first line has the title and the description of the package
+        // separated by \006.
+        char *s = b[SRC_ALIAS];
+        while (*s && *s != '\006')
+            s++;
+        if (*s)
+            *s++ = 0;
+        while (*s && *s != '\n')
+            s++;
+        if (*s)
+            *s = 0;
+    }
+    for (int i = SRC_ALIAS; i < SRC_N; i++)
+        if (b[i])
+            for (size_t j = 0; j < len[i]; j++)
+                if (b[i][j] == '\006')
+                    b[i][j] = 0;
+
+    CacheHeader h = {0};
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.nobjs = t.n;
+    for (int i = 0; i < SRC_N; i++)
+        h.sz[i] = b[i] ? (uint32_t)len[i] + 1 : 0;
+    memcpy(h.mtime, mtime, sizeof(h.mtime));
+    memcpy(h.fsize, fsize, sizeof(h.fsize));
+
+    size_t rec_sz = obj_arrays_size(t.n);
+    *sz = sizeof(CacheHeader) + rec_sz;
+    for (int i = 0; i < SRC_N; i++)
+        *sz += h.sz[i];
+
+    char *m = malloc(*sz);
+    char *d = m;
+    memcpy(d, &h, sizeof(CacheHeader));
+    d += sizeof(CacheHeader);
+    if (rec_sz)
+        memcpy(d, t.rec, rec_sz);
+    d += rec_sz;
+    for (int i = 0; i < SRC_N; i++) {
+        if (b[i]) {
+            memcpy(d, b[i], h.sz[i]);
+            d += h.sz[i];
+            free(b[i]);
+        }
+    }
+    free((void *)t.rec);
+    return m;
+}
+
+static int write_image(const char *fn, const char *m, size_t sz) {
+    char tmp[600];
+    snprintf(tmp, 599, "%s.%d", fn, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+        return 0;
+    int ok = fwrite(m, sz, 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+#ifdef WIN32
+    if (ok)
+        remove(fn);
+#endif
+    if (ok && rename(tmp, fn) == 0)
+        return 1;
+    remove(tmp);
+    return 0;
+}
+
+/**
+ * @brief Load the cached data of a package, building its binary cache file
+ * if it does not exist yet or if it is older than the text files.
+ *
+ * @param pd The package data.
+ * @param dir The directory with the cache files.
+ */
+void load_pkg_cache(PkgData *pd, const char *dir) {
+    char p[SRC_N][512];
+    int64_t mtime[SRC_N];
+    int64_t fsize[SRC_N];
+    char fn[512];
+    size_t sz;
+
+    src_paths(pd, dir, p);
+    src_stamps(p, mtime, fsize);
+    if (mtime[SRC_OBJLS] == -1) {
+        fprintf(stderr, "Cache file '%s' not found\n", p[SRC_OBJLS]);
+        fflush(stderr);
+        return;
+    }
+
+    snprintf(fn, 511, "%s/bincache_%s_%s", dir, pd->name, pd->version);
+    char *m = map_file(fn, &sz);
+    if (m) {
+        if (valid_image(m, sz, mtime, fsize)) {
+            use_image(pd, m, sz, 1);
+            return;
+        }
+        unmap_file(m, sz);
+    }
+
+    Log("load_pkg_cache: building '%s'", fn);
+    int stale;
+    m = build_image(p, mtime, fsize, &sz, &stale);
+    if (!m)
+        return;
+    if (!stale && write_image(fn, m, sz)) {
+        size_t msz;
+        char *mm = map_file(fn, &msz);
+        if (mm) {
+            if (msz == sz && valid_image(mm, msz, mtime, fsize)) {
+                free(m);
+                use_image(pd, mm, msz, 1);
+                return;
+            }
+            unmap_file(mm, msz);
+        }
+    }
+    use_image(pd, m, sz, 0);
+}
+
+/**
+ * @brief Release the cached data of a package.
+ * @param pd The package data.
+ */
+void unload_pkg_cache(PkgData *pd) {
+    if (!pd->map)
+        return;
+    if (pd->mapped)
+        unmap_file(pd->map, pd->map_sz);
+    else
+        free(pd->map);
+    pd->map = NULL;
+    obj_index_free(&pd->objs);
+    pd->objs.n = 0;
+    obj_arrays_bind(&pd->objs, NULL);
+    pd->title = pd->descr = pd->alias = pd->args = pd->srcref = NULL;
+}
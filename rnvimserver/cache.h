@@ -0,0 +1,9 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "data_structures.h"
+
+void load_pkg_cache(PkgData *pd, const char *dir);
+void unload_pkg_cache(PkgData *pd);
+
+#endif
@@ -6,6 +6,7 @@
 #include "logging.h"
 #include "lsp.h"
 #include "utilities.h"
+#include "buffers.h"
 #include "../nvimcom/src/common.h"
 
 typedef struct chunkitem_ {
@@ -16,7 +17,7 @@ typedef struct chunkitem_ {
 
 static ChunkItem *broot;
 static ChunkItem *croot;
-static char *cbuffer;
+static StrBuf cbuffer;
 
 static void get_chunk_items(const char *fname, ChunkItem **root) {
     char *b1 = read_file(fname, 1);
@@ -47,26 +48,22 @@ static void get_chunk_items(const char *fname, ChunkItem **root) {
         *b2 = 0;
         b2++;
     }
-    if (!cbuffer)
-        cbuffer = (char *)calloc(100000, sizeof(char));
 }
 
 static void fill_compl_buffer(const char *base, ChunkItem *root) {
-    char *p = cbuffer;
-    *p = '\0';
+    sb_reset(&cbuffer);
     ChunkItem *c = root;
     while (c) {
         if (!base || strstr(c->label, base)) {
-            p = str_cat(p, "{\"label\":\"");
-            p = str_cat(p, c->label);
-            p = str_cat(p, "\",\"kind\":5,\"documentation\":{\"kind\":"
-                           "\"markdown\",\"value\":\"");
-            p = str_cat(p, c->descr);
-            p = str_cat(p, "\"}},");
+            sb_cat(&cbuffer, "{\"label\":\"");
+            sb_cat(&cbuffer, c->label);
+            sb_cat(&cbuffer, "\",\"kind\":5,\"documentation\":{\"kind\":"
+                             "\"markdown\",\"value\":\"");
+            sb_cat(&cbuffer, c->descr);
+            sb_cat(&cbuffer, "\"}},");
         }
         c = c->next;
     }
-    *p = '\0';
 }
 
 void complete_chunk_opts(char t, const char *params) {
@@ -97,8 +94,8 @@ void complete_chunk_opts(char t, const char *params) {
             fill_compl_buffer(base, broot);
     }
 
-    if (cbuffer)
-        send_menu_items(cbuffer, id);
+    if (cbuffer.b)
+        send_menu_items(cbuffer.b, id);
     else
         send_empty(id);
 }
@@ -8,317 +8,447 @@
 #include "../nvimcom/src/common.h"
 #include "complete.h"
 #include "lsp.h"
+#include "symbols.h"
+#include "objindex.h"
+#include "snapshot.h"
+#include "workers.h"
+#include "buffers.h"
+
+// The long loops check whether the job was cancelled every CANCEL_STEP + 1
+// iterations
+#define CANCEL_STEP 255
+
+// The state below is not protected by locks because completion jobs run one
+// at a time (see workers.c).
+static StrBuf cmp_buf; // Completion items that are not precomputed
+static int max_items;  // Max number of items sent (0 = no limit)
+
+// Object matching the word being completed
+typedef struct cand_ {
+    const ObjTable *t; // Table of the object
+    uint32_t rec;      // Record of the object in the table
+    int score;         // Result of fuzzy_score()
+    const char *pkg;   // Package prefix of the label ("pkg::") or NULL
+} Cand;
+
+static struct {
+    Cand *c;   // Candidates
+    size_t n;  // Number of candidates
+    size_t sz; // Allocated number of candidates
+} cands;
+
+// Pieces of the completion response (see send_completion_iov())
+static struct {
+    struct iovec *v;
+    size_t n;
+    size_t sz;
+} iov;
+
+static char *sort_buf;     // The sortText of the items sent
+static size_t sort_buf_sz; // Allocated size of sort_buf
+
+// The word for which the candidates were found
+static struct {
+    char base[128];
+    unsigned ver; // Version of the snapshot
+    uint32_t key; // Nesting depth of base (see depth_key())
+    int valid;
+} cached;
+
+/**
+ * @brief Check whether the elements of a list of .GlobalEnv are missing from
+ * the list of objects (see request_elements()) and, if so, request them.
+ *
+ * @param snap The data snapshot.
+ * @param prefix The list name followed by '$' or '@'.
+ * @return 1 if the elements are missing and 0 otherwise.
+ */
+static int missing_elements(const Snapshot *snap, const char *prefix) {
+    char lst[128];
+    size_t len = strlen(prefix);
+    if (len < 2 || len >= sizeof(lst))
+        return 0;
+    memcpy(lst, prefix, len - 1);
+    lst[len - 1] = 0;
+
+    const ObjTable *t = snap->glbnv;
+    char ulst[132];
+    snprintf(ulst, 131, "%s[[", lst); // Unnamed elements are "lst[[1]]"
+    uint32_t from, to;
+    obj_index_range(t, depth_key(prefix), prefix, &from, &to);
+    if (from < to)
+        return 0;
+    obj_index_range(t, depth_key(ulst), ulst, &from, &to);
+    if (from < to)
+        return 0;
+
+    // Is `lst` really a list?
+    obj_index_range(t, depth_key(lst), lst, &from, &to);
+    uint32_t k = from;
+    while (k < to && strcmp(obj_field(t, t->idx[k], OBJ_NAME), lst) != 0)
+        k++;
+    if (k == to)
+        return 0;
+    char cls = t->cls[t->idx[k]];
+    if (cls != 'l' && cls != 'd' && cls != '4' && cls != '7')
+        return 0;
+
+    request_elements(lst);
+    return 1;
+}
+
+static void get_df_cols(const Snapshot *snap, const char *dtfrm,
+                        const char *base) {
+    size_t skip = strlen(dtfrm) + 1; // The data.frame name + "$"
+    char dfbase[64];
+    snprintf(dfbase, 63, "%s$%s", dtfrm, base ? base : "");
+    uint32_t key = depth_key(dfbase);
+    uint32_t from, to;
+
+    const ObjTable *t = snap->glbnv;
+    obj_index_range(t, key, dfbase, &from, &to);
+
+    if (from == to) {
+        char prefix[80];
+        snprintf(prefix, 79, "%s$", dtfrm);
+        missing_elements(snap, prefix);
+
+        LibList *lib = snap->libs;
+        while (lib) {
+            t = &lib->pkg->objs;
+            obj_index_range(t, key, dfbase, &from, &to);
+            if (from < to)
+                break;
+            lib = lib->next;
+        }
+    }
 
-// The kind numbers are from vim.lsp.protocol.CompletionItemKind
-static const char *kind_tbl[16][2] = {
-    {"a", "6"},  //  function arg      Variable
-    {"c", "5"},  //  data.frame column Field
-    {"n", "12"}, //  numeric           Value
-    {"f", "5"},  //  factor            Field
-    {"t", "1"},  //  character         Text
-    {"F", "3"},  //  function          Function
-    {"d", "22"}, //  data.frame        Struct
-    {"l", "22"}, //  list              Struct
-    {"4", "7"},  //  S4                Class
-    {"7", "7"},  //  S7                Class
-    {"b", "2"},  //  logical           Method
-    {"L", "9"},  //  library           Module
-    {"C", "4"},  //  control           Constructor
-    {"e", "8"},  //  environment       Interface
-    {"p", "23"}, //  promise           Event
-    {"o", "25"}, //  other             TypeParameter
-};
-
-static char *cmp_buf;              // Completion buffer
-static size_t cmp_buf_sz = 163840; // Completion buffer size
-
-static const char *get_kind(const char *cls) {
-    for (size_t i = 0; i < 16; i++)
-        if (*kind_tbl[i][0] == *cls)
-            return kind_tbl[i][1];
-    Log("get_kind: %s", cls);
-    return kind_tbl[15][1];
+    for (uint32_t k = from; k < to; k++) {
+        if (!(k & CANCEL_STEP) && job_cancelled())
+            break;
+        const char *s = obj_field(t, t->idx[k], OBJ_NAME);
+        sb_cat(&cmp_buf, "{\"label\":\"");
+        sb_cat(&cmp_buf, s + skip);
+        sb_cat(&cmp_buf, "\",\"sortText\":\"_");
+        sb_cat(&cmp_buf, s + skip);
+        sb_cat(&cmp_buf, "\",\"cls\":\"c\",\"kind\":5,\"env\":\"");
+        sb_cat(&cmp_buf, dtfrm);
+        sb_cat(&cmp_buf, "\"},");
+    }
 }
 
-static int count_twice(const char *b1, const char *b2, const char ch) {
-    int n1 = 0;
-    int n2 = 0;
-    for (unsigned long i = 0; i < strlen(b1); i++)
-        if (b1[i] == ch)
-            n1++;
-    for (unsigned long i = 0; i < strlen(b2); i++)
-        if (b2[i] == ch)
-            n2++;
-    return n1 == n2;
+static void add_iov(const void *b, size_t len) {
+    if (iov.n == iov.sz) {
+        iov.sz = iov.sz ? iov.sz * 2 : 8192;
+        iov.v = realloc(iov.v, iov.sz * sizeof(struct iovec));
+    }
+    iov.v[iov.n].iov_base = (void *)b;
+    iov.v[iov.n].iov_len = len;
+    iov.n++;
 }
 
-static char *find_obj(char *objls, const char *dfbase) {
-    while (*objls != 0) {
-        if (str_here(objls, dfbase)) {
-            return objls;
-        } else {
-            while (*objls != '\n')
-                objls++;
-            objls++;
-        }
+// Add the prebuilt completion item of an object to the response. Only its
+// sortText, which depends on the score, is written here. `sort_text` must
+// have room for SORT_LEN characters.
+#define SORT_LEN 17
+static void add_obj_item(const Cand *c, char *sort_text) {
+    // Higher scores first
+    int o = c->score < 9999 ? 9999 - c->score : 0;
+    memcpy(sort_text, "{\"sortText\":\"", 13);
+    for (int j = 16; j > 12; j--) {
+        sort_text[j] = '0' + o % 10;
+        o /= 10;
     }
-    return NULL;
+    add_iov(sort_text, SORT_LEN);
+
+    const ObjTable *t = c->t;
+    const char *frag = t->frag + t->frag_off[c->rec];
+    size_t len = t->frag_off[c->rec + 1] - t->frag_off[c->rec];
+    if (!c->pkg) {
+        add_iov(frag, len);
+        return;
+    }
+    size_t split = strlen(obj_field(t, c->rec, OBJ_NAME)) + strlen(FRAG_LABEL);
+    size_t plen = strlen(c->pkg);
+    add_iov(c->pkg, plen);
+    add_iov("::", 2);
+    add_iov(frag, split);
+    add_iov(c->pkg, plen);
+    add_iov("::", 2);
+    add_iov(frag + split, len - split);
 }
 
-static char *get_df_cols(const char *dtfrm, const char *base, char *p) {
-    size_t skip = strlen(dtfrm) + 1; // The data.frame name + "$"
-    char dfbase[64];
-    snprintf(dfbase, 63, "%s$%s", dtfrm, base ? base : "");
-    const char *s = NULL;
+// Length of the part of `base` that must be matched exactly: up to its
+// last '$' or '@'.
+static size_t fixed_len(const char *base) {
+    size_t len = 0;
+    for (size_t j = 0; base[j] && j < 127; j++)
+        if (base[j] == '$' || base[j] == '@')
+            len = j + 1;
+    return len;
+}
+
+static void add_cand(const ObjTable *t, uint32_t rec, int score,
+                     const char *pkg) {
+    if (cands.n == cands.sz) {
+        cands.sz = cands.sz ? cands.sz * 2 : 4096;
+        cands.c = realloc(cands.c, cands.sz * sizeof(Cand));
+    }
+    Cand *c = &cands.c[cands.n++];
+    c->t = t;
+    c->rec = rec;
+    c->score = score;
+    c->pkg = pkg;
+}
 
-    if (glbnv_buffer)
-        s = find_obj(glbnv_buffer, dfbase);
+// Find the objects that match `base` and add them to the list of candidates.
+// Title and description of objects are not included in the menu items to
+// avoid extremely large data transfer.
+static void parse_objls(const ObjTable *t, const char *base,
+                        const char *pkg) {
+    if (!t->frag)
+        return;
 
-    if (!s) {
-        LibList *lib = loaded_libs;
-        while (lib) {
-            if (lib->pkg->objls) {
-                s = find_obj(lib->pkg->objls, dfbase);
-                if (s)
-                    break;
-            }
-            lib = lib->next;
+    // Skip elements of lists unless the user is really looking for them, and
+    // skip lists if the user is looking for one of its elements: only the
+    // objects with the same nesting depth of `base` are considered.
+    uint32_t key = depth_key(base);
+    uint32_t from, to;
+    obj_index_range(t, key, base, &from, &to);
+    for (uint32_t k = from; k < to; k++) {
+        if (!(k & CANCEL_STEP) && job_cancelled())
+            return;
+        uint32_t i = t->idx[k];
+        add_cand(t, i, fuzzy_score(obj_field(t, i, OBJ_NAME), base), pkg);
+    }
+
+    if (*base == '\0')
+        return;
+
+    // Fuzzy matches. The part of `base` up to its last '$' or '@' must match
+    // exactly; hence, only this range is checked.
+    char fixed[128];
+    size_t len = fixed_len(base);
+    memcpy(fixed, base, len);
+    fixed[len] = 0;
+
+    uint64_t bmask = char_mask(base + len);
+    uint32_t ffrom, fto;
+    obj_index_range(t, key, fixed, &ffrom, &fto);
+    for (uint32_t k = ffrom; k < fto; k++) {
+        if (k == from && from < to) {
+            // Already added
+            k = to - 1;
+            continue;
         }
+        if (!(k & CANCEL_STEP) && job_cancelled())
+            return;
+        uint32_t i = t->idx[k];
+        if (bmask & ~t->mask[i])
+            continue;
+        int score = fuzzy_score(obj_field(t, i, OBJ_NAME) + len, base + len);
+        if (score)
+            add_cand(t, i, score, pkg);
     }
+}
 
-    if (!s)
-        return p;
-
-    while (*s && str_here(s, dfbase)) {
-        // Avoid buffer overflow if the information is bigger than
-        // cmp_buf.
-        size_t nsz = strlen(s) + 1024 + (p - cmp_buf);
-        if (cmp_buf_sz < nsz)
-            p = grow_buffer(&cmp_buf, &cmp_buf_sz, nsz - cmp_buf_sz + 32768);
-
-        p = str_cat(p, "{\"label\":\"");
-        p = str_cat(p, s + skip);
-        p = str_cat(p, "\",\"sortText\":\"_");
-        p = str_cat(p, s + skip);
-        p = str_cat(p, "\",\"cls\":\"c\",\"kind\":5,\"env\":\"");
-        p = str_cat(p, dtfrm);
-        p = str_cat(p, "\"},");
-
-        while (*s != '\n')
-            s++;
-        s++;
+/**
+ * @brief Filter the candidates found for a previous `base` keeping only the
+ * ones that still match the new `base`, which extends the previous one.
+ */
+static void narrow_cands(const char *base) {
+    size_t len = fixed_len(base);
+    size_t blen = strlen(base);
+    uint64_t bmask = char_mask(base + len);
+    size_t n = 0;
+    for (size_t k = 0; k < cands.n; k++) {
+        if (!(k & CANCEL_STEP) && job_cancelled())
+            break;
+        Cand *c = &cands.c[k];
+        const char *nm = obj_field(c->t, c->rec, OBJ_NAME);
+        int score = 0;
+        if (strncmp(nm, base, blen) == 0)
+            score = fuzzy_score(nm, base);
+        else if (strncmp(nm, base, len) == 0 && !(bmask & ~c->t->mask[c->rec]))
+            score = fuzzy_score(nm + len, base + len);
+        if (score) {
+            c->score = score;
+            cands.c[n++] = *c;
+        }
     }
-    return p;
+    cands.n = n;
 }
 
-// Return the menu items for auto completion, but don't include function
-// usage, and tittle and description of objects to avoid extremely large data
-// transfer.
-static char *parse_objls(const char *s, const char *base, const char *pkg,
-                         const char *lib, char *p) {
-    int i;
-    size_t nsz;
-    const char *f[7];
-    char order[4];
-
-    while (*s != 0) {
-        int z = fuzzy_find(s, base);
-        if (*base == '\0' || z) {
-            i = 0;
-            while (i < 7) {
-                f[i] = s;
-                i++;
-                while (*s != 0)
-                    s++;
-                s++;
-            }
-            while (*s != '\n' && *s != 0)
-                s++;
-            if (*s == '\n')
-                s++;
+// Higher scores first
+static int cmp_cands(const void *x, const void *y) {
+    const Cand *a = x;
+    const Cand *b = y;
+    return b->score - a->score;
+}
 
-            // Skip elements of lists unless the user is really looking for
-            // them, and skip lists if the user is looking for one of its
-            // elements.
-            if (!count_twice(base, f[0], '@'))
-                continue;
-            if (!count_twice(base, f[0], '$'))
-                continue;
-            if (!count_twice(base, f[0], '['))
-                continue;
-
-            // Avoid buffer overflow if the information is bigger than
-            // cmp_buf.
-            nsz = 1024 + (p - cmp_buf);
-            if (cmp_buf_sz < nsz)
-                p = grow_buffer(&cmp_buf, &cmp_buf_sz,
-                                nsz - cmp_buf_sz + 32768);
-
-            p = str_cat(p, "{\"label\":\"");
-            if (pkg) {
-                p = str_cat(p, pkg);
-                p = str_cat(p, "::");
-            }
-            p = str_cat(p, f[0]);
-            p = str_cat(p, "\",\"sortText\":\"");
-            snprintf(order, 3, "%02d", z);
-            p = str_cat(p, order);
-            if (pkg) {
-                p = str_cat(p, pkg);
-                p = str_cat(p, "::");
-            }
-            p = str_cat(p, f[0]);
-            p = str_cat(p, "\",\"cls\":\"");
-            p = str_cat(p, f[1]);
-            p = str_cat(p, "\",\"kind\":");
-            p = str_cat(p, get_kind(f[1]));
-            if (lib) {
-                p = str_cat(p, ",\"env\":\"");
-                p = str_cat(p, lib);
-            }
-            p = str_cat(p, "\"},");
-            // big data will be truncated.
-        } else {
-            while (*s != '\n')
-                s++;
-            s++;
+/**
+ * @brief Find the objects matching `base` in .GlobalEnv and in the loaded
+ * libraries (or in a single package if `base` is "pkg::name") and add them
+ * their prebuilt items to the list of pieces of the response.
+ *
+ * If the number of matches exceeds `max_items`, only the best ones are
+ * added and the complete list is kept: Neovim will ask for a new list as the
+ * user types and, then, the kept list is filtered instead of searching all
+ * objects again.
+ *
+ * @param snap The data snapshot.
+ * @param base The word being completed.
+ * @param incomplete Set to 1 if the list was truncated.
+ * @return 0 if the job was cancelled and 1 otherwise.
+ */
+static int complete_objects(const Snapshot *snap, char *base,
+                            int *incomplete) {
+    char *ebase = base; // base without the "pkg::" prefix
+    PkgData *pd = NULL;
+    if (strstr(base, "::")) {
+        char *pkg = base;
+        ebase = strstr(base, "::");
+        *ebase = 0;
+        pd = get_pkg(pkg);
+        *ebase = ':';
+        ebase += 2;
+    }
+
+    unsigned ver = snap->version;
+    if (cached.valid && cached.ver == ver &&
+        str_here(base, cached.base) &&
+        (strstr(base, "::") != NULL) == (strstr(cached.base, "::") != NULL) &&
+        depth_key(ebase) == cached.key) {
+        Log("complete_objects: narrowing %zu candidates", cands.n);
+        narrow_cands(ebase);
+    } else {
+        cands.n = 0;
+        if (pd) {
+            parse_objls(&pd->objs, ebase, pd->name);
+        } else if (ebase == base) {
+            parse_objls(snap->glbnv, base, NULL);
+            for (LibList *lib = snap->libs; lib; lib = lib->next)
+                parse_objls(&lib->pkg->objs, base, NULL);
         }
     }
-    return p;
+    if (job_cancelled()) {
+        // The candidates are incomplete
+        cached.valid = 0;
+        return 0;
+    }
+    cached.valid = strlen(base) < sizeof(cached.base);
+    if (cached.valid) {
+        strcpy(cached.base, base);
+        cached.ver = ver;
+        cached.key = depth_key(ebase);
+    }
+
+    size_t n = cands.n;
+    *incomplete = 0;
+
+    // Neovim will ask again for the elements of a list if they are missing
+    size_t flen = fixed_len(ebase);
+    if (ebase == base && flen > 0) {
+        char prefix[128];
+        memcpy(prefix, base, flen);
+        prefix[flen] = 0;
+        *incomplete = missing_elements(snap, prefix);
+    }
+    if (max_items > 0 && n > (size_t)max_items) {
+        qsort(cands.c, n, sizeof(Cand), cmp_cands);
+        n = max_items;
+        *incomplete = 1;
+    }
+    if (sort_buf_sz < n * SORT_LEN) {
+        sort_buf_sz = n * SORT_LEN + 4096;
+        free(sort_buf);
+        sort_buf = malloc(sort_buf_sz);
+    }
+    for (size_t k = 0; k < n; k++)
+        add_obj_item(&cands.c[k], sort_buf + k * SORT_LEN);
+    return 1;
 }
 
-static char *complete_args(char *p, const char *s, const char *funcnm,
-                           const char *libnm) {
+static void complete_args(const ObjTable *t, uint32_t i, const char *funcnm,
+                          const char *libnm) {
     const char *a;
     char order[16];
-    while (*s)
-        s++;
-    s++;
-    if (*s == 'F') { // Check if it's a function
-        int i;
-        i = 3;
-        while (i) {
-            s++;
-            if (*s == 0)
-                i--;
-        }
-        s++;
+    if (t->cls[i] == 'F') { // Check if it's a function
+        const char *s = obj_field(t, i, OBJ_ARGS);
         int o = 0;
-        while (*s) {
-            p = str_cat(p, "{\"label\":\"");
+        while (*s && !job_cancelled()) {
+            sb_cat(&cmp_buf, "{\"label\":\"");
             a = s;
             while (*a != '\x05' && *a != '\x04')
                 a++;
-            char *b = calloc(a - s + 2, sizeof(char));
-            i = 0;
-            while (*s != '\x05' && *s != '\x04') {
-                b[i] = *s;
-                i++;
-                s++;
-            }
-            p = str_cat(p, b);
-            free(b);
-            p = str_cat(p, " = \",\"sortText\":\"_");
+            sb_add(&cmp_buf, s, a - s);
+            s = a;
+            sb_cat(&cmp_buf, " = \",\"sortText\":\"_");
             o++;
             snprintf(order, 15, "%02d", o);
-            p = str_cat(p, order);
-            p = str_cat(p, "\",\"cls\":\"a\",\"kind\":6,\"env\":\"");
-            p = str_cat(p, libnm);
-            p = str_cat(p, ":");
-            p = str_cat(p, funcnm);
-            p = str_cat(p, "\"},");
+            sb_cat(&cmp_buf, order);
+            sb_cat(&cmp_buf, "\",\"cls\":\"a\",\"kind\":6,\"env\":\"");
+            sb_cat(&cmp_buf, libnm);
+            sb_cat(&cmp_buf, ":");
+            sb_cat(&cmp_buf, funcnm);
+            sb_cat(&cmp_buf, "\"},");
             if (*s == '\x04') {
                 // skip default value
                 s++;
-                while (*s != '\x05') {
-                    i++;
+                while (*s != '\x05')
                     s++;
-                }
             }
             s++;
         }
     }
-    return p;
 }
 
-static char *seek_fun_complete_args(char *p, char *funcnm) {
+static void seek_fun_complete_args(char *funcnm) {
+    if (job_cancelled())
+        return;
+
     // Check if function is "pkg::fun"
-    char *pkg = NULL;
-    LibList *lib;
     if (strstr(funcnm, "::")) {
-        pkg = funcnm;
+        const char *pkg = funcnm;
         funcnm = strstr(funcnm, "::");
         *funcnm = 0;
         funcnm++;
         funcnm++;
-        lib = inst_libs;
-    } else {
-        lib = loaded_libs;
-    }
-
-    while (lib) {
-        if (lib->pkg->objls &&
-            (pkg == NULL || (strcmp(lib->pkg->name, pkg) == 0))) {
-            const char *s = lib->pkg->objls;
-            while (*s != 0) {
-                if (strcmp(s, funcnm) == 0) {
-                    p = complete_args(p, s, funcnm, lib->pkg->name);
-                    return p;
-                } else {
-                    while (*s != '\n')
-                        s++;
-                    s++;
-                }
-            }
+        PkgData *pd = get_pkg(pkg);
+        if (pd) {
+            int i = sym_find_in(pd, funcnm);
+            if (i >= 0)
+                complete_args(&pd->objs, i, funcnm, pd->name);
         }
-        lib = lib->next;
+        return;
     }
-    return p;
+
+    PkgData *pd;
+    int i = sym_find(funcnm, &pd);
+    if (i >= 0)
+        complete_args(&pd->objs, i, funcnm, pd->name);
 }
 
-static void complete_instlibs(char *p, const char *base) {
+static void complete_instlibs(const char *base) {
     LibList *lib = inst_libs;
     while (lib) {
         if (!base || (str_here(lib->pkg->name, base))) {
-            size_t len = p - cmp_buf + 1024;
-            if (cmp_buf_sz < len)
-                p = grow_buffer(&cmp_buf, &cmp_buf_sz,
-                                len - cmp_buf_sz + 32768);
-
-            p = str_cat(p, "{\"label\":\"");
-            p = str_cat(p, lib->pkg->name);
-            p = str_cat(p, "\",\"cls\":\"L\",\"kind\":9},");
+            sb_cat(&cmp_buf, "{\"label\":\"");
+            sb_cat(&cmp_buf, lib->pkg->name);
+            sb_cat(&cmp_buf, "\",\"cls\":\"L\",\"kind\":9},");
         }
         lib = lib->next;
     }
 }
 
-void complete(const char *params) {
-    Log("complete: %s", params);
-    char *id = strstr(params, "\"orig_id\":");
-    char *base = strstr(params, "\"base\":\"");
-    char *fnm = strstr(params, "\"fnm\":\"");
-    char *df = strstr(params, "\"df\":\"");
-    char *fargs = strstr(params, "\"fargs\":\"");
-    cut_json_int(&id, 10);
-    cut_json_str(&base, 8);
-    cut_json_str(&fnm, 7);
-    cut_json_str(&df, 6);
-    cut_json_str(&fargs, 9);
-    if (base && *base == ' ')
-        base = NULL;
-
-    Log("complete(id=%s, base=%s, fnm=%s, df=%s, fargs=%s)", id, base, fnm, df,
-        fargs);
-
-    char *p;
-    memset(cmp_buf, 0, cmp_buf_sz);
-    p = cmp_buf;
+static void complete_items(const Snapshot *snap, const char *id, char *base,
+                           char *fnm, const char *df, char *fargs) {
+    sb_reset(&cmp_buf);
 
     // Get menu completion for installed libraries
     if (fnm && *fnm == '#') {
-        complete_instlibs(p, base);
-        send_menu_items(cmp_buf, id);
+        complete_instlibs(base);
+        send_menu_items(cmp_buf.b, id);
         return;
     }
 
@@ -326,81 +456,79 @@ void complete(const char *params) {
         if (fargs) {
             replace_char(fargs, '\x13', '"');
             // Insert arguments of .GlobalEnv function
-            p = str_cat(p, fargs);
+            sb_cat(&cmp_buf, fargs);
         } else {
             // Completion of arguments of a library's function
-            const char *s = NULL;
-            if (glbnv_buffer) {
-                s = seek_word(glbnv_buffer, fnm);
-                if (s && is_function(s)) {
-                    p = complete_args(p, s, fnm, ".GlobalEnv");
-                }
-            }
-
-            if (!s)
-                p = seek_fun_complete_args(p, fnm);
+            int i = seek_obj(snap->glbnv, fnm);
+            if (i >= 0)
+                complete_args(snap->glbnv, i, fnm, ".GlobalEnv");
+            else
+                seek_fun_complete_args(fnm);
 
             // Add columns of a data.frame
             if (df) {
-                p = get_df_cols(df, base, p);
+                get_df_cols(snap, df, base);
             }
         }
 
         // base will be empty if completing only function arguments
         if (!base) {
-            send_menu_items(cmp_buf, id);
+            send_menu_items(cmp_buf.b, id);
             return;
         }
     }
 
-    // Finish filling the cmp_buf
-    if (glbnv_buffer && base)
-        p = parse_objls(glbnv_buffer, base, NULL, ".GlobalEnv", p);
-
+    // Finish filling the cmp_buf. The pieces of the response point to
+    // cmp_buf only after it has been completely filled because it might be
+    // reallocated.
+    int incomplete = 0;
+    iov.n = 0;
+    add_iov(NULL, 0); // Reserved for the header
     if (base) {
-        // Check if base is "pkg::fun"
-        char *pkg = NULL;
-        int pkg_compl = 1;
-        LibList *lib;
-        if (strstr(base, "::")) {
-            pkg_compl = 0;
-            pkg = base;
-            base = strstr(base, "::");
-            *base = 0;
-            base++;
-            base++;
-            lib = inst_libs;
-        } else {
-            lib = loaded_libs;
-        }
-        Log("LIB: %p, base: %s, pkg: %s", (void *)lib, base, pkg);
-        while (lib) {
-            if (pkg == NULL || (strcmp(lib->pkg->name, pkg) == 0))
-                p = parse_objls(lib->pkg->objls, base, pkg, lib->pkg->name, p);
-            lib = lib->next;
-        }
+        if (!complete_objects(snap, base, &incomplete))
+            return; // The reply was already sent or is no longer expected
 
-        if (pkg_compl) {
-            lib = inst_libs;
+        if (!strstr(base, "::")) {
+            LibList *lib = inst_libs;
             while (lib) {
                 if (str_here(lib->pkg->name, base)) {
-                    size_t len = p - cmp_buf + 1024;
-                    if (cmp_buf_sz < len)
-                        p = grow_buffer(&cmp_buf, &cmp_buf_sz,
-                                        len - cmp_buf_sz + 32768);
-
-                    p = str_cat(p, "{\"label\":\"");
-                    p = str_cat(p, lib->pkg->name);
-                    p = str_cat(p, "::\",\"sortText\":\"zz");
-                    p = str_cat(p, lib->pkg->name);
-                    p = str_cat(p, "\",\"cls\":\"L\",\"kind\":9},");
+                    sb_cat(&cmp_buf, "{\"label\":\"");
+                    sb_cat(&cmp_buf, lib->pkg->name);
+                    sb_cat(&cmp_buf, "::\",\"sortText\":\"zz");
+                    sb_cat(&cmp_buf, lib->pkg->name);
+                    sb_cat(&cmp_buf, "\",\"cls\":\"L\",\"kind\":9},");
                 }
                 lib = lib->next;
             }
         }
     }
 
-    send_menu_items(cmp_buf, id);
+    add_iov(cmp_buf.b, cmp_buf.len);
+    add_iov(NULL, 0); // Reserved for the tail
+    send_completion_iov(id, iov.v, iov.n, incomplete);
+}
+
+void complete(const char *params) {
+    Log("complete: %s", params);
+    char *id = strstr(params, "\"orig_id\":");
+    char *base = strstr(params, "\"base\":\"");
+    char *fnm = strstr(params, "\"fnm\":\"");
+    char *df = strstr(params, "\"df\":\"");
+    char *fargs = strstr(params, "\"fargs\":\"");
+    cut_json_int(&id, 10);
+    cut_json_str(&base, 8);
+    cut_json_str(&fnm, 7);
+    cut_json_str(&df, 6);
+    cut_json_str(&fargs, 9);
+    if (base && *base == ' ')
+        base = NULL;
+
+    Log("complete(id=%s, base=%s, fnm=%s, df=%s, fargs=%s)", id, base, fnm, df,
+        fargs);
+
+    Snapshot *snap = snap_acquire();
+    complete_items(snap, id, base, fnm, df, fargs);
+    snap_release(snap);
 }
 
 void complete_fig_tbl(const char *params) {
@@ -423,4 +551,7 @@ void complete_fig_tbl(const char *params) {
     send_menu_items(items, id);
 }
 
-void init_cmp(void) { cmp_buf = calloc(cmp_buf_sz, sizeof(char)); }
+void init_cmp(void) {
+    if (getenv("R_LS_MAX_ITEMS"))
+        max_items = atoi(getenv("R_LS_MAX_ITEMS"));
+}
@@ -9,14 +9,31 @@
 #include "utilities.h"
 #include "logging.h"
 #include "data_structures.h"
+#include "cache.h"
+#include "intern.h"
+#include "symbols.h"
+#include "objindex.h"
+#include "snapshot.h"
+#include "threads.h"
 #include "tcp.h"
 #include "lsp.h"
 
-static size_t glbnv_buffer_sz; // Global environment buffer size
-static ListStatus *listTree;   // Root node of the list status tree
-static int max_depth = 2;      // Max list depth in nvimcom
-static char *cmp_dir;          // Directory for completion files
-static char *lib_names;        // List of loaded libraries
+static ListStatus *listTree;           // Root node of the list status tree
+static int max_depth = 2;              // Max list depth in nvimcom
+static char *cmp_dir;                  // Directory for completion files
+static char *lib_names;                // List of loaded libraries
+static Mutex upd_lock = MUTEX_INIT;    // Serializes the updates of the data
+static Mutex load_lock = MUTEX_INIT;   // Serializes the loading of packages
+static int glbnv_seq = -1; // Edits applied to the last list of .GlobalEnv
+                           // objects from nvimcom (-1 if there is no list)
+
+// Lists whose elements were requested from nvimcom (see request_elements())
+static struct {
+    char **path;
+    int n;
+    int sz;
+} requested;
+static Mutex req_lock = MUTEX_INIT;
 
 void set_max_depth(int m) { max_depth = m; }
 
@@ -63,21 +80,13 @@ static void change_all_stt(ListStatus *root, int stt) {
 void change_all(int stt) { change_all_stt(listTree, stt); }
 
 static void delete_pkg(PkgData *pd) {
-    free(pd->name);
-    free(pd->version);
-    if (pd->objls)
-        free(pd->objls);
-    if (pd->args)
-        free(pd->args);
-    if (pd->srcref)
-        free(pd->srcref);
-    if (pd->title) // free title, descr and alias
-        free(pd->title);
+    sym_del_pkg(pd);
+    unload_pkg_cache(pd);
     free(pd);
 }
 
-static PkgData *get_pkg(const char *nm) {
-    // Log("get_pkg: '%s'", nm);
+static PkgData *find_pkg(const char *nm) {
+    // Log("find_pkg: '%s'", nm);
     if (!inst_libs)
         return NULL;
 
@@ -91,206 +100,184 @@ static PkgData *get_pkg(const char *nm) {
     return NULL;
 }
 
+// Can the object have nested members (lists, data.frames, S4 objects and
+// environments)?
+static int has_members(uint8_t cls) {
+    return cls == 'l' || cls == 'd' || cls == '4' || cls == '7' || cls == 'e';
+}
+
+// Is `nm` the name of a nested member of the object `i`? The members of S4
+// objects are "obj@slot" and the members of the others are "obj$name".
+// Unnamed elements are "obj[[1]]".
+static int is_member(const ObjTable *t, uint32_t i, const char *nm) {
+    const char *p = obj_field(t, i, OBJ_NAME);
+    size_t len = strlen(p);
+    if (strncmp(nm, p, len) != 0)
+        return 0;
+    nm += len;
+    if (nm[0] == '[' && nm[1] == '[')
+        return 1;
+    return nm[0] == (t->cls[i] == '4' || t->cls[i] == '7' ? '@' : '$');
+}
+
 /**
- * @brief Count the number of separator characters in a given buffer.
- * @param b1 Pointer to the buffer to be scanned.
- * @param size Pointer to an integer where the size of the buffer will be
- * stored.
- * @return Returns the original buffer if the count of separators is as
- * expected. Returns NULL in case of an error or if the count is not as
- * expected.
+ * @brief Fill the arrays `cls` and `end` of a table whose field offsets are
+ * already known. The nested members of an object are the records that
+ * follow it and whose names begin with its name: they are found with a
+ * stack of the objects whose members are still being listed.
+ *
+ * @param t The table. Its arrays must have been allocated as a single block.
  */
-static char *count_sep(char *b1, int *size) {
-    *size = strlen(b1);
-    // Some packages do not export any objects.
-    if (*size == 1)
-        return b1;
-
-    const char *s0 = b1;
-    char *s1 = b1;
-    int n = 0;
-    while (*s1) {
-        if (*s1 == '\006')
-            n++;
-        if (*s1 == '\n') {
-            if (n == 7) {
-                n = 0;
-                s0 = s1;
-                s0++;
-            } else {
-                char b[64];
-                strncpy(b, s0, 63);
-                fprintf(stderr, "Number of separators: %d (%s)\n", n, b);
-                fflush(stderr);
-                free(b1);
-                *size = 0;
-                return NULL;
-            }
-        }
-        s1++;
+static void obj_ranges_build(ObjTable *t) {
+    if (t->n == 0)
+        return;
+    uint8_t *cls = (uint8_t *)t->cls;
+    uint32_t *end = (uint32_t *)t->end;
+    uint32_t *stack = malloc(t->n * sizeof(uint32_t));
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < t->n; i++) {
+        const char *nm = obj_field(t, i, OBJ_NAME);
+        while (top > 0 && !is_member(t, stack[top - 1], nm))
+            end[stack[--top]] = i;
+        cls[i] = *obj_field(t, i, OBJ_CLS);
+        end[i] = i + 1;
+        if (has_members(cls[i]))
+            stack[top++] = i;
     }
-    return b1;
+    while (top > 0)
+        end[stack[--top]] = t->n;
+    free(stack);
 }
 
 /**
- * @brief Validates and prepares the buffer containing completion data.
+ * @brief Validate a buffer with either the contents of an `objls_` file or
+ * the list of .GlobalEnv objects and build the table of its records. The
+ * \006 separators are replaced with NUL bytes in place.
  *
- * @param buffer Pointer to the buffer containing auto completion data.
- * @param size Pointer to an integer representing the size of the buffer.
- * @return Returns a pointer to the processed buffer.
+ * @param b The buffer. It becomes the string pool of the table.
+ * @param t The table to be filled. `t->rec`, the block with its arrays, must
+ * be freed by the caller.
+ * @return 1 on success and 0 if the number of separators is wrong in any
+ * line.
  */
-static char *check_omils_buffer(char *b, int *size) {
+int parse_obj_table(char *b, ObjTable *t) {
     // Ensure that there are exactly 7 \006 between new line characters
-    b = count_sep(b, size);
+    const char *s0 = b;
+    uint32_t n = 0;
+    int nsep = 0;
+    for (const char *s = b; *s; s++) {
+        if (*s == '\006') {
+            nsep++;
+        } else if (*s == '\n') {
+            if (nsep == OBJ_NFIELDS) {
+                n++;
+            } else if (nsep != 0 || s != s0) {
+                // Some packages do not export any objects and their objls_
+                // has a single empty line.
+                fprintf(stderr, "Number of separators: %d (%.63s)\n", nsep,
+                        s0);
+                fflush(stderr);
+                return 0;
+            }
+            nsep = 0;
+            s0 = s + 1;
+        }
+    }
 
-    if (!b)
-        return NULL;
+    uint32_t *rec = NULL;
+    if (n > 0)
+        rec = malloc(obj_arrays_size(n));
 
+    uint32_t i = 0;
+    int k = 0;
     char *p = b;
-    while (*p) {
-        if (*p == '\006')
-            *p = 0;
+    while (*p && i < n) {
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+        if (k == 0)
+            rec[i] = p - b;
+        while (*p != '\006')
+            p++;
+        *p = 0;
         p++;
+        k++;
+        if (k == OBJ_NFIELDS) {
+            k = 0;
+            i++;
+            while (*p && *p != '\n')
+                p++;
+        } else {
+            rec[(size_t)k * n + i] = p - b;
+        }
     }
-    return b;
+
+    t->pool = b;
+    t->n = n;
+    obj_arrays_bind(t, rec);
+    obj_ranges_build(t);
+    return 1;
 }
 
 /**
- * @brief Reads the contents of an auto completion list file into a buffer.
- * @param fn The name of the file to be read.
- * @param size A pointer to an integer where the size of the read data will be
- * stored.
- * @return Returns a pointer to a buffer containing the file contents.
+ * @brief Find an object by its name.
+ * @param t The table of objects.
+ * @param wrd The name of the object.
+ * @return The index of the record or -1 if the object was not found.
  */
-static char *read_objls_file(const char *fn, int *size) {
-    char *b = read_file(fn, 1);
-    if (!b)
-        return NULL;
-
-    return check_omils_buffer(b, size);
-}
-
-static void *read_alias_file(PkgData *pd) {
-    char fnm[512];
-    snprintf(fnm, 511, "%s/alias_%s", cmp_dir, pd->name);
-    char *b = read_file(fnm, 1);
-    if (!b)
-        return NULL;
-    pd->title = b;
-    char *p = b;
-    while (*p != '\006')
-        p++;
-    *p = '\0';
-    p++;
-    pd->descr = p;
-    while (*p != '\n')
-        p++;
-    *p = '\0';
-    p++;
-    pd->alias = p;
-    while (*p) {
-        if (*p == '\006')
-            *p = 0;
-        p++;
-    }
-    return b;
+int seek_obj(const ObjTable *t, const char *wrd) {
+    for (uint32_t i = 0; i < t->n; i++)
+        if (strcmp(obj_field(t, i, OBJ_NAME), wrd) == 0)
+            return (int)i;
+    return -1;
 }
 
-static char *read_srcref_file(const char *nm) {
-    char fnm[512];
-    snprintf(fnm, 511, "%s/srcref_%s", cmp_dir, nm);
-    char *b = read_file(fnm, 0);
-    if (!b)
-        return NULL;
-
-    int size = strlen(b);
-    if (size == 0)
-        return b;
-
-    // Validate: expect exactly 3 \006 per line
-    const char *s0 = b;
-    char *s1 = b;
-    int n = 0;
-    while (*s1) {
-        if (*s1 == '\006')
-            n++;
-        if (*s1 == '\n') {
-            if (n == 3) {
-                n = 0;
-                s0 = s1 + 1;
-            } else {
-                char buf[64];
-                strncpy(buf, s0, 63);
-                buf[63] = '\0';
-                fprintf(stderr, "srcref: bad separator count: %d (%s)\n", n,
-                        buf);
-                fflush(stderr);
-                free(b);
-                return NULL;
-            }
-        }
-        s1++;
-    }
+/**
+ * @brief Read the cache files of a package. Only the name and the version
+ * number of installed packages are known at startup; the remaining data is
+ * read the first time the package is either loaded by R or referenced as
+ * `pkg::`.
+ *
+ * The completion index and items are built here too: the package data does
+ * not change after this function returns and can be read by any thread.
+ *
+ * @param pd The package data.
+ */
+void load_pkg_data(PkgData *pd) {
+    if (__atomic_load_n(&pd->loaded, __ATOMIC_ACQUIRE))
+        return;
 
-    // Convert \006 to \0
-    char *p = b;
-    while (*p) {
-        if (*p == '\006')
-            *p = 0;
-        p++;
+    mutex_lock(&load_lock);
+    if (!pd->loaded) {
+        Log("load_pkg_data(%s)", pd->name);
+        load_pkg_cache(pd, cmp_dir);
+        sym_add_pkg(pd);
+        obj_index_build(&pd->objs);
+        obj_frags_build(&pd->objs, pd->name);
+        __atomic_store_n(&pd->loaded, 1, __ATOMIC_RELEASE);
     }
-    return b;
+    mutex_unlock(&load_lock);
 }
 
-static char *read_args_file(const char *nm) {
-    char fnm[512];
-    snprintf(fnm, 511, "%s/args_%s", cmp_dir, nm);
-    char *b = read_file(fnm, 1);
-    if (!b)
-        return NULL;
-    char *p = b;
-    while (*p) {
-        if (*p == '\006')
-            *p = 0;
-        p++;
-    }
-    return b;
-}
-
-static void load_pkg_data(PkgData *pd, const char *fname) {
-    // Log("load_pkg_data(%s)", pd->name);
-    int size;
-    read_alias_file(pd);
-    pd->args = read_args_file(pd->name);
-    pd->srcref = read_srcref_file(pd->name);
-    if (!pd->objls) {
-        pd->nobjs = 0;
-        pd->objls = read_objls_file(fname, &size);
-        if (size > 2)
-            for (int i = 0; i < size; i++)
-                if (pd->objls[i] == '\n')
-                    pd->nobjs++;
-    }
+/**
+ * @brief Get an installed package by name, reading its cache files if this
+ * is the first time that the package is needed.
+ *
+ * @param nm The package name.
+ * @return The package data or NULL if the package is not installed.
+ */
+PkgData *get_pkg(const char *nm) {
+    PkgData *pd = find_pkg(nm);
+    if (pd)
+        load_pkg_data(pd);
+    return pd;
 }
 
 static PkgData *new_pkg_data(const char *nm, const char *vrsn) {
-    char fname[1024];
-
     PkgData *pd = calloc(1, sizeof(PkgData));
-    pd->name = malloc((strlen(nm) + 1) * sizeof(char));
-    strcpy(pd->name, nm);
-    pd->version = malloc((strlen(vrsn) + 1) * sizeof(char));
-    strcpy(pd->version, vrsn);
-
-    snprintf(fname, 1023, "%s/objls_%s_%s", cmp_dir, nm, vrsn);
-
-    // Check if objls_ exist
-    if (access(fname, F_OK) == 0) {
-        load_pkg_data(pd, fname);
-    } else {
-        fprintf(stderr, "Cache file '%s' not found\n", fname);
-        fflush(stderr);
-    }
+    pd->name = str_intern(nm);
+    pd->version = str_intern(vrsn);
     return pd;
 }
 
@@ -319,7 +306,8 @@ static void add_pkg(const char *nm, const char *vrsn) {
     cur->next = tmp;
 }
 
-void load_cached_data(void) {
+// See load_cached_data()
+static void read_cached_data(void) {
     DIR *d;
     const struct dirent *dir;
     char path[512];
@@ -328,6 +316,7 @@ void load_cached_data(void) {
     if (!d)
         return;
 
+    pkgs_wr_lock();
     while ((dir = readdir(d)) != NULL) {
         if (strstr(dir->d_name, "objls_")) {
             strcpy(path, dir->d_name);
@@ -337,7 +326,7 @@ void load_cached_data(void) {
                 vr++;
             *vr = '\0';
             vr++;
-            PkgData *pkg = get_pkg(nm);
+            PkgData *pkg = find_pkg(nm);
             if (pkg && strcmp(pkg->version, vr) != 0) {
                 LibList *lib = inst_libs;
                 LibList *prv = NULL;
@@ -349,6 +338,7 @@ void load_cached_data(void) {
                         } else {
                             inst_libs = lib->next;
                         }
+                        snap_drop_pkg(pkg);
                         delete_pkg(pkg);
                         break;
                     }
@@ -361,28 +351,29 @@ void load_cached_data(void) {
                 add_pkg(nm, vr);
         }
     }
+    pkgs_wr_unlock();
     closedir(d);
 }
 
-static void delete_lib_list(LibList *lib) {
-    LibList *next;
-    while (lib) {
-        next = lib->next;
-        free(lib);
-        lib = next;
-    }
+/**
+ * @brief Build the list of installed packages from the names of the `objls_`
+ * files in the cache directory. Only the names and version numbers are
+ * recorded here; see `load_pkg_data()`.
+ */
+void load_cached_data(void) {
+    mutex_lock(&upd_lock);
+    read_cached_data();
+    mutex_unlock(&upd_lock);
 }
 
-void finish_updating_loaded_libs(int has_new_lib) {
-    Log("finish_updating_loaded_libs");
+static void update_libs(int has_new_lib) {
+    Log("update_libs(%d)", has_new_lib);
 
     if (has_new_lib) {
-        load_cached_data();
+        read_cached_data();
     }
 
-    // Consider that all packages were unloaded
-    delete_lib_list(loaded_libs);
-    loaded_libs = NULL;
+    LibList *libs = NULL;
 
     char *msg = calloc(128 + strlen(lib_names), sizeof(char));
     sprintf(msg, "require('r.server').update_Rhelp_list('%s')", lib_names);
@@ -398,11 +389,15 @@ void finish_updating_loaded_libs(int has_new_lib) {
         if (pkg) {
             LibList *tmp = calloc(1, sizeof(LibList));
             tmp->pkg = pkg;
-            tmp->next = loaded_libs;
-            loaded_libs = tmp;
+            tmp->next = libs;
+            libs = tmp;
         }
     }
 
+    // The first package in libs masks the others
+    sym_set_ranks(inst_libs, libs);
+    snap_set_libs(libs);
+
     // Message to Neovim: Update Rhelp_list
     p = msg;
     while (*p) {
@@ -414,8 +409,15 @@ void finish_updating_loaded_libs(int has_new_lib) {
     free(msg);
 }
 
+void finish_updating_loaded_libs(int has_new_lib) {
+    mutex_lock(&upd_lock);
+    update_libs(has_new_lib);
+    mutex_unlock(&upd_lock);
+}
+
 void update_loaded_libs(char *libnms) {
     Log("update_loaded_libs: '%s'", libnms);
+    mutex_lock(&upd_lock);
     if (lib_names)
         free(lib_names);
     lib_names = malloc(sizeof(char) * strlen(libnms) + 1);
@@ -428,13 +430,15 @@ void update_loaded_libs(char *libnms) {
             libnms++;
         *libnms = 0;
         libnms++;
-        const PkgData *pkg = get_pkg(nm);
+        const PkgData *pkg = find_pkg(nm);
         if (!pkg) {
+            mutex_unlock(&upd_lock);
             send_cmd_to_nvim("require('r.server').build_cache_files()");
             return;
         }
     }
-    finish_updating_loaded_libs(0);
+    update_libs(0);
+    mutex_unlock(&upd_lock);
 }
 
 /**
@@ -453,33 +457,202 @@ void init_lib_list(void) {
     free(libnms);
 }
 
+// Publish a new list of .GlobalEnv objects. The list begins at `g`, inside
+// `buf`, and the snapshot takes ownership of `buf`.
+static void set_glblenv_buffer(char *buf, char *g) {
+    ObjTable t = {0};
+    if (!parse_obj_table(g, &t)) {
+        t.pool = g;
+        t.n = 0;
+        obj_arrays_bind(&t, NULL);
+    }
+    obj_index_build(&t);
+    obj_frags_build(&t, ".GlobalEnv");
+
+    mutex_lock(&upd_lock);
+    snap_set_glbnv(buf, &t);
+    glbnv_seq = *g ? 0 : -1;
+    mutex_unlock(&upd_lock);
+}
+
 /**
  * @brief Updates the buffer containing the global environment data from R.
- * @param g A string containing the new global environment data.
+ * @param g A string containing the new global environment data. It is
+ * copied.
  */
 void update_glblenv_buffer(const char *g) {
     Log("update_glblenv_buffer()");
-    int glbnv_size = strlen(g);
+    size_t glbnv_size = strlen(g);
+    char *buf = malloc(glbnv_size + 1);
+    memcpy(buf, g, glbnv_size + 1);
+    set_glblenv_buffer(buf, buf);
+}
 
-    if (glbnv_buffer) {
-        if ((glbnv_size + 2) > glbnv_buffer_sz) {
-            free(glbnv_buffer);
-            glbnv_buffer_sz = glbnv_size + 4096;
-            glbnv_buffer = calloc(glbnv_buffer_sz, sizeof(char));
-        }
-    } else {
-        glbnv_buffer_sz = glbnv_size + 4096;
-        glbnv_buffer = calloc(glbnv_buffer_sz, sizeof(char));
+/**
+ * @brief Update the list of .GlobalEnv objects with a message read from the
+ * shared memory region ("+G" followed by the list) without copying it.
+ *
+ * @param msg The message. It is freed with the list.
+ */
+void take_glblenv_buffer(char *msg) {
+    Log("take_glblenv_buffer()");
+    set_glblenv_buffer(msg, msg + 2);
+}
+
+/**
+ * @brief Keep the list of .GlobalEnv objects of the active nvimcom session
+ * while another session is active (see activate() in tcp.c).
+ *
+ * @param seq Where to store the number of edits applied to the list.
+ * @return The list, to be passed to `restore_glblenv()` or
+ * `free_glblenv()`.
+ */
+struct glb_env_ *save_glblenv(int *seq) {
+    mutex_lock(&upd_lock);
+    struct glb_env_ *g = snap_hold_glb();
+    *seq = glbnv_seq;
+    mutex_unlock(&upd_lock);
+    return g;
+}
+
+/**
+ * @brief Use again a list of .GlobalEnv objects kept by `save_glblenv()`.
+ * @param g The list (NULL for an empty one). It is owned by the snapshot.
+ * @param seq The number of edits applied to the list.
+ */
+void restore_glblenv(struct glb_env_ *g, int seq) {
+    mutex_lock(&upd_lock);
+    snap_use_glb(g);
+    glbnv_seq = g ? seq : -1;
+    mutex_unlock(&upd_lock);
+}
+
+void free_glblenv(struct glb_env_ *g) { snap_free_glb(g); }
+
+// Offset of the end of the last record in the pool of a table
+static size_t pool_end(const ObjTable *t) {
+    if (t->n == 0)
+        return 0;
+    const char *s = obj_field(t, t->n - 1, OBJ_DESCR);
+    s += strlen(s) + 1;
+    while (*s && *s != '\n')
+        s++;
+    if (*s)
+        s++;
+    return s - t->pool;
+}
+
+// Offset of the beginning of a record in the pool (or the end of the pool)
+static size_t rec_start(const ObjTable *t, uint32_t i) {
+    return i < t->n ? t->rec[i] : pool_end(t);
+}
+
+// Build a copy of `old` with the records from `skip` to `skip + del`
+// replaced by the lines in `lines`. Only the new lines are parsed.
+static int splice_obj_table(const ObjTable *old, uint32_t skip, uint32_t del,
+                            const char *lines, ObjTable *t, char **buf) {
+    size_t pre = rec_start(old, skip);
+    size_t sstart = rec_start(old, skip + del);
+    size_t suf = pool_end(old) - sstart;
+    size_t mlen = strlen(lines);
+
+    char *b = malloc(pre + mlen + suf + 1);
+    memcpy(b, old->pool, pre);
+    memcpy(b + pre, lines, mlen + 1);
+    ObjTable mt = {0};
+    if (!parse_obj_table(b + pre, &mt)) {
+        free(b);
+        return 0;
+    }
+    memcpy(b + pre + mlen, old->pool + sstart, suf);
+    b[pre + mlen + suf] = 0;
+
+    uint32_t m = mt.n;
+    uint32_t nrest = old->n - skip - del;
+    t->n = skip + m + nrest;
+    if (t->n == 0) {
+        t->pool = b;
+        *buf = b;
+        return 1;
     }
+    uint32_t *rec = malloc(obj_arrays_size(t->n));
+    for (int k = 0; k < OBJ_NFIELDS; k++) {
+        uint32_t *d = rec + (size_t)k * t->n;
+        const uint32_t *o = old->rec + (size_t)k * old->n;
+        memcpy(d, o, skip * sizeof(uint32_t));
+        for (uint32_t j = 0; j < m; j++)
+            d[skip + j] = mt.rec[(size_t)k * m + j] + pre;
+        o += skip + del;
+        d += skip + m;
+        for (uint32_t j = 0; j < nrest; j++)
+            d[j] = o[j] - sstart + pre + mlen;
+    }
+    free((void *)mt.rec);
 
-    memcpy(glbnv_buffer, g, glbnv_size);
-    glbnv_buffer[glbnv_size] = 0;
+    t->pool = b;
+    obj_arrays_bind(t, rec);
+    obj_ranges_build(t);
+    *buf = b;
+    return 1;
+}
 
-    if (check_omils_buffer(glbnv_buffer, &glbnv_size) == NULL) {
-        glbnv_buffer_sz = 0;
-        glbnv_buffer = NULL;
+/**
+ * @brief Apply an edit to the list of .GlobalEnv objects. nvimcom sends the
+ * whole list only when it changed a lot (see send_glb_env() in nvimcom.c);
+ * otherwise, it sends the lines that replace a range of lines of the
+ * previous list. The parsed records, the completion index and the items of
+ * the unchanged lines are reused.
+ *
+ * @param g The edit: "seq|skip|del|lines", where `seq` is the number of
+ * edits since the last whole list, `skip` the number of unchanged lines at
+ * the beginning and `del` the number of replaced lines.
+ */
+void update_glblenv_edit(const char *g) {
+    unsigned seq, skip, del;
+    int nc = 0;
+    if (sscanf(g, "%u|%u|%u|%n", &seq, &skip, &del, &nc) != 3 || nc == 0) {
+        fprintf(stderr, "Invalid .GlobalEnv edit: %.63s\n", g);
+        fflush(stderr);
         return;
     }
+
+    mutex_lock(&upd_lock);
+    Snapshot *snap = snap_acquire();
+    const ObjTable *old = snap->glbnv;
+    ObjTable t = {0};
+    char *buf = NULL;
+    int ok = glbnv_seq >= 0 && (unsigned)glbnv_seq == seq &&
+             skip + del <= old->n &&
+             splice_obj_table(old, skip, del, g + nc, &t, &buf);
+    if (ok) {
+        obj_index_splice(&t, old, skip, del);
+        obj_frags_splice(&t, old, skip, del, ".GlobalEnv");
+    }
+    snap_release(snap);
+
+    if (ok) {
+        snap_set_glbnv(buf, &t);
+        glbnv_seq++;
+    } else {
+        // Ask for the whole list
+        Log("update_glblenv_edit: seq %u x %d", seq, glbnv_seq);
+        glbnv_seq = -1;
+        send_to_nvimcom("A");
+    }
+    mutex_unlock(&upd_lock);
+}
+
+/**
+ * @brief Discard the edits applied to the list of .GlobalEnv objects and ask
+ * nvimcom for the whole list. Used when a message from nvimcom was lost: it
+ * might have been a whole list, and the next edits would be applied to an
+ * older one.
+ */
+void invalidate_glblenv(void) {
+    mutex_lock(&upd_lock);
+    glbnv_seq = -1;
+    send_to_nvimcom("A");
+    mutex_unlock(&upd_lock);
 }
 
 static ListStatus *search(ListStatus *root, const char *s) {
@@ -546,8 +719,9 @@ void toggle_list_status(char *s) {
                 n++;
             t++;
         }
-        // Check if the value of max_depth is high enough
-        if (p->status == 0 && n >= max_depth) {
+        // Check if the value of max_depth is high enough. In lazy mode, the
+        // elements are requested by compl2ob().
+        if (p->status == 0 && n >= max_depth && !lazy_list) {
             max_depth++;
             char b[16];
             snprintf(b, 15, "D%d", n + 1);
@@ -558,6 +732,47 @@ void toggle_list_status(char *s) {
     }
 }
 
+/**
+ * @brief Ask nvimcom to include the elements of a list of .GlobalEnv in the
+ * list of objects. They are missing either because nvimcom is in lazy mode
+ * or because the list is deeper than max_depth. nvimcom keeps listing the
+ * elements while the list exists; hence, each list is requested only once.
+ *
+ * @param path Name of the list as in the list of objects ("x$a", "obj@b").
+ */
+void request_elements(const char *path) {
+    mutex_lock(&req_lock);
+    for (int i = 0; i < requested.n; i++) {
+        if (strcmp(requested.path[i], path) == 0) {
+            mutex_unlock(&req_lock);
+            return;
+        }
+    }
+    if (requested.n == requested.sz) {
+        requested.sz = requested.sz ? 2 * requested.sz : 16;
+        requested.path =
+            realloc(requested.path, requested.sz * sizeof(char *));
+    }
+    char *s = malloc(strlen(path) + 1);
+    strcpy(s, path);
+    requested.path[requested.n++] = s;
+    mutex_unlock(&req_lock);
+
+    char *b = malloc(strlen(path) + 2);
+    sprintf(b, "X%s", path);
+    send_to_nvimcom(b);
+    free(b);
+}
+
+// A new nvimcom does not know the lists requested from the previous one
+void reset_requested_elements(void) {
+    mutex_lock(&req_lock);
+    for (int i = 0; i < requested.n; i++)
+        free(requested.path[i]);
+    requested.n = 0;
+    mutex_unlock(&req_lock);
+}
+
 void init_ds_vars(void) {
     // List tree sentinel
     listTree = new_ListStatus("base:", 0);
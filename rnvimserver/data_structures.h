@@ -1,6 +1,9 @@
 #ifndef DATA_STRUCTURES_H
 #define DATA_STRUCTURES_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Structure for list or library open/close status in the Object Browser
 typedef struct liststatus_ {
     char *key; // Name of the object or library. Library names are prefixed with
@@ -10,17 +13,78 @@ typedef struct liststatus_ {
     struct liststatus_ *right; // Right node
 } ListStatus;
 
+// Fields of the records in the objls_ files and in the list of .GlobalEnv
+// objects
+enum {
+    OBJ_NAME,  // Name of the object
+    OBJ_CLS,   // Single character representing the type of object
+    OBJ_TYPE,  // Class
+    OBJ_PKG,   // Package or environment
+    OBJ_ARGS,  // Arguments, if the object is a function
+    OBJ_TITLE, // Title
+    OBJ_DESCR, // Description
+    OBJ_NFIELDS
+};
+
+// Table of objects: the fields are NUL terminated strings stored in `pool`
+// (each record ends with a '\n', except in the binary cache images, where
+// repeated fields are shared by the records). The other arrays are
+// parallel, with one element per record, and are allocated as a single block
+// (see obj_arrays_size()): `rec` has OBJ_NFIELDS arrays of offsets in `pool`,
+// one per field, followed by `end` and `cls`.
+typedef struct obj_table_ {
+    const char *pool;    // The string pool
+    const uint32_t *rec; // Offset of field k of record i at rec[k * n + i]
+    const uint32_t *end; // Index after the last nested member of each record
+    const uint8_t *cls;  // Class character of each record (OBJ_CLS)
+    uint32_t n;          // Number of records
+    uint32_t *idx;       // Completion index (see objindex.c)
+    uint64_t *mask;      // Set of characters of each name (see objindex.c)
+    char *frag;          // Completion item of each record (see objindex.c)
+    uint32_t *frag_off;  // Offset of each item in `frag` (n + 1 offsets)
+} ObjTable;
+
+/**
+ * @brief Get a field of a record.
+ * @param t The table of objects.
+ * @param i Index of the record.
+ * @param k Index of the field.
+ * @return Pointer to the NUL terminated field.
+ */
+static inline const char *obj_field(const ObjTable *t, uint32_t i, int k) {
+    return t->pool + t->rec[(size_t)k * t->n + i];
+}
+
+// Size of the block with the arrays of a table of n records
+static inline size_t obj_arrays_size(uint32_t n) {
+    return (size_t)n * ((OBJ_NFIELDS + 1) * sizeof(uint32_t) + 1);
+}
+
+// Point the arrays of a table of `t->n` records to the block `a`
+static inline void obj_arrays_bind(ObjTable *t, const void *a) {
+    t->rec = t->n ? (const uint32_t *)a : NULL;
+    t->end = t->n ? t->rec + (size_t)OBJ_NFIELDS * t->n : NULL;
+    t->cls = t->n ? (const uint8_t *)(t->end + t->n) : NULL;
+}
+
+struct sym_entry_; // Entry of the symbol index (symbols.c)
+
 // Structure for package data
 typedef struct pkg_data_ {
-    char *name;    // The package name
-    char *version; // The package version number
-    char *title;   // The package short description
-    char *descr;   // The package description
-    char *alias;   // A copy of the alias_ file
-    char *objls;   // A copy of the objls_ file
-    char *args;    // A copy of the args_ file
-    char *srcref;  // A copy of the srcref_ file (source references)
-    int nobjs;     // Number of objects in objls
+    const char *name;        // The package name (interned)
+    const char *version;     // The package version number (interned)
+    const char *title;       // The package short description
+    const char *descr;       // The package description
+    const char *alias;       // The aliases from the alias_ file
+    const char *args;        // The arguments from the args_ file
+    const char *srcref;      // The srcref_ file (source references)
+    ObjTable objs;           // The objects from the objls_ file
+    void *map;               // The binary cache file mapped in memory
+    size_t map_sz;           // Size of the binary cache file
+    int mapped;              // Is `map` a memory mapping or a heap buffer?
+    int loaded;              // Were the cache files already read?
+    int rank;                // Position in the search path (0 if not attached)
+    struct sym_entry_ *syms; // Entries of the objects in the symbol index
 } PkgData;
 
 typedef struct lib_data_ {
@@ -28,13 +92,27 @@ typedef struct lib_data_ {
     struct lib_data_ *next;
 } LibList;
 
+struct glb_env_; // Objects of .GlobalEnv (snapshot.c)
+
 void set_max_depth(int m);
 int get_list_status(const char *s, int stt);
 void toggle_list_status(char *s);
+void request_elements(const char *path);
+void reset_requested_elements(void);
 void init_lib_list(void);                  // Initialize the list of libraries
 void update_loaded_libs(char *libnms);     // Update the list of libraries
 void update_glblenv_buffer(const char *g); // Update global environment buffer
+void update_glblenv_edit(const char *g);   // Edit global environment buffer
+void take_glblenv_buffer(char *msg);       // Update from shared memory
+void invalidate_glblenv(void);             // Ask for the whole list
+struct glb_env_ *save_glblenv(int *seq);
+void restore_glblenv(struct glb_env_ *g, int seq);
+void free_glblenv(struct glb_env_ *g);
 void load_cached_data(void); // Build list of objects for completion
+int parse_obj_table(char *b, ObjTable *t);
+int seek_obj(const ObjTable *t, const char *wrd);
+void load_pkg_data(PkgData *pd);
+PkgData *get_pkg(const char *nm);
 void finish_updating_loaded_libs(int has_new_lib);
 void init_ds_vars(void);
 void change_all(int stt);
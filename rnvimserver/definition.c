@@ -8,6 +8,8 @@
 #include "lsp.h"
 #include "utilities.h"
 #include "tcp.h"
+#include "symbols.h"
+#include "snapshot.h"
 
 /**
  * @brief Search a package's srcref buffer for a symbol and extract
@@ -96,31 +98,13 @@ static int try_resolve(const char *id, const char *symbol, const char *pkg_name,
     return 1;
 }
 
-void definition(const char *params) {
-    Log("definition: %s", params);
-
-    char *id = strstr(params, "\"orig_id\":");
-    char *symbol = strstr(params, "\"symbol\":\"");
-    char *pkg = strstr(params, "\"pkg\":\"");
-
-    cut_json_int(&id, 10);
-    cut_json_str(&symbol, 10);
-    cut_json_str(&pkg, 7);
-
-    if (!id || !symbol || !*symbol) {
-        if (id)
-            send_null(id);
-        return;
-    }
-
+static void find_definition(const char *id, const char *symbol,
+                            const char *pkg) {
     if (pkg && *pkg) {
-        LibList *lib = inst_libs;
-        while (lib) {
-            if (strcmp(lib->pkg->name, pkg) == 0) {
-                try_resolve(id, symbol, pkg, lib->pkg);
-                return;
-            }
-            lib = lib->next;
+        PkgData *pd = get_pkg(pkg);
+        if (pd) {
+            try_resolve(id, symbol, pkg, pd);
+            return;
         }
         if (r_running) {
             char cmd[512];
@@ -133,29 +117,12 @@ void definition(const char *params) {
         return;
     }
 
-    LibList *lib = loaded_libs;
-    while (lib) {
-        if (lib->pkg->objls) {
-            const char *s = seek_word(lib->pkg->objls, symbol);
-            if (s) {
-                try_resolve(id, symbol, lib->pkg->name, lib->pkg);
-                return;
-            }
-        }
-        lib = lib->next;
-    }
-
-    // Not in loaded_libs — search inst_libs
-    lib = inst_libs;
-    while (lib) {
-        if (lib->pkg->objls) {
-            const char *s = seek_word(lib->pkg->objls, symbol);
-            if (s) {
-                try_resolve(id, symbol, lib->pkg->name, lib->pkg);
-                return;
-            }
-        }
-        lib = lib->next;
+    // Search loaded_libs first and then the other packages whose cache
+    // files were already read (the remaining ones are left to R)
+    PkgData *pd;
+    if (sym_find_any(symbol, &pd) >= 0) {
+        try_resolve(id, symbol, pd->name, pd);
+        return;
     }
 
     // Not found — full R search as last resort
@@ -169,3 +136,25 @@ void definition(const char *params) {
 
     send_null(id);
 }
+
+void definition(const char *params) {
+    Log("definition: %s", params);
+
+    char *id = strstr(params, "\"orig_id\":");
+    char *symbol = strstr(params, "\"symbol\":\"");
+    char *pkg = strstr(params, "\"pkg\":\"");
+
+    cut_json_int(&id, 10);
+    cut_json_str(&symbol, 10);
+    cut_json_str(&pkg, 7);
+
+    if (!id || !symbol || !*symbol) {
+        if (id)
+            send_null(id);
+        return;
+    }
+
+    Snapshot *snap = snap_acquire(); // Keep the package data alive
+    find_definition(id, symbol, pkg);
+    snap_release(snap);
+}
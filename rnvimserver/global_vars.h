@@ -6,10 +6,9 @@
 #include "data_structures.h"
 
 extern LibList *inst_libs;   // Pointer to first package data
-extern LibList *loaded_libs; // Pointer to loaded library
-extern char *glbnv_buffer;   // Global environment buffer
 extern char tmpdir[256];     // Temporary directory
 extern int auto_obbr;        // Auto object browser flag
 extern int r_running;        // Indicates whether R is running
+extern int lazy_list;        // Does nvimcom list elements of lists on demand?
 
 #endif
@@ -8,51 +8,36 @@
 #include "lsp.h"
 #include "utilities.h"
 #include "tcp.h"
+#include "symbols.h"
+#include "snapshot.h"
+#include "workers.h"
 #include "../nvimcom/src/common.h"
 
-static char *hov_buf;
-static size_t hov_buf_sz = 4096;
-
-static int get_info(const char *s) {
-    Log("get_info: %s", s);
-    int i;
-    size_t nsz;
-    const char *f[7];
-    i = 0;
-    while (i < 7) {
-        f[i] = s;
-        i++;
-        while (*s != 0)
-            s++;
-        s++;
-    }
-    while (*s != '\n' && *s != 0)
-        s++;
+static StrBuf hov_buf;
 
-    // Avoid buffer overflow if the information is bigger than
-    // hov_buf.
-    char *p = hov_buf;
-    nsz = strlen(f[4]) + strlen(f[5]) + strlen(f[6]) + 1024 + (p - hov_buf);
-    if (hov_buf_sz < nsz)
-        p = grow_buffer(&hov_buf, &hov_buf_sz, nsz - hov_buf_sz + 32768);
+static int get_info(const ObjTable *t, uint32_t i) {
+    Log("get_info: %s", obj_field(t, i, OBJ_NAME));
+    const char *f[OBJ_NFIELDS];
+    for (int k = 0; k < OBJ_NFIELDS; k++)
+        f[k] = obj_field(t, i, k);
 
     size_t sz = strlen(f[5]) + strlen(f[6]) + 16;
-    char *buffer = malloc(sz);
-    p = str_cat(p, f[2]);
-    p = str_cat(p, " `");
-    p = str_cat(p, f[3]);
-    p = str_cat(p, "::");
-    p = str_cat(p, f[0]);
-    p = str_cat(p, "`\x14\x14**");
+    char *buffer = arena_alloc(job_arena(), sz);
+    sb_reset(&hov_buf);
+    sb_cat(&hov_buf, f[2]);
+    sb_cat(&hov_buf, " `");
+    sb_cat(&hov_buf, f[3]);
+    sb_cat(&hov_buf, "::");
+    sb_cat(&hov_buf, f[0]);
+    sb_cat(&hov_buf, "`\x14\x14**");
     format(f[5], buffer, ' ', '\x14');
-    p = str_cat(p, buffer);
-    p = str_cat(p, "**\x14\x14");
+    sb_cat(&hov_buf, buffer);
+    sb_cat(&hov_buf, "**\x14\x14");
     format(f[6], buffer, ' ', '\x14');
-    p = str_cat(p, buffer);
-    free(buffer);
+    sb_cat(&hov_buf, buffer);
     if (f[1][0] == 'F') {
         char *b = format_usage(f[0], f[4], 1);
-        str_cat(p, b);
+        sb_cat(&hov_buf, b);
         free(b);
         return 1;
     }
@@ -65,20 +50,13 @@ static void send_result(const char *req_id, const char *doc) {
         return;
     }
 
-    const char *fmt =
-        "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{\"contents\":\"%s\"}}";
-
-    char *fdoc = (char *)calloc(strlen(doc) + 1, sizeof(char));
-    format(doc, fdoc, ' ', '\x14');
-    char *edoc = esc_json(fdoc);
-    size_t len = sizeof(char) * (strlen(edoc) + 256);
-    char *res = (char *)malloc(len);
-    snprintf(res, len - 1, fmt, req_id, edoc);
-
-    send_ls_response(req_id, res);
-    free(fdoc);
-    free(edoc);
-    free(res);
+    JsonWriter w;
+    jw_init(&w, strlen(doc) + 256);
+    jw_printf(&w, "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{\"contents\":\"",
+              req_id);
+    jw_doc(&w, doc);
+    jw_cat(&w, "\"}}");
+    send_ls_json(req_id, &w);
 }
 
 void send_hover_doc(const char *hid, const char *hdoc) {
@@ -87,104 +65,90 @@ void send_hover_doc(const char *hid, const char *hdoc) {
 
 // Seek object in loaded libraries
 static void seek_in_libs(const char *id, const char *word) {
-    LibList *lib = loaded_libs;
-    while (lib) {
-        if (lib->pkg->objls) {
-            const char *s = seek_word(lib->pkg->objls, word);
-            if (s) {
-                if (is_function(s)) {
-                    get_info(s);
-                    send_result(id, hov_buf);
-                    return;
-                }
-            }
-        }
-        lib = lib->next;
+    PkgData *pd;
+    int i = sym_find_fun(word, &pd);
+    if (i >= 0) {
+        get_info(&pd->objs, i);
+        send_result(id, hov_buf.b);
+        return;
     }
     send_null(id);
 }
 
-void hov_seek(const char *id, const char *word) { seek_in_libs(id, word); }
-
-void hover(const char *params) {
-    Log("hover: %s", params);
-
-    char *id = strstr(params, "\"orig_id\":");
-    char *word = strstr(params, "\"word\":\"");
-    char *fobj = strstr(params, "\"fobj\":\"");
-
-    cut_json_int(&id, 10);
-    cut_json_str(&word, 8);
-    cut_json_str(&fobj, 8);
-
-    if (!hov_buf) {
-        hov_buf = (char *)malloc(hov_buf_sz);
-    }
-    memset(hov_buf, 0, hov_buf_sz);
+void hov_seek(const char *id, const char *word) {
+    Snapshot *snap = snap_acquire(); // Keep the package data alive
+    seek_in_libs(id, word);
+    snap_release(snap);
+}
 
+static void hover_word(const Snapshot *snap, const char *id, char *word,
+                       const char *fobj) {
     // First search the .GlobalEnv
-    if (glbnv_buffer) {
-        const char *s = seek_word(glbnv_buffer, word);
-        if (s) {
-            if (is_function(s)) {
-                get_info(s);
-                send_result(id, hov_buf);
-            } else {
-                char buffer[128];
-                snprintf(buffer, 127, "nvimcom:::hover_summary('%s', %s)", id,
-                         word);
-                nvimcom_eval(buffer);
-            }
-            return;
+    const ObjTable *g = snap->glbnv;
+    int i = seek_obj(g, word);
+    if (i >= 0) {
+        if (g->cls[i] == 'F') {
+            get_info(g, i);
+            send_result(id, hov_buf.b);
+        } else {
+            char buffer[128];
+            snprintf(buffer, 127, "nvimcom:::hover_summary('%s', %s)", id,
+                     word);
+            nvimcom_eval(buffer);
         }
+        return;
     }
 
-    LibList *lib;
-    char *pkg = NULL;
+    PkgData *pd = NULL;
     if (strstr(word, "::")) {
-        pkg = word;
+        const char *pkg = word;
         word = strstr(word, "::");
         *word = '\0';
         word += 2;
-        lib = inst_libs;
+        pd = get_pkg(pkg);
+        i = pd ? sym_find_in(pd, word) : -1;
     } else {
-        lib = loaded_libs;
+        i = sym_find(word, &pd);
+    }
+
+    if (i < 0) {
+        send_null(id);
+        return;
     }
 
-    while (lib) {
-        if (lib->pkg->objls) {
-            if (pkg && strcmp(pkg, lib->pkg->name) != 0) {
-                lib = lib->next;
-                continue;
-            }
-            const char *s = seek_word(lib->pkg->objls, word);
-            if (s) {
-                if (is_function(s)) {
-                    if (r_running && fobj) {
-                        // If the function display information on the relevant
-                        // method
-                        char cmd[128];
-                        snprintf(
-                            cmd, 127,
-                            "nvimcom:::sighover_method('%s', '%s', '%s', 'h')",
-                            id, word, fobj);
-                        nvimcom_eval(cmd);
-                    } else {
-                        get_info(s);
-                        send_result(id, hov_buf);
-                    }
-                } else if (r_running) {
-                    char buffer[128];
-                    snprintf(buffer, 127, "nvimcom:::hover_summary('%s', %s)",
-                             id, word);
-                    nvimcom_eval(buffer);
-                }
-                return;
-            }
+    const ObjTable *t = &pd->objs;
+    if (t->cls[i] == 'F') {
+        if (r_running && fobj) {
+            // If the function display information on the relevant
+            // method
+            char cmd[128];
+            snprintf(cmd, 127,
+                     "nvimcom:::sighover_method('%s', '%s', '%s', 'h')", id,
+                     word, fobj);
+            nvimcom_eval(cmd);
+        } else {
+            get_info(t, i);
+            send_result(id, hov_buf.b);
         }
-        lib = lib->next;
+    } else if (r_running) {
+        char buffer[128];
+        snprintf(buffer, 127, "nvimcom:::hover_summary('%s', %s)", id, word);
+        nvimcom_eval(buffer);
     }
+}
 
-    send_null(id);
-    return;
+void hover(const char *params) {
+    Log("hover: %s", params);
+
+    char *id = strstr(params, "\"orig_id\":");
+    char *word = strstr(params, "\"word\":\"");
+    char *fobj = strstr(params, "\"fobj\":\"");
+
+    cut_json_int(&id, 10);
+    cut_json_str(&word, 8);
+    cut_json_str(&fobj, 8);
+
+    Snapshot *snap = snap_acquire();
+    hover_word(snap, id, word, fobj);
+    snap_release(snap);
 }
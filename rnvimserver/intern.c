@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "threads.h"
+
+/*
+ * Deduplication of strings. A StrSet finds repeated strings while a table
+ * of objects is written into a binary cache image (see cache.c), and the
+ * process-wide pool keeps a single copy of strings that are shared by many
+ * structures, such as the names and version numbers of packages. Interned
+ * strings are never released.
+ */
+
+#define INTERN_CHUNK 4096 // Size of the blocks of the interned strings
+
+static StrSet interned;                // The interned strings
+static char *chunk;                    // Block being filled with strings
+static size_t chunk_free;              // Free bytes at the end of `chunk`
+static Mutex intern_lock = MUTEX_INIT; // Protects the interned strings
+
+// FNV-1a hash
+static uint32_t str_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Index of the slot of `k`: either the slot where it is or an empty one
+static uint32_t str_set_slot(const StrSet *s, const char *k) {
+    uint32_t i = str_hash(k) & (s->sz - 1);
+    while (s->key[i] && strcmp(s->key[i], k) != 0)
+        i = (i + 1) & (s->sz - 1);
+    return i;
+}
+
+static void str_set_grow(StrSet *s) {
+    StrSet o = *s;
+    s->sz = o.sz ? 2 * o.sz : 1024;
+    s->key = calloc(s->sz, sizeof(char *));
+    s->val = malloc(s->sz * sizeof(uint32_t));
+    for (uint32_t i = 0; i < o.sz; i++) {
+        if (o.key[i]) {
+            uint32_t j = str_set_slot(s, o.key[i]);
+            s->key[j] = o.key[i];
+            s->val[j] = o.val[i];
+        }
+    }
+    free(o.key);
+    free(o.val);
+}
+
+/**
+ * @brief Add a string to a set unless it is already there.
+ *
+ * @param s The set. It must be zeroed before its first use.
+ * @param k The string. It must not change while it is in the set.
+ * @param v The value of the string. If the string was already in the set,
+ * the value stored with it is returned here.
+ * @return 1 if the string was added and 0 if it was already in the set.
+ */
+int str_set_add(StrSet *s, const char *k, uint32_t *v) {
+    if (2 * (s->n + 1) > s->sz)
+        str_set_grow(s);
+    uint32_t i = str_set_slot(s, k);
+    if (s->key[i]) {
+        *v = s->val[i];
+        return 0;
+    }
+    s->key[i] = k;
+    s->val[i] = *v;
+    s->n++;
+    return 1;
+}
+
+void str_set_free(StrSet *s) {
+    free(s->key);
+    free(s->val);
+    memset(s, 0, sizeof(StrSet));
+}
+
+/**
+ * @brief Get the copy of a string kept in the process-wide pool.
+ *
+ * @param s The string.
+ * @return A string equal to `s` that is never freed.
+ */
+const char *str_intern(const char *s) {
+    mutex_lock(&intern_lock);
+    if (2 * (interned.n + 1) > interned.sz)
+        str_set_grow(&interned);
+    uint32_t i = str_set_slot(&interned, s);
+    if (!interned.key[i]) {
+        size_t len = strlen(s) + 1;
+        char *p;
+        if (len > INTERN_CHUNK / 4) {
+            p = malloc(len);
+        } else {
+            if (len > chunk_free) {
+                chunk = malloc(INTERN_CHUNK);
+                chunk_free = INTERN_CHUNK;
+            }
+            p = chunk;
+            chunk += len;
+            chunk_free -= len;
+        }
+        memcpy(p, s, len);
+        interned.key[i] = p;
+        interned.n++;
+    }
+    const char *r = interned.key[i];
+    mutex_unlock(&intern_lock);
+    return r;
+}
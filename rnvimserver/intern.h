@@ -0,0 +1,19 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+// Hash set of strings, each one with an associated value. The set does not
+// copy the strings.
+typedef struct str_set_ {
+    const char **key; // The strings (NULL in empty slots)
+    uint32_t *val;    // The value associated with each string
+    uint32_t n;       // Number of strings
+    uint32_t sz;      // Number of slots (a power of 2)
+} StrSet;
+
+int str_set_add(StrSet *s, const char *k, uint32_t *v);
+void str_set_free(StrSet *s);
+const char *str_intern(const char *s);
+
+#endif
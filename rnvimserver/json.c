@@ -0,0 +1,347 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "../nvimcom/src/common.h"
+
+/*
+ * Single pass tokenizer of the JSON messages from Neovim. It does not copy
+ * or unescape anything: each value is recorded in the tape as a pair of
+ * offsets in the text, and the tokens of arrays and objects know where
+ * their children end, so that the members of an object can be found
+ * without looking at the values of the other members. Strings are skipped
+ * with strcspn(), which is vectorized by the C library.
+ *
+ * The values are returned either copied into a buffer or terminated by
+ * '\0' in place. The latter changes the text of the arrays and objects
+ * around the value; hence, their text must be got first.
+ */
+
+#define JSON_MAX_DEPTH 64
+
+static int new_tok(JsonTape *t, uint32_t type, size_t start) {
+    if (t->n == t->sz) {
+        t->sz = t->sz ? 2 * t->sz : 256;
+        t->tok = realloc(t->tok, t->sz * sizeof(JsonTok));
+    }
+    JsonTok *k = &t->tok[t->n];
+    k->type = type;
+    k->start = start;
+    k->end = start;
+    k->skip = t->n + 1;
+    return t->n++;
+}
+
+/**
+ * @brief Tokenize a JSON text. Only the structure is checked: missing or
+ * extra commas and colons are not detected.
+ *
+ * @param t The tape. It must be zeroed before its first use.
+ * @param s The text. It must be followed by '\0'.
+ * @param len The length of the text.
+ * @return 1 on success and 0 if the text is not valid.
+ */
+int json_parse(JsonTape *t, char *s, size_t len) {
+    uint32_t stack[JSON_MAX_DEPTH];
+    int depth = 0;
+    t->s = s;
+    t->n = 0;
+
+    size_t i = 0;
+    while (i < len) {
+        int k;
+        size_t j;
+        switch (s[i]) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case ',':
+        case ':':
+            i++;
+            break;
+        case '{':
+        case '[':
+            if (depth == JSON_MAX_DEPTH)
+                return 0;
+            k = new_tok(t, s[i] == '{' ? JSON_OBJ : JSON_ARR, i);
+            stack[depth++] = k;
+            i++;
+            break;
+        case '}':
+        case ']':
+            if (depth == 0)
+                return 0;
+            k = stack[--depth];
+            if (t->tok[k].type != (s[i] == '}' ? JSON_OBJ : JSON_ARR))
+                return 0;
+            t->tok[k].end = ++i;
+            t->tok[k].skip = t->n;
+            break;
+        case '"':
+            j = i + 1;
+            for (;;) {
+                j += strcspn(s + j, "\"\\");
+                if (s[j] == '\\' && j + 1 < len)
+                    j += 2;
+                else
+                    break;
+            }
+            if (j >= len || s[j] != '"')
+                return 0;
+            k = new_tok(t, JSON_STR, i + 1);
+            t->tok[k].end = j;
+            i = j + 1;
+            break;
+        default:
+            j = i;
+            while (j < len && s[j] && !strchr(",:]} \t\r\n", s[j]))
+                j++;
+            if (j == i) // '\0' inside the message
+                return 0;
+            k = new_tok(t, s[i] == '-' || (s[i] >= '0' && s[i] <= '9')
+                               ? JSON_NUM
+                               : JSON_LIT,
+                        i);
+            t->tok[k].end = j;
+            i = j;
+            break;
+        }
+        if (depth == 0 && t->n > 0)
+            break;
+    }
+    return depth == 0 && t->n > 0;
+}
+
+/**
+ * @brief Find a member of an object.
+ * @param t The tape.
+ * @param obj The index of the object (negative values are accepted).
+ * @param key The name of the member.
+ * @return The index of the value or -1 if it was not found.
+ */
+int json_get(const JsonTape *t, int obj, const char *key) {
+    if (obj < 0 || t->tok[obj].type != JSON_OBJ)
+        return -1;
+    size_t len = strlen(key);
+    uint32_t k = obj + 1;
+    while (k + 1 < t->tok[obj].skip) {
+        const JsonTok *kt = &t->tok[k];
+        if (kt->end - kt->start == len &&
+            memcmp(t->s + kt->start, key, len) == 0)
+            return k + 1;
+        k = t->tok[k + 1].skip;
+    }
+    return -1;
+}
+
+/**
+ * @brief Copy a value without its quotes (if it is a string) and without
+ * unescaping it.
+ * @param t The tape.
+ * @param i The index of the value (the buffer is emptied if it is negative).
+ * @param buf The buffer.
+ * @param sz The size of the buffer. The value is truncated if needed.
+ * @return The length of the copied value.
+ */
+size_t json_copy(const JsonTape *t, int i, char *buf, size_t sz) {
+    size_t len = 0;
+    if (i >= 0) {
+        len = t->tok[i].end - t->tok[i].start;
+        if (len >= sz)
+            len = sz - 1;
+        memcpy(buf, t->s + t->tok[i].start, len);
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+long json_int(const JsonTape *t, int i) {
+    return i < 0 ? 0 : strtol(t->s + t->tok[i].start, NULL, 10);
+}
+
+/**
+ * @brief Get a string or number terminated by '\0' in place, without quotes
+ * and without unescaping it.
+ * @return The value or NULL if `i` is negative.
+ */
+char *json_str(JsonTape *t, int i) {
+    if (i < 0)
+        return NULL;
+    t->s[t->tok[i].end] = '\0';
+    return t->s + t->tok[i].start;
+}
+
+/**
+ * @brief Get the JSON text of a value terminated by '\0' in place.
+ * @return The text or NULL if `i` is negative.
+ */
+char *json_raw(JsonTape *t, int i) {
+    if (i < 0)
+        return NULL;
+    if (t->tok[i].type != JSON_STR) {
+        t->s[t->tok[i].end] = '\0';
+        return t->s + t->tok[i].start;
+    }
+    t->s[t->tok[i].end + 1] = '\0';
+    return t->s + t->tok[i].start - 1;
+}
+
+/*
+ * Writer of the messages sent to Neovim. The payload is appended to a single
+ * buffer that grows as needed and has room for the Content-Length header at
+ * its start (see send_ls_json()). Strings are escaped while being appended:
+ * the spans of bytes that do not need escaping are found eight bytes at a
+ * time and copied with memcpy().
+ */
+
+/**
+ * @brief Initialize a writer.
+ * @param w The writer.
+ * @param sz Expected size of the payload.
+ */
+void jw_init(JsonWriter *w, size_t sz) {
+    w->sz = JSON_HEAD + sz + 1;
+    w->b = malloc(w->sz);
+    w->len = JSON_HEAD;
+    w->b[w->len] = '\0';
+}
+
+// Make room for n more bytes and the terminating '\0'
+static void jw_room(JsonWriter *w, size_t n) {
+    if (w->len + n + 1 <= w->sz)
+        return;
+    while (w->len + n + 1 > w->sz)
+        w->sz *= 2;
+    w->b = realloc(w->b, w->sz);
+}
+
+void jw_raw(JsonWriter *w, const char *s, size_t len) {
+    jw_room(w, len);
+    memcpy(w->b + w->len, s, len);
+    w->len += len;
+    w->b[w->len] = '\0';
+}
+
+void jw_cat(JsonWriter *w, const char *s) { jw_raw(w, s, strlen(s)); }
+
+void jw_printf(JsonWriter *w, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(w->b + w->len, w->sz - w->len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n >= w->sz - w->len) {
+        jw_room(w, n);
+        va_start(ap, fmt);
+        vsnprintf(w->b + w->len, w->sz - w->len, fmt, ap);
+        va_end(ap);
+    }
+    w->len += n;
+}
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+// Non zero if any byte of x is a control character, '"' or '\'
+static inline uint64_t must_escape(uint64_t x) {
+    return ((x - ONES * 0x20) | ((x ^ (ONES * '"')) - ONES) |
+            ((x ^ (ONES * '\\')) - ONES)) &
+           ~x & HIGHS;
+}
+
+static inline int must_escape_char(char c) {
+    return (unsigned char)c < 0x20 || c == '"' || c == '\\';
+}
+
+// Append the escaped representation of c. The characters \x12, \x13 and \x14
+// are used by nvimcom in place of '\', '\'' and new lines. Other control
+// characters are kept because they separate fields (see chunk.c).
+static void jw_esc_char(JsonWriter *w, char c) {
+    switch (c) {
+    case '\x14':
+    case '\n':
+        jw_raw(w, "\\n", 2);
+        break;
+    case '\x13':
+        jw_raw(w, "'", 1);
+        break;
+    case '\x12':
+    case '\\':
+        jw_raw(w, "\\\\", 2);
+        break;
+    case '"':
+        jw_raw(w, "\\\"", 2);
+        break;
+    case '\r':
+        jw_raw(w, "\\r", 2);
+        break;
+    case '\t':
+        jw_raw(w, "\\t", 2);
+        break;
+    case '\b':
+        jw_raw(w, "\\b", 2);
+        break;
+    case '\f':
+        jw_raw(w, "\\f", 2);
+        break;
+    default:
+        jw_raw(w, &c, 1);
+        break;
+    }
+}
+
+static void jw_esc(JsonWriter *w, const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        size_t j = i;
+        uint64_t x;
+        while (j + 8 <= len) {
+            memcpy(&x, s + j, 8);
+            if (must_escape(x))
+                break;
+            j += 8;
+        }
+        while (j < len && !must_escape_char(s[j]))
+            j++;
+        jw_raw(w, s + i, j - i);
+        if (j < len)
+            jw_esc_char(w, s[j++]);
+        i = j;
+    }
+}
+
+/**
+ * @brief Append a string escaped for JSON (without the quotes).
+ */
+void jw_str(JsonWriter *w, const char *s) { jw_esc(w, s, strlen(s)); }
+
+/**
+ * @brief Append a documentation text escaped for JSON. The lines are wrapped
+ * at the documentation width, exactly as format(s, dest, ' ', '\x14') does.
+ */
+void jw_doc(JsonWriter *w, const char *s) {
+    size_t width = get_doc_width();
+    size_t sz = strlen(s);
+    size_t i = 0, n = 0, d = 0, done = 0;
+    while (i < sz) {
+        if (s[i] == ' ')
+            d = i;
+        else if (s[i] == '\x14' || (s[i] == '\\' && s[i + 1] == 'n'))
+            n = 0;
+        if (n == width && d > 0) {
+            // Replace the last space with a new line
+            jw_esc(w, s + done, d - done);
+            jw_raw(w, "\\n", 2);
+            done = d + 1;
+            n = i - d;
+            d = 0;
+        }
+        i++;
+        n++;
+    }
+    jw_esc(w, s + done, sz - done);
+}
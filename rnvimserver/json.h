@@ -0,0 +1,53 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum json_type { JSON_OBJ, JSON_ARR, JSON_STR, JSON_NUM, JSON_LIT };
+
+// A value of a parsed JSON text. The members of an object are stored as
+// pairs of tokens: the key (a string) and the value.
+typedef struct json_tok_ {
+    uint32_t start; // Offset of the value (of its content for strings)
+    uint32_t end;   // Offset after the value (of the closing '"' for strings)
+    uint32_t skip;  // Index of the token after the value and its children
+    uint32_t type;  // One of json_type
+} JsonTok;
+
+// Tape of tokens of a JSON text, in the order they appear in the text. The
+// token 0 is the root value. The same tape is reused for many texts.
+typedef struct json_tape_ {
+    char *s;      // The JSON text
+    JsonTok *tok; // The tokens
+    uint32_t n;   // Number of tokens
+    uint32_t sz;  // Allocated number of tokens
+} JsonTape;
+
+int json_parse(JsonTape *t, char *s, size_t len);
+int json_get(const JsonTape *t, int obj, const char *key);
+size_t json_copy(const JsonTape *t, int i, char *buf, size_t sz);
+long json_int(const JsonTape *t, int i);
+char *json_str(JsonTape *t, int i);
+char *json_raw(JsonTape *t, int i);
+
+// Room for the Content-Length header at the start of the buffer of a writer
+#define JSON_HEAD 40
+
+// Writer of a JSON message. The payload is written after JSON_HEAD bytes,
+// which are left for the header, and is always terminated by '\0'.
+typedef struct json_writer_ {
+    char *b;    // The buffer
+    size_t len; // Offset of the end of the payload
+    size_t sz;  // Allocated size
+} JsonWriter;
+
+void jw_init(JsonWriter *w, size_t sz);
+void jw_raw(JsonWriter *w, const char *s, size_t len);
+void jw_cat(JsonWriter *w, const char *s);
+__attribute__((format(printf, 2, 3))) void jw_printf(JsonWriter *w,
+                                                      const char *fmt, ...);
+void jw_str(JsonWriter *w, const char *s);
+void jw_doc(JsonWriter *w, const char *s);
+
+#endif
@@ -1,9 +1,25 @@
 #ifndef RNVIMSERVER_H
 #define RNVIMSERVER_H
 
+#include <stddef.h>
+
+#include "json.h"
+
+#ifdef WIN32
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
 void send_ls_response(const char *req_id, const char *json_payload);
+void send_ls_json(const char *req_id, JsonWriter *w);
 void send_cmd_to_nvim(const char *cmd);
-void send_menu_items(char *compl_items, const char *req_id);
+void send_menu_items(const char *compl_items, const char *req_id);
+void send_completion_iov(const char *req_id, struct iovec *v, size_t n,
+                         int incomplete);
 void send_empty(const char *req_id);
 void send_null(const char *req_id);
 #endif
@@ -9,6 +9,8 @@
 #include "obbr.h"
 #include "utilities.h"
 #include "lsp.h"
+#include "snapshot.h"
+#include "threads.h"
 
 static int nLibObjs;        // Number of library objects
 static int nvimcom_is_utf8; // Flag for UTF-8 encoding
@@ -19,6 +21,8 @@ static int OpenLS;          // Flag for open lists in tree view
 static char liblist[576];   // Library list buffer
 static char globenv[576];   // Global environment buffer
 static int allnames; // Flag for showing all names, including starting with '.'
+static Mutex obbr_lock = MUTEX_INIT; // Used by the main and TCP threads
+static unsigned lib2ob_gen; // Number of calls to lib2ob()
 
 void init_obbr_vars(void) {
     char envstr[1024];
@@ -85,47 +89,39 @@ static void copy_str_to_ob(const char *o, char *d, int sz) {
     d[i] = 0;
 }
 
-static const char *write_ob_line(const char *p, const char *bs,
-                                 const char *prfx, int closeddf, FILE *fl) {
+static uint32_t write_ob_line(const ObjTable *t, uint32_t i, const char *bs,
+                              const char *prfx, int closeddf, FILE *fl) {
     char base1[128];
     char prefix[128];
     char nm[160];
     char descr[160];
-    const char *f[7];
+    const char *f[OBJ_NFIELDS];
     const char *s;    // Diagnostic pointer
     const char *bsnm; // Name of object including its parent list, data.frame or
                       // S4 object
     int df;           // Is data.frame? If yes, start open unless closeddf = 1
-    int n;
 
-    nLibObjs--;
+    uint32_t end = t->end[i]; // Index after the nested members
+    char cls = t->cls[i];     // Class of the object
 
-    bsnm = p;
-    p += strlen(bs);
+    nLibObjs--;
 
-    n = 0;
-    while (n < 7) {
-        f[n] = p;
-        n++;
-        while (*p != 0)
-            p++;
-        p++;
-    }
-    while (*p != '\n' && *p != 0)
-        p++;
-    if (*p == '\n')
-        p++;
+    for (int k = 0; k < OBJ_NFIELDS; k++)
+        f[k] = obj_field(t, i, k);
+    bsnm = f[0];
+    f[0] += strlen(bs);
+    i++;
 
     if (closeddf)
         df = 0;
-    else if (f[1][0] == 'd')
+    else if (cls == 'd')
         df = OpenDF;
     else
         df = OpenLS;
 
     copy_str_to_ob(f[0], nm, 159);
 
-    if (f[1][0] == 'F')
+    if (cls == 'F')
         s = f[5];
     else
         s = f[6];
@@ -136,48 +132,38 @@ static const char *write_ob_line(const char *p, const char *bs,
     }
 
     if (!(bsnm[0] == '.' && allnames == 0))
-        fprintf(fl, "   %s%c#%s\t%s\n", prfx, f[1][0], nm, descr);
-
-    if (*p == 0)
-        return p;
+        fprintf(fl, "   %s%c#%s\t%s\n", prfx, cls, nm, descr);
 
-    if (f[1][0] == 'l' || f[1][0] == 'd' || f[1][0] == '4' || f[1][0] == '7' ||
-        f[1][0] == 'e') {
-        char base2[128];
+    if (cls == 'l' || cls == 'd' || cls == '4' || cls == '7' || cls == 'e') {
         char newprfx[96];
         int ne;
         s = f[6];
         s++;
         s++;
         s++; // Number of elements (list)
-        if (f[1][0] == 'd') {
+        if (cls == 'd') {
             while (*s && *s != ' ')
                 s++;
             s++; // Number of columns (data.frame)
         }
         ne = atoi(s);
-        if (f[1][0] == 'l' || f[1][0] == 'd' || f[1][0] == 'e') {
-            snprintf(base1, 127, "%s$", bsnm);  // Named list
-            snprintf(base2, 127, "%s[[", bsnm); // Unnamed list
-        } else {
+        if (cls == 'l' || cls == 'd' || cls == 'e')
+            snprintf(base1, 127, "%s$", bsnm); // Named list
+        else
             snprintf(base1, 127, "%s@", bsnm); // S4 object
-            snprintf(
-                base2, 127, "%s[[",
-                bsnm); // S4 object always have names but base2 must be defined
-        }
 
         if (get_list_status(bsnm, df) == 0) {
-            while (str_here(p, base1) || str_here(p, base2)) {
-                while (*p != '\n')
-                    p++;
-                p++;
-                nLibObjs--;
-            }
-            return p;
+            nLibObjs -= end - i;
+            return end;
         }
 
-        if (str_here(p, base1) == 0 && str_here(p, base2) == 0)
-            return p;
+        if (i == end) {
+            // In lazy mode, nvimcom lists the elements of open lists only
+            // after they are requested
+            if (lazy_list && ne > 0 && strcmp(f[3], ".GlobalEnv") == 0)
+                request_elements(bsnm);
+            return i;
+        }
 
         int len = strlen(prfx);
         if (nvimcom_is_utf8) {
@@ -213,37 +199,33 @@ static const char *write_ob_line(const char *p, const char *bs,
         }
 
         // Check if the next list element really is there
-        while (str_here(p, base1) || str_here(p, base2)) {
+        while (i < end) {
             // Check if this is the last element in the list
-            s = p;
-            while (*s != '\n')
-                s++;
-            s++;
             ne--;
             if (ne == 0) {
                 snprintf(prefix, 112, "%s%s", newprfx, strL);
             } else {
-                if (str_here(s, base1) || str_here(s, base2))
+                if (i + 1 < end)
                     snprintf(prefix, 112, "%s%s", newprfx, strT);
                 else
                     snprintf(prefix, 112, "%s%s", newprfx, strL);
             }
 
-            if (*p) {
-                if (str_here(p, base1))
-                    p = write_ob_line(p, base1, prefix, 0, fl);
-                else
-                    p = write_ob_line(p, bsnm, prefix, 0, fl);
-            }
+            if (str_here(obj_field(t, i, OBJ_NAME), base1))
+                i = write_ob_line(t, i, base1, prefix, 0, fl);
+            else
+                i = write_ob_line(t, i, bsnm, prefix, 0, fl);
         }
     }
-    return p;
+    return i;
 }
 
 void compl2ob(void) {
     Log("compl2ob()");
+    mutex_lock(&obbr_lock);
     FILE *f = fopen(globenv, "w");
     if (!f) {
+        mutex_unlock(&obbr_lock);
         fprintf(stderr, "Error opening \"%s\" for writing\n", globenv);
         fflush(stderr);
         return;
@@ -251,21 +233,30 @@ void compl2ob(void) {
 
     fprintf(f, ".GlobalEnv | Libraries\n\n");
 
-    if (glbnv_buffer) {
-        const char *s = glbnv_buffer;
-        while (*s)
-            s = write_ob_line(s, "", "", 0, f);
-    }
+    Snapshot *snap = snap_acquire();
+    uint32_t i = 0;
+    while (i < snap->glbnv->n)
+        i = write_ob_line(snap->glbnv, i, "", "", 0, f);
+    snap_release(snap);
 
     fclose(f);
+    mutex_unlock(&obbr_lock);
     if (auto_obbr)
         send_cmd_to_nvim("require('r.browser').update_OB('GlobalEnv')");
 }
 
+// Was lib2ob() called again? The list of libraries will be rewritten.
+static int lib2ob_outdated(unsigned gen) {
+    return __atomic_load_n(&lib2ob_gen, __ATOMIC_RELAXED) != gen;
+}
+
 void lib2ob(void) {
     Log("lib2ob()");
+    unsigned gen = __atomic_add_fetch(&lib2ob_gen, 1, __ATOMIC_RELAXED);
+    mutex_lock(&obbr_lock);
     FILE *f = fopen(liblist, "w");
     if (!f) {
+        mutex_unlock(&obbr_lock);
         fprintf(stderr, "Failed to open \"%s\"\n", liblist);
         fflush(stderr);
         return;
@@ -273,11 +264,11 @@ void lib2ob(void) {
     fprintf(f, "Libraries | .GlobalEnv\n\n");
 
     char lbnmc[512];
-    const char *p;
     char *pkg_descr;
 
-    LibList *lib = loaded_libs;
-    while (lib) {
+    Snapshot *snap = snap_acquire();
+    LibList *lib = snap->libs;
+    while (lib && !lib2ob_outdated(gen)) {
         if (lib->pkg->descr) {
             pkg_descr =
                 (char *)malloc(sizeof(char) * (strlen(lib->pkg->descr) + 1));
@@ -290,19 +281,28 @@ void lib2ob(void) {
         }
         snprintf(lbnmc, 511, "%s:", lib->pkg->name);
         int stt = get_list_status(lbnmc, 0);
-        if (lib->pkg->objls && lib->pkg->nobjs > 0 && stt == 1) {
-            p = lib->pkg->objls;
-            nLibObjs = lib->pkg->nobjs - 1;
-            while (*p) {
+        const ObjTable *t = &lib->pkg->objs;
+        if (t->n > 0 && stt == 1) {
+            uint32_t i = 0;
+            nLibObjs = t->n - 1;
+            while (i < t->n) {
+                if (!(i & 255) && lib2ob_outdated(gen))
+                    break;
                 if (nLibObjs == 0)
-                    p = write_ob_line(p, "", strL, 1, f);
+                    i = write_ob_line(t, i, "", strL, 1, f);
                 else
-                    p = write_ob_line(p, "", strT, 1, f);
+                    i = write_ob_line(t, i, "", strT, 1, f);
             }
         }
         lib = lib->next;
     }
+    snap_release(snap);
 
     fclose(f);
+    mutex_unlock(&obbr_lock);
+    if (lib2ob_outdated(gen)) {
+        Log("lib2ob: superseded");
+        return;
+    }
     send_cmd_to_nvim("require('r.browser').update_OB('libraries')");
 }
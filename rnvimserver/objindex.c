@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "objindex.h"
+#include "logging.h"
+#include "utilities.h"
+#include "../nvimcom/src/common.h"
+
+/*
+ * Completion index of a table of objects: the record numbers sorted by the
+ * nesting depth of the object name (number of '@', '$' and '[') and then by
+ * the name. The objects with the same depth of the word being completed are
+ * contiguous in the index and, among them, the objects whose names start
+ * with a given prefix are contiguous too. The index also has the set of
+ * characters of each name to quickly discard objects that cannot match a
+ * fuzzy pattern.
+ *
+ * The JSON completion item of each object is built when the table is loaded
+ * (see `obj_frags_build()`). It has everything but the sortText, which
+ * depends on the word being completed, and its layout is
+ *
+ *     name","label":"name","cls":"F","kind":3,"env":"pkg"},
+ *
+ * so that a response is just the concatenation of `{"sortText":"nnnn` and
+ * the fragments of the matching objects. When the label must have a "pkg::"
+ * prefix, the fragment is split after FRAG_LABEL.
+ */
+
+// The kind numbers are from vim.lsp.protocol.CompletionItemKind
+static const char *kind_tbl[16][2] = {
+    {"a", "6"},  //  function arg      Variable
+    {"c", "5"},  //  data.frame column Field
+    {"n", "12"}, //  numeric           Value
+    {"f", "5"},  //  factor            Field
+    {"t", "1"},  //  character         Text
+    {"F", "3"},  //  function          Function
+    {"d", "22"}, //  data.frame        Struct
+    {"l", "22"}, //  list              Struct
+    {"4", "7"},  //  S4                Class
+    {"7", "7"},  //  S7                Class
+    {"b", "2"},  //  logical           Method
+    {"L", "9"},  //  library           Module
+    {"C", "4"},  //  control           Constructor
+    {"e", "8"},  //  environment       Interface
+    {"p", "23"}, //  promise           Event
+    {"o", "25"}, //  other             TypeParameter
+};
+
+static const char *get_kind(const char *cls) {
+    for (size_t i = 0; i < 16; i++)
+        if (*kind_tbl[i][0] == *cls)
+            return kind_tbl[i][1];
+    Log("get_kind: %s", cls);
+    return kind_tbl[15][1];
+}
+
+typedef struct idx_item_ {
+    uint32_t key;
+    uint32_t rec;
+    const char *name;
+} IdxItem;
+
+/**
+ * @brief Get the nesting depth of an object name.
+ * @param s The name.
+ * @return The number of '@', '$' and '[' packed in a single integer.
+ */
+uint32_t depth_key(const char *s) {
+    uint32_t a = 0, d = 0, b = 0;
+    for (; *s; s++) {
+        if (*s == '@')
+            a++;
+        else if (*s == '$')
+            d++;
+        else if (*s == '[')
+            b++;
+    }
+    if (a > 1023)
+        a = 1023;
+    if (d > 1023)
+        d = 1023;
+    if (b > 1023)
+        b = 1023;
+    return (a << 20) | (d << 10) | b;
+}
+
+static int cmp_items(const void *x, const void *y) {
+    const IdxItem *a = x;
+    const IdxItem *b = y;
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    int c = strcmp(a->name, b->name);
+    if (c)
+        return c;
+    return a->rec < b->rec ? -1 : (a->rec > b->rec);
+}
+
+/**
+ * @brief Build the completion index of a table if it does not exist yet.
+ * @param t The table of objects.
+ */
+void obj_index_build(ObjTable *t) {
+    if (t->idx || t->n == 0)
+        return;
+    Log("obj_index_build: %u", t->n);
+
+    IdxItem *it = malloc(t->n * sizeof(IdxItem));
+    for (uint32_t i = 0; i < t->n; i++) {
+        it[i].name = obj_field(t, i, OBJ_NAME);
+        it[i].key = depth_key(it[i].name);
+        it[i].rec = i;
+    }
+    qsort(it, t->n, sizeof(IdxItem), cmp_items);
+
+    t->idx = malloc(t->n * sizeof(uint32_t));
+    t->mask = malloc(t->n * sizeof(uint64_t));
+    for (uint32_t i = 0; i < t->n; i++) {
+        t->idx[i] = it[i].rec;
+        t->mask[it[i].rec] = char_mask(it[i].name);
+    }
+    free(it);
+}
+
+/**
+ * @brief Release the completion index and items of a table.
+ * @param t The table of objects.
+ */
+void obj_index_free(ObjTable *t) {
+    free(t->idx);
+    free(t->mask);
+    free(t->frag);
+    free(t->frag_off);
+    t->idx = NULL;
+    t->mask = NULL;
+    t->frag = NULL;
+    t->frag_off = NULL;
+}
+
+// Compare a new record with the record at position `k` of the old index.
+// See obj_index_splice().
+static int cmp_old(const IdxItem *a, const ObjTable *old, uint32_t k,
+                   uint32_t skip) {
+    const char *nm = obj_field(old, old->idx[k], OBJ_NAME);
+    uint32_t key = depth_key(nm);
+    if (a->key != key)
+        return a->key < key ? -1 : 1;
+    int c = strcmp(a->name, nm);
+    if (c)
+        return c;
+    return old->idx[k] < skip ? 1 : -1;
+}
+
+/**
+ * @brief Build the completion index of a table that is a copy of `old` with
+ * the records from `skip` to `skip + del` replaced. The index of `old` is
+ * reused: only the new records are sorted and then merged into it.
+ *
+ * @param t The new table.
+ * @param old The old table. Its index must be already built.
+ * @param skip Number of records at the beginning of both tables.
+ * @param del Number of records of `old` that were replaced.
+ */
+void obj_index_splice(ObjTable *t, const ObjTable *old, uint32_t skip,
+                      uint32_t del) {
+    uint32_t oend = skip + del;
+    uint32_t m = t->n - (old->n - del); // Number of new records
+    uint32_t nend = skip + m;
+    if (!old->idx || t->n == 0) {
+        obj_index_build(t);
+        return;
+    }
+    Log("obj_index_splice: %u + %u - %u", old->n, m, del);
+
+    t->mask = malloc(t->n * sizeof(uint64_t));
+    memcpy(t->mask, old->mask, skip * sizeof(uint64_t));
+    memcpy(t->mask + nend, old->mask + oend,
+           (old->n - oend) * sizeof(uint64_t));
+
+    IdxItem *it = malloc((m ? m : 1) * sizeof(IdxItem));
+    for (uint32_t i = 0; i < m; i++) {
+        it[i].name = obj_field(t, skip + i, OBJ_NAME);
+        it[i].key = depth_key(it[i].name);
+        it[i].rec = skip + i;
+        t->mask[skip + i] = char_mask(it[i].name);
+    }
+    qsort(it, m, sizeof(IdxItem), cmp_items);
+
+    t->idx = malloc(t->n * sizeof(uint32_t));
+    uint32_t j = 0;
+    uint32_t out = 0;
+    uint32_t k = 0;
+    while (j < m) {
+        // Position of the next new record in the old index
+        uint32_t lo = k, hi = old->n;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (cmp_old(&it[j], old, mid, skip) > 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (; k < lo; k++) {
+            uint32_t r = old->idx[k];
+            if (r < skip)
+                t->idx[out++] = r;
+            else if (r >= oend)
+                t->idx[out++] = r - oend + nend;
+        }
+        t->idx[out++] = it[j++].rec;
+    }
+    for (; k < old->n; k++) {
+        uint32_t r = old->idx[k];
+        if (r < skip)
+            t->idx[out++] = r;
+        else if (r >= oend)
+            t->idx[out++] = r - oend + nend;
+    }
+    free(it);
+}
+
+// Size of the completion items of records `from` to `to`
+static size_t frags_size(const ObjTable *t, uint32_t from, uint32_t to,
+                         const char *env) {
+    size_t sz = 0;
+    size_t elen = strlen(env);
+    for (uint32_t i = from; i < to; i++)
+        sz += 2 * strlen(obj_field(t, i, OBJ_NAME)) +
+              strlen(obj_field(t, i, OBJ_CLS)) + elen + 64;
+    return sz;
+}
+
+// Write the completion items of records `from` to `to` at `p`
+static char *add_frags(ObjTable *t, uint32_t from, uint32_t to, char *p,
+                       const char *env) {
+    *p = '\0'; // str_cat() appends to a string
+    for (uint32_t i = from; i < to; i++) {
+        const char *nm = obj_field(t, i, OBJ_NAME);
+        const char *cls = obj_field(t, i, OBJ_CLS);
+        t->frag_off[i] = p - t->frag;
+        p = str_cat(p, nm);
+        p = str_cat(p, FRAG_LABEL);
+        p = str_cat(p, nm);
+        p = str_cat(p, "\",\"cls\":\"");
+        p = str_cat(p, cls);
+        p = str_cat(p, "\",\"kind\":");
+        p = str_cat(p, get_kind(cls));
+        p = str_cat(p, ",\"env\":\"");
+        p = str_cat(p, env);
+        p = str_cat(p, "\"},");
+    }
+    return p;
+}
+
+/**
+ * @brief Build the completion items of all objects of a table.
+ * @param t The table of objects.
+ * @param env The package or environment of the objects.
+ */
+void obj_frags_build(ObjTable *t, const char *env) {
+    free(t->frag);
+    free(t->frag_off);
+    t->frag = NULL;
+    t->frag_off = NULL;
+    if (t->n == 0)
+        return;
+
+    t->frag = malloc(frags_size(t, 0, t->n, env));
+    t->frag_off = malloc((t->n + 1) * sizeof(uint32_t));
+    char *p = add_frags(t, 0, t->n, t->frag, env);
+    t->frag_off[t->n] = p - t->frag;
+}
+
+/**
+ * @brief Build the completion items of a table that is a copy of `old` with
+ * some records replaced (see obj_index_splice()). Only the items of the new
+ * records are built; the others are copied from `old`.
+ */
+void obj_frags_splice(ObjTable *t, const ObjTable *old, uint32_t skip,
+                      uint32_t del, const char *env) {
+    uint32_t oend = skip + del;
+    uint32_t nend = t->n - (old->n - oend);
+    if (!old->frag || t->n == 0) {
+        obj_frags_build(t, env);
+        return;
+    }
+
+    size_t pre = old->frag_off[skip];
+    size_t suf = old->frag_off[old->n] - old->frag_off[oend];
+    t->frag = malloc(pre + frags_size(t, skip, nend, env) + suf + 1);
+    t->frag_off = malloc((t->n + 1) * sizeof(uint32_t));
+
+    memcpy(t->frag, old->frag, pre);
+    memcpy(t->frag_off, old->frag_off, skip * sizeof(uint32_t));
+    char *p = add_frags(t, skip, nend, t->frag + pre, env);
+
+    memcpy(p, old->frag + old->frag_off[oend], suf);
+    uint32_t shift = p - t->frag;
+    for (uint32_t i = oend; i <= old->n; i++)
+        t->frag_off[i - oend + nend] =
+            old->frag_off[i] - old->frag_off[oend] + shift;
+}
+
+// Compare the object at position `k` of the index with (key, prefix)
+static int cmp_pos(const ObjTable *t, uint32_t k, uint32_t key,
+                   const char *prefix, size_t len) {
+    const char *nm = obj_field(t, t->idx[k], OBJ_NAME);
+    uint32_t nk = depth_key(nm);
+    if (nk != key)
+        return nk < key ? -1 : 1;
+    return strncmp(nm, prefix, len);
+}
+
+/**
+ * @brief Find the objects with a given nesting depth whose names start with
+ * a prefix.
+ *
+ * @param t The table of objects. Its index must be already built.
+ * @param key The nesting depth (see `depth_key()`).
+ * @param prefix The prefix.
+ * @param from Where to store the first position in `t->idx`.
+ * @param to Where to store the position after the last one in `t->idx`.
+ */
+void obj_index_range(const ObjTable *t, uint32_t key, const char *prefix,
+                     uint32_t *from, uint32_t *to) {
+    size_t len = strlen(prefix);
+    uint32_t lo = 0, hi = t->idx ? t->n : 0;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cmp_pos(t, mid, key, prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *from = lo;
+    hi = t->idx ? t->n : 0;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cmp_pos(t, mid, key, prefix, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *to = lo;
+}
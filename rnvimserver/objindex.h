@@ -0,0 +1,20 @@
+#ifndef OBJINDEX_H
+#define OBJINDEX_H
+
+#include "data_structures.h"
+
+// Separator between the two copies of the name in a completion item
+#define FRAG_LABEL "\",\"label\":\""
+
+uint32_t depth_key(const char *s);
+void obj_index_build(ObjTable *t);
+void obj_index_free(ObjTable *t);
+void obj_frags_build(ObjTable *t, const char *env);
+void obj_index_splice(ObjTable *t, const ObjTable *old, uint32_t skip,
+                      uint32_t del);
+void obj_frags_splice(ObjTable *t, const ObjTable *old, uint32_t skip,
+                      uint32_t del, const char *env);
+void obj_index_range(const ObjTable *t, uint32_t key, const char *prefix,
+                     uint32_t *from, uint32_t *to);
+
+#endif
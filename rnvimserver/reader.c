@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reader.h"
+#include "logging.h"
+
+/*
+ * The messages are read with read() into a single buffer and returned as
+ * slices of it: several messages may arrive in a single read and a message is
+ * copied only if it is split at the end of the buffer (the unconsumed bytes
+ * are moved to the beginning before reading more). The buffer grows only
+ * when a message does not fit in it.
+ *
+ * `reader_next()` blocks until a message is complete. The event loop uses
+ * `reader_read()` when the descriptor is readable and then gets the complete
+ * messages with `reader_poll()`.
+ */
+
+/**
+ * @brief Initialize the reader.
+ * @param r The reader.
+ * @param fd The file descriptor to read from.
+ */
+void reader_init(MsgReader *r, int fd) {
+    r->fd = fd;
+    r->sz = 65536;
+    r->buf = malloc(r->sz + 1);
+    r->start = 0;
+    r->end = 0;
+    r->need = 0;
+    r->saved = 0;
+}
+
+/**
+ * @brief Read the available bytes (at least one), making room for the
+ * incomplete message found by the last call of `reader_poll()`.
+ * @param r The reader.
+ * @return 0 at the end of the input.
+ */
+int reader_read(MsgReader *r) {
+    if (r->start > 0 && r->start + r->need > r->sz) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (r->need > r->sz) {
+        r->sz = r->need + 65536;
+        r->buf = realloc(r->buf, r->sz + 1);
+    }
+    for (;;) {
+        ssize_t n = read(r->fd, r->buf + r->end, r->sz - r->end);
+        if (n > 0) {
+            r->end += n;
+            return 1;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (r->end > r->start) {
+            fprintf(stderr, "Incomplete message: %zu bytes\n",
+                    r->end - r->start);
+            fflush(stderr);
+        }
+        return 0;
+    }
+}
+
+// Find the blank line that ends the header. Return the offset of the content
+// or 0 if the header is not complete yet.
+static size_t header_end(const char *b, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+        if (b[i] != '\n')
+            continue;
+        if (i + 1 < to && b[i + 1] == '\n')
+            return i + 2;
+        if (i + 2 < to && b[i + 1] == '\r' && b[i + 2] == '\n')
+            return i + 3;
+    }
+    return 0;
+}
+
+// Get the value of the Content-Length field of the header
+static int content_length(const char *b, size_t from, size_t to,
+                          size_t *len) {
+    size_t i = from;
+    while (i < to) {
+        if (to - i > 15 && strncmp(b + i, "Content-Length:", 15) == 0) {
+            *len = strtoul(b + i + 15, NULL, 10);
+            return 1;
+        }
+        while (i < to && b[i] != '\n')
+            i++;
+        i++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the next message among the bytes already read.
+ * @param r The reader.
+ * @param len Set to the length of the message.
+ * @return The content of the message, terminated by '\0', or NULL if more
+ * bytes must be read. The content is valid until the next call and may be
+ * modified.
+ */
+char *reader_poll(MsgReader *r, size_t *len) {
+    if (r->saved) {
+        r->buf[r->start] = r->saved;
+        r->saved = 0;
+    }
+
+    size_t hlen;
+    size_t clen;
+    for (;;) {
+        size_t h = header_end(r->buf, r->start, r->end);
+        if (h == 0) {
+            r->need = r->end - r->start + 1024;
+            return NULL;
+        }
+        hlen = h - r->start;
+        if (content_length(r->buf, r->start, h, &clen))
+            break;
+        fprintf(stderr, "Malformed header: %.*s", (int)hlen,
+                r->buf + r->start);
+        fflush(stderr);
+        r->start = h;
+    }
+
+    if (r->end - r->start < hlen + clen) {
+        r->need = hlen + clen;
+        return NULL;
+    }
+
+    char *msg = r->buf + r->start + hlen;
+    r->start += hlen + clen;
+    // The next message (if any) begins right after this one
+    r->saved = r->buf[r->start];
+    r->buf[r->start] = '\0';
+    *len = clen;
+    return msg;
+}
+
+/**
+ * @brief Get the next message, reading as many bytes as needed.
+ * @param r The reader.
+ * @param len Set to the length of the message.
+ * @return The content of the message, terminated by '\0', or NULL at the
+ * end of the input. The content is valid until the next call and may be
+ * modified.
+ */
+char *reader_next(MsgReader *r, size_t *len) {
+    char *msg;
+    while (!(msg = reader_poll(r, len)))
+        if (!reader_read(r))
+            return NULL;
+    return msg;
+}
@@ -0,0 +1,22 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+
+// Reader of LSP messages ("Content-Length: N\r\n\r\n" + N bytes)
+typedef struct msg_reader_ {
+    int fd;       // File descriptor being read
+    char *buf;    // Bytes read and not consumed yet start at buf + start
+    size_t sz;    // Allocated size of buf (not counting the final '\0')
+    size_t start; // Beginning of the next message
+    size_t end;   // End of the bytes read
+    size_t need;  // Size of the incomplete message
+    char saved;   // Byte replaced by '\0' at the end of the last message
+} MsgReader;
+
+void reader_init(MsgReader *r, int fd);
+int reader_read(MsgReader *r);
+char *reader_poll(MsgReader *r, size_t *len);
+char *reader_next(MsgReader *r, size_t *len);
+
+#endif
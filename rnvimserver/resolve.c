@@ -8,14 +8,16 @@
 #include "lsp.h"
 #include "tcp.h"
 #include "utilities.h"
+#include "symbols.h"
+#include "snapshot.h"
+#include "workers.h"
 #include "../nvimcom/src/common.h"
 
-static char *res_buf;
-static size_t res_buf_sz = 4096;
+static StrBuf res_buf;
 
 static struct {
     char id[16];
-    char *item;
+    StrBuf item;
 } last_item;
 
 void send_item_doc(const char *req_id, const char *doc) {
@@ -24,46 +26,36 @@ void send_item_doc(const char *req_id, const char *doc) {
         return;
     }
 
-    const char *fmt =
-        "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{%s,\"documentation\":{"
-        "\"kind\":\"markdown\",\"value\":\"%s\"}}}";
-
-    char *fdoc = (char *)calloc(strlen(doc) + 1, sizeof(char));
-    format(doc, fdoc, ' ', '\x14');
-    char *edoc = esc_json(fdoc);
-    size_t len = strlen(edoc) + strlen(last_item.item) + 128;
-    char *res = (char *)malloc(len);
-
-    snprintf(res, len, fmt, req_id, last_item.item, edoc);
-
-    send_ls_response(req_id, res);
-
-    free(fdoc);
-    free(edoc);
-    free(res);
+    JsonWriter w;
+    jw_init(&w, strlen(doc) + last_item.item.len + 128);
+    jw_printf(&w, "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{", req_id);
+    jw_raw(&w, last_item.item.b, last_item.item.len);
+    jw_cat(&w, ",\"documentation\":{\"kind\":\"markdown\",\"value\":\"");
+    jw_doc(&w, doc);
+    jw_cat(&w, "\"}}}");
+    send_ls_json(req_id, &w);
 }
 
-static void get_alias(char **pkg, char **fun, char **args) {
+static void get_alias(const char **pkg, const char **fun,
+                      const char **args) {
     char s[64];
     snprintf(s, 63, "%s\n", *fun);
-    char *p;
-    char *f;
-    LibList *lib = inst_libs;
+    const char *p;
+    const char *f;
 
     Log("get_alias 1: %s, %s", *pkg, *fun);
-    while (lib && !str_here(lib->pkg->name, *pkg))
-        lib = lib->next;
-    if (lib && lib->pkg->alias) {
-        Log("get_alias 2: %s, %s, %s", *pkg, *fun, lib->pkg->name);
-        p = lib->pkg->alias;
+    PkgData *pd = get_pkg(*pkg);
+    if (pd && pd->alias) {
+        Log("get_alias 2: %s, %s, %s", *pkg, *fun, pd->name);
+        p = pd->alias;
         while (*p) {
             f = p;
             while (*f)
                 f++;
             f++;
             if (*f && str_here(f, s)) {
-                *args = lib->pkg->args;
-                *pkg = lib->pkg->name;
+                *args = pd->args;
+                *pkg = pd->name;
                 *fun = p;
                 return;
             }
@@ -79,24 +71,17 @@ static void get_alias(char **pkg, char **fun, char **args) {
 static void resolve_lib_name(const char *req_id, const char *lbl) {
     Log("resolve_lib_name: %s, %s", req_id, lbl);
 
-    LibList *lib = inst_libs;
-    while (lib) {
-        if (strcmp(lib->pkg->name, lbl) == 0) {
-            char *b =
-                (char *)malloc(sizeof(char) * (strlen(lib->pkg->title) +
-                                               strlen(lib->pkg->descr) + 32));
-            sprintf(b, "**%s**\x14\x14%s\x14", lib->pkg->title,
-                    lib->pkg->descr);
-            send_item_doc(req_id, b);
-            free(b);
-            break;
-        }
-        lib = lib->next;
+    const PkgData *pd = get_pkg(lbl);
+    if (pd && pd->title) {
+        char *b = arena_alloc(job_arena(),
+                              strlen(pd->title) + strlen(pd->descr) + 32);
+        sprintf(b, "**%s**\x14\x14%s\x14", pd->title, pd->descr);
+        send_item_doc(req_id, b);
     }
 }
 
-static void resolve_arg_item(const char *rid, const char *itm, char *pkg,
-                             char *fnm) {
+static void resolve_arg_item(const char *rid, const char *itm,
+                             const char *pkg, const char *fnm) {
 
     Log("resolve_arg_item: %s, %s, %s, %s", pkg, fnm, itm, rid);
     // Delete " = "
@@ -111,11 +96,11 @@ static void resolve_arg_item(const char *rid, const char *itm, char *pkg,
         a++;
     }
 
-    char *args;
+    const char *args;
     get_alias(&pkg, &fnm, &args);
-    if (!pkg)
+    if (!pkg || !args)
         return;
-    char *s = args;
+    const char *s = args;
     while (*s) {
         if (strcmp(s, fnm) == 0) {
             while (*s)
@@ -134,11 +119,10 @@ static void resolve_arg_item(const char *rid, const char *itm, char *pkg,
                                     while (*s && *s != '\005')
                                         s++;
                                     s++;
-                                    char *b =
-                                        calloc(strlen(s) + 2, sizeof(char));
+                                    char *b = arena_alloc(job_arena(),
+                                                          strlen(s) + 2);
                                     format(s, b, ' ', '\x14');
                                     send_item_doc(rid, b);
-                                    free(b);
                                     return;
                                 }
                             }
@@ -162,113 +146,85 @@ static void resolve_arg_item(const char *rid, const char *itm, char *pkg,
  * description to be displayed in the float window
  * @param args: List of arguments
  * */
-static void resolve(const char *rid, const char *wrd, const char *pkg) {
+static void resolve(const Snapshot *snap, const char *rid, const char *wrd,
+                    const char *pkg) {
     Log("resolve: %s, %s, %s", wrd, pkg, rid);
+    const char *f[OBJ_NFIELDS];
+    const ObjTable *t;
     int i;
-    size_t nsz;
-    const char *f[7];
-    char *s;
 
     if (strcmp(pkg, ".GlobalEnv") == 0) {
-        s = glbnv_buffer;
+        t = snap->glbnv;
+        i = seek_obj(t, wrd);
     } else {
-        LibList *lib;
+        const PkgData *pd = NULL;
         if (strstr(wrd, "::")) {
-            lib = inst_libs;
             wrd = strstr(wrd, "::") + 2;
+            pd = get_pkg(pkg);
         } else {
-            lib = loaded_libs;
-        }
-        while (lib) {
-            if (strcmp(pkg, lib->pkg->name) == 0)
-                break;
-            else
+            LibList *lib = snap->libs;
+            while (lib && strcmp(pkg, lib->pkg->name) != 0)
                 lib = lib->next;
+            if (lib)
+                pd = lib->pkg;
         }
 
-        if (!lib)
+        if (!pd)
             return;
 
-        s = lib->pkg->objls;
+        t = &pd->objs;
+        i = sym_find_in(pd, wrd);
     }
 
-    memset(res_buf, 0, res_buf_sz);
-    char *p = res_buf;
-
-    while (*s != 0) {
-        if (strcmp(s, wrd) == 0) {
-            i = 0;
-            while (i < 7) {
-                f[i] = s;
-                i++;
-                while (*s != 0)
-                    s++;
-                s++;
-            }
-            while (*s != '\n' && *s != 0)
-                s++;
-            if (*s == '\n')
-                s++;
-
-            if (f[1][0] == 'F' && str_here(f[4], ">not_checked<")) {
-                snprintf(res_buf, 1024,
-                         "nvimcom:::resolve_fun_args('%s', '%s')", rid, wrd);
-                nvimcom_eval(res_buf);
-                return;
-            }
-
-            // Avoid buffer overflow if the information is bigger than
-            // res_buf.
-            nsz = strlen(f[4]) + strlen(f[5]) + strlen(f[6]) + 1024 +
-                  (p - res_buf);
-            if (res_buf_sz < nsz)
-                p = grow_buffer(&res_buf, &res_buf_sz,
-                                nsz - res_buf_sz + 32768);
+    if (i < 0)
+        return;
+    for (int k = 0; k < OBJ_NFIELDS; k++)
+        f[k] = obj_field(t, i, k);
+
+    if (f[1][0] == 'F' && str_here(f[4], ">not_checked<")) {
+        char cmd[1024];
+        snprintf(cmd, sizeof(cmd), "nvimcom:::resolve_fun_args('%s', '%s')",
+                 rid, wrd);
+        nvimcom_eval(cmd);
+        return;
+    }
 
-            size_t sz = strlen(f[5]) + strlen(f[6]) + 16;
-            char *buffer = malloc(sz);
-            p = str_cat(p, f[2]);
-            p = str_cat(p, " `");
-            p = str_cat(p, f[3]);
-            p = str_cat(p, "::");
-            p = str_cat(p, f[0]);
-            p = str_cat(p, "`\x14");
-            if (f[5][0]) {
-                p = str_cat(p, "\x14**");
-                format(f[5], buffer, ' ', '\x14');
-                p = str_cat(p, buffer);
-                p = str_cat(p, "**\x14\x14");
-                format(f[6], buffer, ' ', '\x14');
-                p = str_cat(p, buffer);
-            }
-            free(buffer);
-            if (f[1][0] == 'F') {
-                char *b = format_usage(f[0], f[4], 1);
-                str_cat(p, b);
-                free(b);
-            }
-            send_item_doc(rid, res_buf);
-            return;
-        }
-        while (*s != '\n')
-            s++;
-        s++;
+    sb_reset(&res_buf);
+    sb_cat(&res_buf, f[2]);
+    sb_cat(&res_buf, " `");
+    sb_cat(&res_buf, f[3]);
+    sb_cat(&res_buf, "::");
+    sb_cat(&res_buf, f[0]);
+    sb_cat(&res_buf, "`\x14");
+    if (f[5][0]) {
+        size_t sz = strlen(f[5]) + strlen(f[6]) + 16;
+        char *buffer = arena_alloc(job_arena(), sz);
+        sb_cat(&res_buf, "\x14**");
+        format(f[5], buffer, ' ', '\x14');
+        sb_cat(&res_buf, buffer);
+        sb_cat(&res_buf, "**\x14\x14");
+        format(f[6], buffer, ' ', '\x14');
+        sb_cat(&res_buf, buffer);
     }
+    if (f[1][0] == 'F') {
+        char *b = format_usage(f[0], f[4], 1);
+        sb_cat(&res_buf, b);
+        free(b);
+    }
+    send_item_doc(rid, res_buf.b);
 }
 
-void handle_resolve(const char *req_id, char *params) {
-    Log("handle_resolve: %s\n%s", req_id, params);
-
+static void resolve_item(const Snapshot *snap, const char *req_id,
+                         char *params) {
     const char *doc = strstr(params, "\"documentation\":{");
     if (doc) {
-        cut_json_bkt(&params, 9);
         Log("%s", params);
-        const char *fmt = "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":%s}";
-        size_t len = sizeof(char) * (strlen(params) + 64);
-        char *res = (char *)malloc(len);
-        snprintf(res, len - 1, fmt, req_id, params);
-        send_ls_response(req_id, res);
-        free(res);
+        JsonWriter w;
+        jw_init(&w, strlen(params) + 64);
+        jw_printf(&w, "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":", req_id);
+        jw_cat(&w, params);
+        jw_cat(&w, "}");
+        send_ls_json(req_id, &w);
         return;
     }
 
@@ -278,28 +234,18 @@ void handle_resolve(const char *req_id, char *params) {
         return;
     }
 
-    char *item = strstr(params, "\"params\":{");
     char *env = strstr(params, "\"env\":\"");
     char *lbl = strstr(params, "\"label\":\"");
 
-    cut_json_bkt(&item, 9);
-    if (last_item.item)
-        free(last_item.item);
+    // Keep the members of the item, without the brackets
     strncpy(last_item.id, req_id, 15);
-    last_item.item = (char *)malloc(1 + strlen(item) * sizeof(char));
-    item++;                        // skip the opening bracket
-    item[strlen(item) - 1] = '\0'; // delete the closing bracket
-    strcpy(last_item.item, item);
+    sb_reset(&last_item.item);
+    sb_add(&last_item.item, params + 1, strlen(params) - 2);
 
     cut_json_str(&env, 7);
     cut_json_str(&lbl, 9);
     cut_json_str(&cls, 7);
 
-    if (!res_buf) {
-        res_buf = (char *)malloc(res_buf_sz);
-    }
-    memset(res_buf, 0, res_buf_sz);
-
     if (env && strcmp(env, ".GlobalEnv") == 0) {
         if (*cls == 'a') {
             return;
@@ -310,7 +256,7 @@ void handle_resolve(const char *req_id, char *params) {
             nvimcom_eval(buffer);
 
         } else if (*cls == 'F') {
-            resolve(req_id, lbl, env);
+            resolve(snap, req_id, lbl, env);
             // char buffer[512];
             // sprintf(buffer, "nvimcom:::resolve_fun_args('%s', '%s')", req_id,
             //         lbl);
@@ -346,6 +292,13 @@ void handle_resolve(const char *req_id, char *params) {
                 lbl, env);
         nvimcom_eval(buffer);
     } else {
-        resolve(req_id, lbl, env);
+        resolve(snap, req_id, lbl, env);
     }
 }
+
+void handle_resolve(const char *req_id, char *params) {
+    Log("handle_resolve: %s\n%s", req_id, params);
+    Snapshot *snap = snap_acquire();
+    resolve_item(snap, req_id, params);
+    snap_release(snap);
+}
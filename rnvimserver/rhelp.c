@@ -6,6 +6,7 @@
 #include "lsp.h"
 #include "../nvimcom/src/common.h"
 #include "utilities.h"
+#include "buffers.h"
 
 // clang-format off
 static const char *rhelp_keywords[] = {
@@ -31,8 +32,7 @@ static const char *rhelp_keywords[] = {
 };
 // clang-format on
 
-static char *rhelp_menu;
-static size_t nchars = 0;
+static StrBuf rhelp_menu;
 
 void complete_rhelp(const char *params) {
     char *id = strstr(params, "\"orig_id\":");
@@ -42,27 +42,15 @@ void complete_rhelp(const char *params) {
 
     Log("complete_rhelp: %s, '%s'", id, base);
 
-    const char **s;
-
-    if (!rhelp_menu) {
-        s = rhelp_keywords;
-        while (*s != NULL) {
-            nchars += strlen(*s) + 32;
-            s++;
-        }
-        rhelp_menu = (char *)calloc(nchars, sizeof(char));
-    }
-
-    memset(rhelp_menu, 0, nchars * sizeof(char));
-    char *p = rhelp_menu;
-    s = rhelp_keywords;
+    sb_reset(&rhelp_menu);
+    const char **s = rhelp_keywords;
     while (*s != NULL) {
         if (!base || fuzzy_find(*s, base)) {
-            p = str_cat(p, "{\"label\":\"\\\\");
-            p = str_cat(p, *s);
-            p = str_cat(p, "\",\"kind\":14},");
+            sb_cat(&rhelp_menu, "{\"label\":\"\\\\");
+            sb_cat(&rhelp_menu, *s);
+            sb_cat(&rhelp_menu, "\",\"kind\":14},");
         }
         s++;
     }
-    send_menu_items(rhelp_menu, id);
+    send_menu_items(rhelp_menu.b, id);
 }
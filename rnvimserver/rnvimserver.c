@@ -3,6 +3,8 @@
 #include <stdlib.h> // Standard library
 #include <string.h> // String handling functions
 #include <unistd.h> // For read/write in a more robust server environment
+#include <errno.h>
+#include <limits.h>
 
 #include "data_structures.h"
 #include "logging.h"
@@ -18,12 +20,21 @@
 #include "rhelp.h"
 #include "roxygen.h"
 #include "chunk.h"
+#include "threads.h"
+#include "workers.h"
+#include "reader.h"
 #include "../nvimcom/src/common.h"
 
 #ifdef WIN32
 // Include for _setmode and _O_BINARY
 #include <fcntl.h>
 #include <io.h>
+#else
+#include <poll.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024 // As on Linux, macOS and BSD
 #endif
 
 /*
@@ -31,11 +42,10 @@
  */
 
 LibList *inst_libs;   // Pointer to first package data
-LibList *loaded_libs; // Pointer to loaded library
-char *glbnv_buffer;   // Global environment buffer
 char tmpdir[256];     // Temporary directory
 int auto_obbr;        // Auto object browser flag
 int r_running;        // Indicates whether R is running
+int lazy_list;        // Does nvimcom list elements of lists on demand?
 
 typedef struct active_request_ {
     char id[16];
@@ -43,12 +53,16 @@ typedef struct active_request_ {
 } ActiveRequest;
 
 static ActiveRequest *actv_req;
+static Mutex req_lock = MUTEX_INIT; // Protects actv_req
+static Mutex out_lock = MUTEX_INIT; // Serializes the writes to stdout
 
 static void add_active_request(const char *id) {
     ActiveRequest *ar = calloc(1, sizeof(ActiveRequest));
-    strncpy(ar->id, id, 15);
+    snprintf(ar->id, sizeof(ar->id), "%s", id);
+    mutex_lock(&req_lock);
     ar->next = actv_req;
     actv_req = ar;
+    mutex_unlock(&req_lock);
 }
 
 static void rm_active_request(const char *id) {
@@ -91,6 +105,53 @@ void print_listTree(ListStatus *root, FILE *f) {
 
 // --- LSP Communication Helper ---
 
+// Check whether the response to a request is still expected and, if so,
+// remove the request from the list of active ones.
+static int claim_request(const char *req_id) {
+    if (!req_id)
+        return 1;
+    mutex_lock(&req_lock);
+    int active = is_request_active(req_id);
+    if (active)
+        rm_active_request(req_id);
+    mutex_unlock(&req_lock);
+    return active;
+}
+
+// Write a whole message to stdout. All messages are written by this function
+// while holding out_lock, so that they are never interleaved, and each one is
+// written with a single system call (unless stdout is full). The array `v` is
+// modified while being written.
+static void write_msg(struct iovec *v, size_t n) {
+#ifdef WIN32
+    for (size_t i = 0; i < n; i++)
+        fwrite(v[i].iov_base, 1, v[i].iov_len, stdout);
+    fflush(stdout);
+#else
+    while (n > 0) {
+        int cnt = n > IOV_MAX ? IOV_MAX : (int)n;
+        ssize_t w = writev(STDOUT_FILENO, v, cnt);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "writev failed: %s\n", strerror(errno));
+            fflush(stderr);
+            break;
+        }
+        // Skip what was written
+        while (n > 0 && (size_t)w >= v->iov_len) {
+            w -= v->iov_len;
+            v++;
+            n--;
+        }
+        if (w > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+#endif
+}
+
 /**
  * @brief Sends a JSON response with the necessary LSP headers (Content-Length
  * and Content-Type).
@@ -110,18 +171,42 @@ void send_ls_response(const char *req_id, const char *json_payload) {
         Log("%s\n", json_payload);
     }
 #endif
-    if (req_id) {
-        int is_active = is_request_active(req_id);
-        if (is_active) {
-            rm_active_request(req_id);
-        } else {
-            return;
-        }
-    }
+    if (!claim_request(req_id))
+        return;
 
-    fprintf(stdout, "Content-Length: %zu\r\n\r\n", strlen(json_payload));
-    fprintf(stdout, "%s", json_payload);
-    fflush(stdout);
+    char head[64];
+    size_t len = strlen(json_payload);
+    struct iovec v[2];
+    v[0].iov_base = head;
+    v[0].iov_len = snprintf(head, 63, "Content-Length: %zu\r\n\r\n", len);
+    v[1].iov_base = (void *)json_payload;
+    v[1].iov_len = len;
+    mutex_lock(&out_lock);
+    write_msg(v, 2);
+    mutex_unlock(&out_lock);
+}
+
+/**
+ * @brief Send the message built by a writer, with its Content-Length header
+ * written in the room left at the start of the buffer, and free the buffer.
+ */
+void send_ls_json(const char *req_id, JsonWriter *w) {
+    size_t len = w->len - JSON_HEAD;
+    Log("\x1b[33mSEND_LS_JSON\x1b[0m (%zu bytes)", len);
+    if (claim_request(req_id)) {
+        char head[JSON_HEAD + 1];
+        int hlen = snprintf(head, sizeof(head), "Content-Length: %zu\r\n\r\n",
+                            len);
+        struct iovec v;
+        v.iov_base = w->b + JSON_HEAD - hlen;
+        v.iov_len = hlen + len;
+        memcpy(v.iov_base, head, hlen);
+        mutex_lock(&out_lock);
+        write_msg(&v, 1);
+        mutex_unlock(&out_lock);
+    }
+    free(w->b);
+    w->b = NULL;
 }
 
 void send_null(const char *req_id) {
@@ -166,24 +251,88 @@ void send_cmd_to_nvim(const char *cmd) {
     free(esccmd);
 }
 
-void send_menu_items(char *compl_items, const char *req_id) {
+/**
+ * @brief Send a list of completion items scattered in memory with a single
+ * system call.
+ *
+ * @param req_id The request ID.
+ * @param v The items, each one followed by a comma. The first and the last
+ * elements are reserved for the envelope of the message and are overwritten.
+ * The array is modified while being written.
+ * @param n Number of elements of `v`, including the reserved ones.
+ * @param incomplete Whether the client should ask for a new list as the user
+ * types.
+ */
+void send_completion_iov(const char *req_id, struct iovec *v, size_t n,
+                         int incomplete) {
+    // Remove the superfluous comma after the last item
+    size_t last = n - 2;
+    while (last > 0 && v[last].iov_len == 0)
+        last--;
+    if (last == 0) {
+        if (incomplete) {
+            char res[128];
+            snprintf(res, 127,
+                     "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":"
+                     "{\"isIncomplete\":true,\"items\":[]}}",
+                     req_id);
+            send_ls_response(req_id, res);
+        } else {
+            send_empty(req_id);
+        }
+        return;
+    }
+    if (((char *)v[last].iov_base)[v[last].iov_len - 1] == ',')
+        v[last].iov_len--;
+
+    size_t len = 0;
+    for (size_t i = 1; i < n - 1; i++)
+        len += v[i].iov_len;
+
+    char pre[128];
+    char head[160];
+    char tail[] = "]}}";
+    int plen = snprintf(pre, 127,
+                        "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{"
+                        "\"isIncomplete\":%s,\"items\":[",
+                        req_id, incomplete ? "true" : "false");
+    len += plen + 3;
+    int hlen = snprintf(head, 159, "Content-Length: %zu\r\n\r\n%s", len, pre);
+    v[0].iov_base = head;
+    v[0].iov_len = hlen;
+    v[n - 1].iov_base = tail;
+    v[n - 1].iov_len = 3;
+
+    Log("\x1b[33mSEND_COMPLETION_IOV\x1b[0m (%zu bytes, %zu pieces)", len, n);
+    if (!claim_request(req_id))
+        return;
+
+    mutex_lock(&out_lock);
+    write_msg(v, n);
+    mutex_unlock(&out_lock);
+}
+
+void send_menu_items(const char *compl_items, const char *req_id) {
     if (strlen(compl_items) == 0) {
         send_empty(req_id);
         return;
     }
-    const char *fmt = "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{"
-                      "\"isIncomplete\":false,\"items\":[%s]}}";
 
     size_t len = strlen(compl_items);
 
     // remove last superfluous comma to avoid json error:
-    if (len > 3 && compl_items[len - 1] == ',') {
-        compl_items[len - 1] = '\0';
-    }
-    char *res = (char *)malloc(sizeof(char) * len + 128);
-    sprintf(res, fmt, req_id, compl_items);
-    send_ls_response(req_id, res);
-    free(res);
+    if (len > 3 && compl_items[len - 1] == ',')
+        len--;
+
+    JsonWriter w;
+    jw_init(&w, len + 128);
+    jw_printf(&w,
+              "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{"
+              "\"isIncomplete\":false,\"items\":[",
+              req_id);
+    jw_raw(&w, compl_items, len);
+    jw_cat(&w, "]}}");
+    send_ls_json(req_id, &w);
 }
 
 // Signal handler for SIGTERM
@@ -203,11 +352,13 @@ static void handle_initialize(const char *request_id) {
     strncpy(tmpdir, getenv("RNVIM_TMPDIR"), 255);
     set_doc_width(getenv("R_LS_DOC_WIDTH"));
     set_max_depth(atoi(getenv("RNVIM_MAX_DEPTH")));
+    lazy_list = getenv("RNVIM_LAZY_LIST") != NULL;
 
     init_cmp();
     init_obbr_vars();
     init_ds_vars();
     init_lib_list();
+    start_workers();
 
     char res[1024] = {0};
     char *p = res;
@@ -287,19 +438,35 @@ static void handle_initialize(const char *request_id) {
 }
 
 // Forward declarations
-static void send_location_result(const char *params);
-static void send_definition_result(const char *params);
-static void send_document_symbols_result(const char *params);
-static void send_workspace_symbols_result(const char *params);
-static void send_references_result(const char *params);
-static void send_implementation_result(const char *params);
-static void send_document_highlight_result(const char *params);
-static void send_rename_result(const char *params);
-
-static void handle_exe_cmd(const char *params) {
+static void send_location_result(JsonTape *t, int params);
+static void send_definition_result(JsonTape *t, int params);
+static void send_document_symbols_result(JsonTape *t, int params);
+static void send_workspace_symbols_result(JsonTape *t, int params);
+static void send_references_result(JsonTape *t, int params);
+static void send_implementation_result(JsonTape *t, int params);
+static void send_document_highlight_result(JsonTape *t, int params);
+static void send_rename_result(JsonTape *t, int params);
+
+// Wrappers to run the handlers in the worker threads
+static void complete_job(const char *id, char *params) { complete(params); }
+static void hover_job(const char *id, char *params) { hover(params); }
+static void signature_job(const char *id, char *params) { signature(params); }
+static void definition_job(const char *id, char *params) { definition(params); }
+
+static void handle_exe_cmd(JsonTape *t, int prms) {
+    int c = json_get(t, prms, "code");
+    if (c < 0 || t->tok[c].type != JSON_STR) {
+        fprintf(stderr, "Error in exeRnvimCmd: missing `code` field\n");
+        fflush(stderr);
+        return;
+    }
+    char id[16];
+    json_copy(t, json_get(t, prms, "orig_id"), id, sizeof(id));
+    // The text of params is terminated after the object, and the values
+    // inside it may be terminated only by the branches that do not use it.
+    char *params = json_raw(t, prms);
     Log("handle_exe_cmd: %s\n", params);
-    char *code = strstr(params, "\"code\":\"") + 8;
-    char *p;
+    char *code = t->s + t->tok[c].start;
     switch (*code) {
     case 'C':
         code++;
@@ -314,49 +481,46 @@ static void handle_exe_cmd(const char *params) {
         }
         break;
     case 'H':
-        hover(params);
+        run_job(JOB_HOVER, hover_job, id, params);
         break;
     case 'G':
-        definition(params);
+        run_job(JOB_DEFINITION, definition_job, id, params);
         break;
     case 'S':
-        signature(params);
+        run_job(JOB_SIGNATURE, signature_job, id, params);
         break;
     case 'E':
-        cut_json_str(&code, 1);
-        send_empty(code);
+        send_empty(json_str(t, c) + 1);
         break;
     case 'N':
-        cut_json_str(&code, 1);
-        send_null(code);
+        send_null(json_str(t, c) + 1);
         break;
     case 'D': // Definition result from Lua
-        send_definition_result(params);
+        send_definition_result(t, prms);
         break;
     case 'Y': // Document symbols result from Lua
-        send_document_symbols_result(params);
+        send_document_symbols_result(t, prms);
         break;
     case 'W': // Workspace symbols result from Lua
-        send_workspace_symbols_result(params);
+        send_workspace_symbols_result(t, prms);
         break;
     case 'R': // References result from Lua
-        send_references_result(params);
+        send_references_result(t, prms);
         break;
     case 'I': // Implementation result from Lua
-        send_implementation_result(params);
+        send_implementation_result(t, prms);
         break;
     case 'L': // Document highlight result from Lua
-        send_document_highlight_result(params);
+        send_document_highlight_result(t, prms);
         break;
     case 'X': // Rename result from Lua
-        send_rename_result(params);
+        send_rename_result(t, prms);
         break;
     case '1': // Start TCP server and wait nvimcom connection
         start_server();
         break;
     case '2': // Send message
-        cut_json_str(&code, 1);
-        send_to_nvimcom(code);
+        send_to_nvimcom(json_str(t, c) + 1);
         break;
     case '3':
         code++;
@@ -370,9 +534,7 @@ static void handle_exe_cmd(const char *params) {
             lib2ob();
             break;
         case '3': // Open/Close list
-            p = strstr(params, "\"key\":\"");
-            cut_json_str(&p, 7);
-            toggle_list_status(p);
+            toggle_list_status(json_str(t, json_get(t, prms, "key")));
             code++;
             if (*code == 'G')
                 compl2ob();
@@ -407,7 +569,7 @@ static void handle_exe_cmd(const char *params) {
         }
         break;
     case '5':
-        complete(params);
+        run_job(JOB_COMPLETE, complete_job, id, params);
         break;
     case '9': // R no longer running
         update_glblenv_buffer("");
@@ -416,7 +578,7 @@ static void handle_exe_cmd(const char *params) {
         r_running = 0;
         break;
     default:
-        fprintf(stderr, "Unknown command received: %s\n", code);
+        fprintf(stderr, "Unknown command received: %s\n", json_str(t, c));
         fflush(stderr);
         break;
     }
@@ -427,21 +589,31 @@ static void handle_exe_cmd(const char *params) {
  */
 static void handle_exit(const char *method) {
     Log("Received \"%s\" notification. Shutting down.\n", method);
+    stop_server();
     exit(0);
 }
 
-static void handle_completion(const char *id, const char *params) {
-    char *position = strstr(params, "\"position\":{") + 11;
-    if (!position) {
+/* Get the line and the character of the "position" field of LSP params,
+ * terminated in place. Return 0 if they are missing. */
+static int get_position(JsonTape *t, int params, char **line, char **col) {
+    int pos = json_get(t, params, "position");
+    int l = json_get(t, pos, "line");
+    int c = json_get(t, pos, "character");
+    if (l < 0 || c < 0)
+        return 0;
+    *line = json_str(t, l);
+    *col = json_str(t, c);
+    return 1;
+}
+
+static void handle_completion(const char *id, JsonTape *t, int params) {
+    char *line, *col;
+    if (!get_position(t, params, &line, &col)) {
         fprintf(stderr, "Error in textDocument/completion: missing "
                         "`position` field\n");
         fflush(stderr);
         return;
     }
-    char *line = strstr(position, "\"line\":");
-    char *col = strstr(position, "\"character\":");
-    cut_json_int(&line, 7);
-    cut_json_int(&col, 12);
     char compl_command[128];
     snprintf(compl_command, 127, "require('r.lsp').complete(%s, %s, %s)", id,
              line, col);
@@ -460,46 +632,29 @@ static void handle_signature(const char *id) {
     send_cmd_to_nvim(h_cmd);
 }
 
-/* Extract the textDocument URI from LSP params into buf (null-terminated).
+/* Copy the textDocument URI from LSP params into buf (null-terminated).
  * URI chars are all percent-encoded so no single quotes can appear — safe
  * to embed directly in a single-quoted Lua string literal. */
-static void extract_doc_uri(const char *params, char *buf, int buf_size) {
-    buf[0] = '\0';
-    char *p = strstr(params, "\"uri\":\"");
-    if (!p)
-        return;
-    p += 7;
-    char *end = strchr(p, '"');
-    if (!end)
-        return;
-    int len = (int)(end - p);
-    if (len >= buf_size)
-        len = buf_size - 1;
-    strncpy(buf, p, len);
-    buf[len] = '\0';
+static void extract_doc_uri(const JsonTape *t, int params, char *buf,
+                            int buf_size) {
+    int doc = json_get(t, params, "textDocument");
+    json_copy(t, json_get(t, doc, "uri"), buf, buf_size);
 }
 
 /* Shared handler for LSP requests that carry a textDocument position.
  * Extracts line/character and URI from params, then calls the named
  * Lua function as: require('r.lsp').<lua_fn>(id, line, col, bufnr) */
-static void handle_location_request(const char *id, const char *params,
+static void handle_location_request(const char *id, JsonTape *t, int params,
                                     const char *lua_fn) {
-    char *position = strstr(params, "\"position\":{");
-    if (!position) {
+    char *line, *col;
+    if (!get_position(t, params, &line, &col)) {
         fprintf(stderr, "Error in textDocument/%s: missing `position` field\n",
                 lua_fn);
         fflush(stderr);
         return;
     }
-    position += 11;
-    char *line = strstr(position, "\"line\":");
-    char *col = strstr(position, "\"character\":");
-    // Extract URI BEFORE cut_json_int calls, which insert \0 bytes that can
-    // truncate the buffer and hide fields that appear later in the JSON.
     char uri[2048];
-    extract_doc_uri(params, uri, sizeof(uri));
-    cut_json_int(&line, 7);
-    cut_json_int(&col, 12);
+    extract_doc_uri(t, params, uri, sizeof(uri));
     char cmd[4096];
     snprintf(cmd, sizeof(cmd) - 1,
              "require('r.lsp').%s(%s, %s, %s, vim.uri_to_bufnr('%s'))", lua_fn,
@@ -507,8 +662,8 @@ static void handle_location_request(const char *id, const char *params,
     send_cmd_to_nvim(cmd);
 }
 
-static void handle_definition(const char *id, const char *params) {
-    handle_location_request(id, params, "definition");
+static void handle_definition(const char *id, JsonTape *t, int params) {
+    handle_location_request(id, t, params, "definition");
 }
 
 static void handle_document_symbols(const char *id) {
@@ -517,86 +672,70 @@ static void handle_document_symbols(const char *id) {
     send_cmd_to_nvim(s_cmd);
 }
 
-static void handle_references(const char *id, const char *params) {
-    handle_location_request(id, params, "references");
+static void handle_references(const char *id, JsonTape *t, int params) {
+    handle_location_request(id, t, params, "references");
 }
 
-static void handle_implementation(const char *id, const char *params) {
-    handle_location_request(id, params, "implementation");
+static void handle_implementation(const char *id, JsonTape *t, int params) {
+    handle_location_request(id, t, params, "implementation");
 }
 
-static void handle_document_highlight(const char *id, const char *params) {
-    handle_location_request(id, params, "document_highlight");
+static void handle_document_highlight(const char *id, JsonTape *t,
+                                      int params) {
+    handle_location_request(id, t, params, "document_highlight");
 }
 
-static void send_rename_result(const char *params) {
-    /* Extract orig_id without mutating params so the subsequent strstr for
-     * "changes" is not affected by cut_json_int's null-termination. */
-    char id_str[16] = "";
-    char *id_ptr = strstr(params, "\"orig_id\":");
-    if (!id_ptr)
-        return;
-    snprintf(id_str, sizeof(id_str) - 1, "%ld", strtol(id_ptr + 10, NULL, 10));
+/* Send the result of a request whose JSON value was built by Lua and is
+ * copied as is. Return 0 if the value is not of the expected type. */
+static int send_lua_result(const char *id, const JsonTape *t, int v,
+                           int type) {
+    if (v < 0 || t->tok[v].type != type)
+        return 0;
+    const JsonTok *k = &t->tok[v];
+    size_t len = k->end - k->start;
+    size_t result_size = len + 256;
+    char *result = (char *)malloc(result_size);
+    snprintf(result, result_size,
+             "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":%.*s}", id, (int)len,
+             t->s + k->start);
+    send_ls_response(id, result);
+    free(result);
+    return 1;
+}
 
-    char *changes_start = strstr(params, "\"changes\":{");
-    if (!changes_start) {
-        send_null(id_str);
+static void send_rename_result(JsonTape *t, int params) {
+    char id[16];
+    int i = json_get(t, params, "orig_id");
+    if (i < 0)
         return;
-    }
-    changes_start += 10; /* points to '{' */
-
-    /* Walk forward counting braces to find the matching '}'. */
-    int depth = 0;
-    char *p = changes_start;
-    while (*p) {
-        if (*p == '{')
-            depth++;
-        else if (*p == '}') {
-            if (--depth == 0)
-                break;
-        }
-        p++;
-    }
-    if (depth != 0 || !*p) {
-        send_null(id_str);
+    json_copy(t, i, id, sizeof(id));
+    int changes = json_get(t, params, "changes");
+    if (changes < 0 || t->tok[changes].type != JSON_OBJ) {
+        send_null(id);
         return;
     }
-
-    size_t changes_len = (size_t)(p - changes_start) + 1;
+    const JsonTok *k = &t->tok[changes];
+    size_t changes_len = k->end - k->start;
     size_t result_size = changes_len + 256;
     char *result = (char *)malloc(result_size);
     snprintf(result, result_size,
              "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{\"changes\":%.*s}}",
-             id_str, (int)changes_len, changes_start);
-    send_ls_response(id_str, result);
+             id, (int)changes_len, t->s + k->start);
+    send_ls_response(id, result);
     free(result);
 }
 
-static void handle_rename(const char *id, const char *params) {
+static void handle_rename(const char *id, JsonTape *t, int params) {
     char uri[2048];
-    extract_doc_uri(params, uri, sizeof(uri));
+    extract_doc_uri(t, params, uri, sizeof(uri));
+
+    char new_name_raw[256];
+    json_copy(t, json_get(t, params, "newName"), new_name_raw,
+              sizeof(new_name_raw));
 
-    char *position = strstr(params, "\"position\":{");
-    if (!position)
+    char *line, *col;
+    if (!get_position(t, params, &line, &col))
         return;
-    position += 11;
-    char *line = strstr(position, "\"line\":");
-    char *col = strstr(position, "\"character\":");
-
-    /* Extract newName BEFORE cut_json_int calls mutate the buffer */
-    char new_name_raw[256] = "";
-    char *nn = strstr(params, "\"newName\":\"");
-    if (nn) {
-        nn += 11;
-        char *nn_end = strchr(nn, '"');
-        if (nn_end) {
-            size_t n = (size_t)(nn_end - nn);
-            if (n < sizeof(new_name_raw)) {
-                strncpy(new_name_raw, nn, n);
-                new_name_raw[n] = '\0';
-            }
-        }
-    }
 
     /* Escape backslashes and single quotes for Lua single-quoted literal */
     char escaped[512] = "";
@@ -608,9 +747,6 @@ static void handle_rename(const char *id, const char *params) {
     }
     escaped[ei] = '\0';
 
-    cut_json_int(&line, 7);
-    cut_json_int(&col, 12);
-
     char cmd[4096];
     snprintf(
         cmd, sizeof(cmd) - 1,
@@ -621,165 +757,105 @@ static void handle_rename(const char *id, const char *params) {
 
 // Generic function to handle location-based LSP responses (definition,
 // references, implementation)
-static void send_location_result(const char *params) {
-    // IMPORTANT: Search for ALL fields BEFORE calling cut_json_* functions,
-    // because those functions NULL-terminate and modify the params string!
-    char *id = strstr(params, "\"orig_id\":");
-    char *locations = strstr(params, "\"locations\":");
-    char *uri = strstr(params, "\"uri\":\"");
-    char *line_field = strstr(params, "\"line\":");
-    char *col_field = strstr(params, "\"col\":");
-
-    if (!id)
+static void send_location_result(JsonTape *t, int params) {
+    char id[16];
+    int i = json_get(t, params, "orig_id");
+    if (i < 0)
         return;
+    json_copy(t, i, id, sizeof(id));
 
-    cut_json_int(&id, 10);
-
-    if (locations) {
+    int locations = json_get(t, params, "locations");
+    if (locations >= 0) {
         // Format: "locations":[{file:"...",line:N,col:N},...]
-        char *arr_start = strchr(locations, '[');
-        char *arr_end = strrchr(locations, ']');
-        if (!arr_start || !arr_end) {
+        if (t->tok[locations].type != JSON_ARR) {
             send_null(id);
             return;
         }
 
-        size_t arr_len = (size_t)(arr_end - arr_start);
+        size_t arr_len = t->tok[locations].end - t->tok[locations].start;
         size_t result_size = arr_len * 4 + 256;
         char *result = (char *)malloc(result_size);
         char *p = result;
         p += snprintf(p, result_size,
                       "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":[", id);
 
-        char *loc = arr_start + 1;
         int first = 1;
-        while (loc < arr_end) {
-            char *obj_start = strchr(loc, '{');
-            if (!obj_start || obj_start >= arr_end)
-                break;
-
-            char *obj_end = strchr(obj_start, '}');
-            if (!obj_end || obj_end > arr_end)
-                break;
-
-            char *file = strstr(obj_start, "\"file\":\"");
-            char *line = strstr(obj_start, "\"line\":");
-            char *col = strstr(obj_start, "\"col\":");
-            char *end_col_field = strstr(obj_start, "\"end_col\":");
-
-            if (file && line && col && file < obj_end && line < obj_end &&
-                col < obj_end) {
-                file += 8;
-                char *file_end = strchr(file, '"');
-                if (file_end && file_end < obj_end) {
-                    size_t file_len = file_end - file;
-                    char *file_str = (char *)malloc(file_len + 1);
-                    strncpy(file_str, file, file_len);
-                    file_str[file_len] = '\0';
-
-                    line += 7;
-                    col += 6;
-                    int line_num = atoi(line);
-                    int col_num = atoi(col);
-                    int end_col_num = (end_col_field && end_col_field < obj_end)
-                                          ? atoi(end_col_field + 10)
-                                          : col_num;
-
-                    if (!first) {
-                        p += snprintf(p, result_size - (p - result), ",");
-                    }
-                    first = 0;
-
-                    p += snprintf(p, result_size - (p - result),
-                                  "{\"uri\":\"file://"
-                                  "%s\",\"range\":{\"start\":{\"line\":%d,"
-                                  "\"character\":%d},"
-                                  "\"end\":{\"line\":%d,\"character\":%d}}}",
-                                  file_str, line_num, col_num, line_num,
-                                  end_col_num);
-
-                    free(file_str);
-                }
+        for (uint32_t o = locations + 1; o < t->tok[locations].skip;
+             o = t->tok[o].skip) {
+            int file = json_get(t, o, "file");
+            int line = json_get(t, o, "line");
+            int col = json_get(t, o, "col");
+            int end_col = json_get(t, o, "end_col");
+            if (file < 0 || line < 0 || col < 0 ||
+                t->tok[file].type != JSON_STR)
+                continue;
+
+            int line_num = json_int(t, line);
+            int col_num = json_int(t, col);
+            int end_col_num = end_col >= 0 ? json_int(t, end_col) : col_num;
+
+            if (!first) {
+                p += snprintf(p, result_size - (p - result), ",");
             }
-
-            loc = obj_end + 1;
+            first = 0;
+
+            p += snprintf(p, result_size - (p - result),
+                          "{\"uri\":\"file://"
+                          "%s\",\"range\":{\"start\":{\"line\":%d,"
+                          "\"character\":%d},"
+                          "\"end\":{\"line\":%d,\"character\":%d}}}",
+                          json_str(t, file), line_num, col_num, line_num,
+                          end_col_num);
         }
 
         p += snprintf(p, result_size - (p - result), "]}");
         send_ls_response(id, result);
         free(result);
     } else {
-        // Single location: use the fields we already found
-        if (!uri || !line_field || !col_field)
+        // Single location
+        char *uri = json_str(t, json_get(t, params, "uri"));
+        char *line = json_str(t, json_get(t, params, "line"));
+        char *col = json_str(t, json_get(t, params, "col"));
+        if (!uri || !line || !col)
             return;
 
-        cut_json_str(&uri, 7);
-        cut_json_int(&line_field, 7);
-        cut_json_int(&col_field, 6);
-
         // Build the LSP Location response
         const char *fmt = "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":"
                           "{\"uri\":\"%s\",\"range\":{\"start\":{\"line\":%s,"
                           "\"character\":%s},"
                           "\"end\":{\"line\":%s,\"character\":%s}}}}";
 
-        size_t len = strlen(uri) + strlen(id) + strlen(line_field) * 2 +
-                     strlen(col_field) * 2 + 256;
+        size_t len = strlen(uri) + strlen(id) + strlen(line) * 2 +
+                     strlen(col) * 2 + 256;
         char *res = (char *)malloc(len);
-        snprintf(res, len - 1, fmt, id, uri, line_field, col_field, line_field,
-                 col_field);
+        snprintf(res, len - 1, fmt, id, uri, line, col, line, col);
         send_ls_response(id, res);
         free(res);
     }
 }
 
-static void send_definition_result(const char *params) {
-    send_location_result(params);
+static void send_definition_result(JsonTape *t, int params) {
+    send_location_result(t, params);
 }
 
-static void send_symbols_result(const char *params) {
-    char *id = strstr(params, "\"orig_id\":");
-    char *symbols = strstr(params, "\"symbols\":");
-    if (!id)
+static void send_symbols_result(JsonTape *t, int params) {
+    char id[16];
+    int i = json_get(t, params, "orig_id");
+    if (i < 0)
         return;
-    cut_json_int(&id, 10);
-    if (!symbols) {
+    json_copy(t, i, id, sizeof(id));
+    if (!send_lua_result(id, t, json_get(t, params, "symbols"), JSON_ARR))
         send_null(id);
-        return;
-    }
-    char *arr_start = strchr(symbols, '[');
-    char *arr_end = strrchr(symbols, ']');
-    if (!arr_start || !arr_end) {
-        send_null(id);
-        return;
-    }
-    size_t array_len = arr_end - arr_start + 1;
-    size_t result_size = array_len + 256;
-    char *result = (char *)malloc(result_size);
-    snprintf(result, result_size,
-             "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":%.*s}", id,
-             (int)array_len, arr_start);
-    send_ls_response(id, result);
-    free(result);
 }
 
-static void send_document_symbols_result(const char *params) {
-    send_symbols_result(params);
+static void send_document_symbols_result(JsonTape *t, int params) {
+    send_symbols_result(t, params);
 }
 
-static void handle_workspace_symbols(const char *id, const char *params) {
-    char *q = strstr(params, "\"query\":\"");
-    char query[1024] = "";
-    if (q) {
-        q += 9;
-        char *end = strchr(q, '"');
-        if (end) {
-            size_t n = end - q;
-            if (n < sizeof(query))
-                memcpy(query, q, n);
-            query[n < sizeof(query) ? n : sizeof(query) - 1] = '\0';
-        }
-    }
+static void handle_workspace_symbols(const char *id, JsonTape *t,
+                                     int params) {
+    char query[1024];
+    json_copy(t, json_get(t, params, "query"), query, sizeof(query));
 
     /* Escape backslashes and single quotes so the query is safe inside a Lua
      * single-quoted string literal. */
@@ -798,164 +874,165 @@ static void handle_workspace_symbols(const char *id, const char *params) {
     send_cmd_to_nvim(cmd);
 }
 
-static void send_workspace_symbols_result(const char *params) {
-    send_symbols_result(params);
+static void send_workspace_symbols_result(JsonTape *t, int params) {
+    send_symbols_result(t, params);
 }
 
-static void send_references_result(const char *params) {
-    send_location_result(params);
+static void send_references_result(JsonTape *t, int params) {
+    send_location_result(t, params);
 }
 
-static void send_implementation_result(const char *params) {
-    send_location_result(params);
+static void send_implementation_result(JsonTape *t, int params) {
+    send_location_result(t, params);
 }
 
-static void send_document_highlight_result(const char *params) {
-    char *id = strstr(params, "\"orig_id\":");
-    char *highlights = strstr(params, "\"highlights\":");
-    if (!id)
+static void send_document_highlight_result(JsonTape *t, int params) {
+    char id[16];
+    int i = json_get(t, params, "orig_id");
+    if (i < 0)
         return;
-    cut_json_int(&id, 10);
-    if (!highlights) {
+    json_copy(t, i, id, sizeof(id));
+    if (!send_lua_result(id, t, json_get(t, params, "highlights"), JSON_ARR))
         send_null(id);
-        return;
-    }
-
-    char *arr_start = strchr(highlights, '[');
-    char *arr_end = strrchr(highlights, ']');
-    if (!arr_start || !arr_end) {
-        send_null(id);
-        return;
-    }
-
-    size_t array_len = arr_end - arr_start + 1;
-    size_t result_size = array_len + 256;
-    char *result = (char *)malloc(result_size);
-    snprintf(result, result_size,
-             "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":%.*s}", id,
-             (int)array_len, arr_start);
-    send_ls_response(id, result);
-    free(result);
 }
 
 // --- Main Server Loop ---
 
-static void lsp_loop(void) {
-    Log("LSP loop started.\n");
+static JsonTape tape; // Tokens of the message being handled
 
-    // The main buffer to read the Content-Length header
-    char header[128];
-    // The main buffer for the JSON payload. Needs to be large enough for
-    // typical messages.
-    size_t clen = 6143;
-    char *content = (char *)malloc(clen + 1);
-
-    // Server loop: continuously read messages from stdin
-    while (1) {
-        size_t content_length = 0;
-        // char *header_end = NULL;
-
-        // 1. Read Content-Length Header
-        // Read header line by line until we find Content-Length:
-        if (fgets(header, 127, stdin) == NULL)
-            break;
+// Process a message from Neovim. Return 0 if the server must stop.
+static int handle_msg(char *content, size_t content_length) {
+    if (content_length == 0)
+        return 1;
 
-        if (sscanf(header, "Content-Length: %zu", &content_length) != 1) {
-            // Error handling for missing/malformed header.
-            // For a simple server, we might just continue or break.
-            fprintf(stderr, "Malformed header: %s", header);
-            fflush(stderr);
-            continue;
-        }
-        if (content_length >= clen) {
-            free(content);
-            clen = content_length + 1024;
-            content = (char *)malloc(clen + 1);
-        }
+    // JSON parsing
+    Log("\x1b[36mJSON received\x1b[0m:\n%s\n", content);
 
-        // 2. Consume the remaining headers until the blank line (\r\n\r\n)
-        // We expect Content-Type: application/json\r\n and then \r\n
-        do {
-            if (fgets(header, 127, stdin) == NULL)
-                break;
-            // The blank line is just "\r\n" or "\n" depending on environment,
-            // but we check for the line being effectively empty.
-            if (header[0] == '\r' || header[0] == '\n')
-                break;
-        } while (1);
-
-        // 3. Read the JSON payload
-        if (content_length > 0) {
-            size_t bytes_read = fread(content, 1, content_length, stdin);
-            content[bytes_read] = '\0';
-            if (bytes_read != content_length) {
-                fprintf(stderr, "wrong content length: %zu x %zu",
-                        content_length, bytes_read);
-                fflush(stderr);
-            }
+    JsonTape *t = &tape;
+    if (!json_parse(t, content, content_length)) {
+        fprintf(stderr, "Error: invalid JSON message\n");
+        fflush(stderr);
+        return 1;
+    }
 
-            // JSON parsing
-            Log("\x1b[36mJSON received\x1b[0m:\n%s\n", content);
+    // Find the top level fields. Their values are looked up only in their
+    // own subtrees by the handlers.
+    int m = json_get(t, 0, "method");
+    int i = json_get(t, 0, "id");
+    int params = json_get(t, 0, "params");
 
-            // Find the start position of all fields that we may need
-            char *method = strstr(content, "\"method\":\"");
-            char *id = strstr(content, "\"id\":");
-            char *params = strstr(content, "\"params\":{");
+    if (m < 0) {
+        fprintf(stderr, "Error: method not defined\n");
+        fflush(stderr);
+        return 0;
+    }
 
-            if (!method) {
-                fprintf(stderr, "Error: method not defined\n");
-                fflush(stderr);
-                break;
-            }
+    const char *method = json_str(t, m);
+
+    char id_buf[16];
+    char *id = NULL;
+    if (i >= 0) {
+        json_copy(t, i, id_buf, sizeof(id_buf));
+        id = id_buf;
+        add_active_request(id);
+    } else if (strcmp(method, "$/cancelRequest") == 0) {
+        // The ID of the cancelled request, which is already active
+        i = json_get(t, params, "id");
+        if (i < 0) {
+            fprintf(stderr, "Error: $/cancelRequest without id\n");
+            fflush(stderr);
+            return 1;
+        }
+        json_copy(t, i, id_buf, sizeof(id_buf));
+        id = id_buf;
+    }
 
-            cut_json_str(&method, 10);
+    // Route the request based on the method
+    if (strcmp(method, "textDocument/completion") == 0) {
+        handle_completion(id, t, params);
+    } else if (strcmp(method, "exeRnvimCmd") == 0) {
+        handle_exe_cmd(t, params);
+    } else if (strcmp(method, "completionItem/resolve") == 0) {
+        run_job(JOB_RESOLVE, handle_resolve, id, json_raw(t, params));
+    } else if (strcmp(method, "textDocument/hover") == 0) {
+        handle_hover(id);
+    } else if (strcmp(method, "textDocument/signatureHelp") == 0) {
+        handle_signature(id);
+    } else if (strcmp(method, "textDocument/definition") == 0) {
+        handle_definition(id, t, params);
+    } else if (strcmp(method, "textDocument/documentSymbol") == 0) {
+        handle_document_symbols(id);
+    } else if (strcmp(method, "workspace/symbol") == 0) {
+        handle_workspace_symbols(id, t, params);
+    } else if (strcmp(method, "textDocument/references") == 0) {
+        handle_references(id, t, params);
+    } else if (strcmp(method, "textDocument/implementation") == 0) {
+        handle_implementation(id, t, params);
+    } else if (strcmp(method, "textDocument/documentHighlight") == 0) {
+        handle_document_highlight(id, t, params);
+    } else if (strcmp(method, "textDocument/rename") == 0) {
+        handle_rename(id, t, params);
+    } else if (strcmp(method, "initialize") == 0) {
+        handle_initialize(id);
+    } else if (strcmp(method, "initialized") == 0) {
+        load_cached_data();
+    } else if (strcmp(method, "$/cancelRequest") == 0) {
+        Log("\x1b[31;1mCANCEL %s", id);
+        cancel_request(id);
+    } else if (strcmp(method, "exit") == 0 ||
+               strcmp(method, "shutdown") == 0) {
+        handle_exit(method);
+    } else {
+        fprintf(stderr, "Unhandled method: %s\n", method);
+        fflush(stderr);
+    }
+    return 1;
+}
 
-            if (id) {
-                cut_json_int(&id, 5);
-                add_active_request(id);
-            }
+/*
+ * Event loop of the server. The messages from Neovim (stdin) and from the
+ * nvimcom sessions (see tcp.c) are received by this thread, which is the
+ * only one that changes the data. The requests that only read the data may
+ * run in worker threads (see workers.c), and all threads send messages to
+ * Neovim through write_msg(). On Windows, the standard input cannot be
+ * polled and the messages from nvimcom are received by another thread.
+ */
+static void lsp_loop(void) {
+    Log("LSP loop started.\n");
 
-            // Route the request based on the method
-            if (strcmp(method, "textDocument/completion") == 0) {
-                handle_completion(id, params);
-            } else if (strcmp(method, "exeRnvimCmd") == 0) {
-                handle_exe_cmd(params);
-            } else if (strcmp(method, "completionItem/resolve") == 0) {
-                handle_resolve(id, params);
-            } else if (strcmp(method, "textDocument/hover") == 0) {
-                handle_hover(id);
-            } else if (strcmp(method, "textDocument/signatureHelp") == 0) {
-                handle_signature(id);
-            } else if (strcmp(method, "textDocument/definition") == 0) {
-                handle_definition(id, params);
-            } else if (strcmp(method, "textDocument/documentSymbol") == 0) {
-                handle_document_symbols(id);
-            } else if (strcmp(method, "workspace/symbol") == 0) {
-                handle_workspace_symbols(id, params);
-            } else if (strcmp(method, "textDocument/references") == 0) {
-                handle_references(id, params);
-            } else if (strcmp(method, "textDocument/implementation") == 0) {
-                handle_implementation(id, params);
-            } else if (strcmp(method, "textDocument/documentHighlight") == 0) {
-                handle_document_highlight(id, params);
-            } else if (strcmp(method, "textDocument/rename") == 0) {
-                handle_rename(id, params);
-            } else if (strcmp(method, "initialize") == 0) {
-                handle_initialize(id);
-            } else if (strcmp(method, "initialized") == 0) {
-                load_cached_data();
-            } else if (strcmp(method, "$/cancelRequest") == 0) {
-                Log("\x1b[31;1mCANCEL %s", id);
-                rm_active_request(id);
-            } else if (strcmp(method, "exit") == 0 ||
-                       strcmp(method, "shutdown") == 0) {
-                handle_exit(method);
-            } else {
-                fprintf(stderr, "Unhandled method: %s\n", method);
-                fflush(stderr);
-            }
+    MsgReader rdr;
+    reader_init(&rdr, STDIN_FILENO);
+    size_t content_length;
+    char *content;
+
+#ifdef WIN32
+    while ((content = reader_next(&rdr, &content_length)))
+        if (!handle_msg(content, content_length))
+            break;
+#else
+    struct pollfd pfd[MAX_SESSIONS + 2];
+    for (;;) {
+        pfd[0].fd = STDIN_FILENO;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        int n = tcp_fds(pfd + 1);
+        if (poll(pfd, n + 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "poll failed: %s\n", strerror(errno));
+            fflush(stderr);
+            break;
+        }
+        tcp_events(pfd + 1, n);
+        if (pfd[0].revents) {
+            if (!reader_read(&rdr))
+                break;
+            while ((content = reader_poll(&rdr, &content_length)))
+                if (!handle_msg(content, content_length))
+                    return;
         }
     }
+#endif
 }
 
 int main(int argc, char **argv) {
@@ -968,5 +1045,6 @@ int main(int argc, char **argv) {
     init_logging();
 #endif
     lsp_loop();
+    stop_server();
     return 0;
 }
@@ -6,6 +6,7 @@
 #include "lsp.h"
 #include "../nvimcom/src/common.h"
 #include "utilities.h"
+#include "buffers.h"
 
 // clang-format off
 static const char *roxygen_tags[] = {
@@ -22,8 +23,7 @@ static const char *roxygen_tags[] = {
 };
 // clang-format on
 
-static char *roxygen_menu;
-static size_t nchars = 0;
+static StrBuf roxygen_menu;
 
 void complete_roxygen(const char *params) {
     char *id = strstr(params, "\"orig_id\":");
@@ -33,27 +33,15 @@ void complete_roxygen(const char *params) {
 
     Log("complete_roxygen: %s, '%s'", id ? id : "", base ? base : "");
 
-    const char **s;
-
-    if (!roxygen_menu) {
-        s = roxygen_tags;
-        while (*s != NULL) {
-            nchars += strlen(*s) + 32;
-            s++;
-        }
-        roxygen_menu = (char *)calloc(nchars, sizeof(char));
-    }
-
-    memset(roxygen_menu, 0, nchars * sizeof(char));
-    char *p = roxygen_menu;
-    s = roxygen_tags;
+    sb_reset(&roxygen_menu);
+    const char **s = roxygen_tags;
     while (*s != NULL) {
         if (!base || fuzzy_find(*s, base)) {
-            p = str_cat(p, "{\"label\":\"@");
-            p = str_cat(p, *s);
-            p = str_cat(p, "\",\"kind\":14},");
+            sb_cat(&roxygen_menu, "{\"label\":\"@");
+            sb_cat(&roxygen_menu, *s);
+            sb_cat(&roxygen_menu, "\",\"kind\":14},");
         }
         s++;
     }
-    send_menu_items(roxygen_menu, id);
+    send_menu_items(roxygen_menu.b, id);
 }
@@ -8,37 +8,20 @@
 #include "lsp.h"
 #include "tcp.h"
 #include "utilities.h"
+#include "symbols.h"
+#include "snapshot.h"
+#include "buffers.h"
 #include "../nvimcom/src/common.h"
 
-static char *sig_buf;
-static size_t sig_buf_sz = 1024;
+static StrBuf sig_buf;
 
-static int get_info(const char *s) {
-    int i;
-    const char *f[7];
-    i = 0;
-    while (i < 7) {
-        f[i] = s;
-        i++;
-        while (*s != 0)
-            s++;
-        s++;
-    }
-    while (*s != '\n' && *s != 0)
-        s++;
-
-    memset(sig_buf, 0, sig_buf_sz);
-    char *p = sig_buf;
-
-    if (f[1][0] == 'F') {
-        char *b = format_usage(f[0], f[4], 0);
+static int get_info(const ObjTable *t, uint32_t i) {
+    sb_reset(&sig_buf);
 
-        // Avoid buffer overflow if the information is too lengthy.
-        size_t nsz = strlen(b) + 512;
-        if (sig_buf_sz < nsz)
-            p = grow_buffer(&sig_buf, &sig_buf_sz, nsz - sig_buf_sz);
-
-        str_cat(p, b);
+    if (t->cls[i] == 'F') {
+        char *b = format_usage(obj_field(t, i, OBJ_NAME),
+                               obj_field(t, i, OBJ_ARGS), 0);
+        sb_cat(&sig_buf, b);
         free(b);
         return 1;
     } else {
@@ -52,21 +35,15 @@ static void send_result(const char *req_id, const char *doc) {
         return;
     }
 
-    const char *fmt =
-        "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{\"activeSignature\":0,"
-        "\"signatures\":[{\"label\":\"%s\"}]}}";
-
-    char *fdoc = (char *)calloc(strlen(doc) + 1, sizeof(char));
-    format(doc, fdoc, ' ', '\x14');
-    char *edoc = esc_json(fdoc);
-    size_t len = sizeof(char) * (strlen(edoc) + 256);
-    char *res = (char *)malloc(len);
-    snprintf(res, len - 1, fmt, req_id, edoc);
-
-    send_ls_response(req_id, res);
-    free(fdoc);
-    free(edoc);
-    free(res);
+    JsonWriter w;
+    jw_init(&w, strlen(doc) + 256);
+    jw_printf(&w,
+              "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":{"
+              "\"activeSignature\":0,\"signatures\":[{\"label\":\"",
+              req_id);
+    jw_doc(&w, doc);
+    jw_cat(&w, "\"}]}}");
+    send_ls_json(req_id, &w);
 }
 
 void glbnv_signature(const char *req_id, const char *word, const char *args) {
@@ -82,33 +59,32 @@ void glbnv_signature(const char *req_id, const char *word, const char *args) {
 
 // Seek the function in loaded libraries
 static void seek_in_libs(const char *id, char *word) {
-    LibList *lib;
-    char *pkg = NULL;
+    PkgData *pd = NULL;
+    int i;
     if (strstr(word, "::")) {
-        lib = inst_libs;
-        pkg = word;
+        const char *pkg = word;
         word = strstr(word, "::");
         *word = '\0';
         word += 2;
+        pd = get_pkg(pkg);
+        i = pd ? sym_find_in(pd, word) : -1;
     } else {
-        lib = loaded_libs;
+        i = sym_find(word, &pd);
     }
-    while (lib) {
-        if (!pkg || strcmp(lib->pkg->name, pkg) == 0) {
-            const char *s = seek_word(lib->pkg->objls, word);
-            if (s) {
-                int is_fun = get_info(s);
-                if (is_fun)
-                    send_result(id, sig_buf);
-                return;
-            }
-        }
-        lib = lib->next;
+    if (i >= 0) {
+        int is_fun = get_info(&pd->objs, i);
+        if (is_fun)
+            send_result(id, sig_buf.b);
+        return;
     }
     send_null(id);
 }
 
-void sig_seek(const char *id, char *word) { seek_in_libs(id, word); }
+void sig_seek(const char *id, char *word) {
+    Snapshot *snap = snap_acquire(); // Keep the package data alive
+    seek_in_libs(id, word);
+    snap_release(snap);
+}
 
 void signature(const char *params) {
     Log("signature: %s", params);
@@ -121,16 +97,15 @@ void signature(const char *params) {
     cut_json_str(&word, 8);
     cut_json_str(&fobj, 8);
 
-    if (!sig_buf) {
-        sig_buf = (char *)malloc(sig_buf_sz);
-    }
-
-    if (glbnv_buffer) {
-        const char *s = seek_word(glbnv_buffer, word);
-        if (s) {
-            int is_fun = get_info(s);
+    Snapshot *snap = snap_acquire();
+    const ObjTable *g = snap->glbnv;
+    if (g->pool) {
+        int i = seek_obj(g, word);
+        if (i >= 0) {
+            int is_fun = get_info(g, i);
             if (is_fun)
-                send_result(id, sig_buf);
+                send_result(id, sig_buf.b);
+            snap_release(snap);
             return;
         }
         if (fobj) {
@@ -141,9 +116,11 @@ void signature(const char *params) {
                      "nvimcom:::sighover_method('%s', '%s', '%s', 's')", id,
                      word, fobj);
             nvimcom_eval(cmd);
+            snap_release(snap);
             return;
         }
     }
 
     seek_in_libs(id, word);
+    snap_release(snap);
 }
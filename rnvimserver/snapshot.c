@@ -0,0 +1,190 @@
+#include <stdlib.h>
+
+#include "snapshot.h"
+#include "objindex.h"
+#include "threads.h"
+#include "logging.h"
+
+/*
+ * The list of loaded libraries and the objects of .GlobalEnv are replaced
+ * (never modified) when nvimcom sends new data. Readers get a reference to
+ * the current snapshot and keep using it while a new one is published; a
+ * snapshot is freed when its last reference is released.
+ *
+ * Holding a snapshot also holds a read lock on the list of installed
+ * packages: the data of a package is freed only when a new version of its
+ * cache files is found, and this happens only while no reader is running.
+ */
+
+typedef struct glb_env_ {
+    int refcnt;   // Number of snapshots using it
+    char *buf;    // The string pool of `objs`
+    ObjTable objs;
+} GlbEnv;
+
+static GlbEnv empty_glb = {1, NULL, {0}};
+static Snapshot empty_snap = {1, 0, &empty_glb.objs, NULL, &empty_glb};
+
+static Snapshot *current = &empty_snap;  // The published snapshot
+static unsigned last_version;            // Version of `current`
+static Mutex snap_lock = MUTEX_INIT;     // Protects `current`
+static RWLock pkg_lock = RWLOCK_INIT;    // Protects the installed packages
+
+static void glb_unref(GlbEnv *g) {
+    if (__atomic_sub_fetch(&g->refcnt, 1, __ATOMIC_ACQ_REL) || g == &empty_glb)
+        return;
+    free((void *)g->objs.rec);
+    obj_index_free(&g->objs);
+    free(g->buf);
+    free(g);
+}
+
+static void snap_unref(Snapshot *s) {
+    if (__atomic_sub_fetch(&s->refcnt, 1, __ATOMIC_ACQ_REL) ||
+        s == &empty_snap)
+        return;
+    Log("snap_unref: freeing version %u", s->version);
+    LibList *lib = s->libs;
+    while (lib) {
+        LibList *next = lib->next;
+        free(lib);
+        lib = next;
+    }
+    glb_unref(s->glb);
+    free(s);
+}
+
+/**
+ * @brief Get a reference to the current snapshot. It must be released with
+ * `snap_release()` by the same thread.
+ */
+Snapshot *snap_acquire(void) {
+    rd_lock(&pkg_lock);
+    mutex_lock(&snap_lock);
+    Snapshot *s = current;
+    __atomic_add_fetch(&s->refcnt, 1, __ATOMIC_RELAXED);
+    mutex_unlock(&snap_lock);
+    return s;
+}
+
+/**
+ * @brief Release a reference obtained with `snap_acquire()`.
+ * @param s The snapshot.
+ */
+void snap_release(Snapshot *s) {
+    snap_unref(s);
+    rd_unlock(&pkg_lock);
+}
+
+// Replace the current snapshot. Only one thread at a time may call it.
+static void publish(Snapshot *s) {
+    s->refcnt = 1;
+    mutex_lock(&snap_lock);
+    Snapshot *old = current;
+    s->version = ++last_version;
+    current = s;
+    mutex_unlock(&snap_lock);
+    Log("publish: snapshot version %u", s->version);
+    snap_unref(old);
+}
+
+static LibList *copy_libs(const LibList *lib, const PkgData *skip) {
+    LibList *first = NULL;
+    LibList **last = &first;
+    for (; lib; lib = lib->next) {
+        if (lib->pkg == skip)
+            continue;
+        *last = calloc(1, sizeof(LibList));
+        (*last)->pkg = lib->pkg;
+        last = &(*last)->next;
+    }
+    return first;
+}
+
+/**
+ * @brief Publish a new table of .GlobalEnv objects.
+ * @param buf The string pool of the table. The snapshot takes ownership.
+ * @param t The table with its index and completion items already built.
+ * The snapshot takes ownership of its arrays.
+ */
+void snap_set_glbnv(char *buf, const ObjTable *t) {
+    GlbEnv *g = malloc(sizeof(GlbEnv));
+    g->refcnt = 1;
+    g->buf = buf;
+    g->objs = *t;
+
+    Snapshot *s = calloc(1, sizeof(Snapshot));
+    s->glb = g;
+    s->glbnv = &g->objs;
+    s->libs = copy_libs(current->libs, NULL);
+    publish(s);
+}
+
+/**
+ * @brief Get a reference to the .GlobalEnv objects of the current snapshot,
+ * to be published again later with `snap_use_glb()` or released with
+ * `snap_free_glb()`.
+ */
+struct glb_env_ *snap_hold_glb(void) {
+    mutex_lock(&snap_lock);
+    GlbEnv *g = current->glb;
+    __atomic_add_fetch(&g->refcnt, 1, __ATOMIC_RELAXED);
+    mutex_unlock(&snap_lock);
+    return g;
+}
+
+/**
+ * @brief Publish .GlobalEnv objects obtained with `snap_hold_glb()`.
+ * @param g The objects (NULL for none). The snapshot takes the reference.
+ */
+void snap_use_glb(struct glb_env_ *g) {
+    if (!g) {
+        g = &empty_glb;
+        __atomic_add_fetch(&g->refcnt, 1, __ATOMIC_RELAXED);
+    }
+    Snapshot *s = calloc(1, sizeof(Snapshot));
+    s->glb = g;
+    s->glbnv = &g->objs;
+    s->libs = copy_libs(current->libs, NULL);
+    publish(s);
+}
+
+void snap_free_glb(struct glb_env_ *g) {
+    if (g)
+        glb_unref(g);
+}
+
+/**
+ * @brief Publish a new list of loaded libraries.
+ * @param libs The list. The snapshot takes ownership.
+ */
+void snap_set_libs(LibList *libs) {
+    Snapshot *s = calloc(1, sizeof(Snapshot));
+    s->glb = current->glb;
+    __atomic_add_fetch(&s->glb->refcnt, 1, __ATOMIC_RELAXED);
+    s->glbnv = &s->glb->objs;
+    s->libs = libs;
+    publish(s);
+}
+
+/**
+ * @brief Remove a package that is going to be deleted from the list of
+ * loaded libraries. Must be called while holding `pkgs_wr_lock()`.
+ * @param pd The package data.
+ */
+void snap_drop_pkg(const PkgData *pd) {
+    Snapshot *s = calloc(1, sizeof(Snapshot));
+    s->glb = current->glb;
+    __atomic_add_fetch(&s->glb->refcnt, 1, __ATOMIC_RELAXED);
+    s->glbnv = &s->glb->objs;
+    s->libs = copy_libs(current->libs, pd);
+    publish(s);
+}
+
+/**
+ * @brief Wait until no reader is running and block new ones. Required to
+ * change the list of installed packages.
+ */
+void pkgs_wr_lock(void) { wr_lock(&pkg_lock); }
+
+void pkgs_wr_unlock(void) { wr_unlock(&pkg_lock); }
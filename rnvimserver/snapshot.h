@@ -0,0 +1,28 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "data_structures.h"
+
+struct glb_env_; // Objects of .GlobalEnv (snapshot.c)
+
+// Immutable view of the data that changes while R is running
+typedef struct snapshot_ {
+    int refcnt;             // Number of references
+    unsigned version;       // Different for each published snapshot
+    const ObjTable *glbnv;  // Objects in the global environment
+    LibList *libs;          // Loaded libraries (the first one masks the others)
+    struct glb_env_ *glb;   // Owner of `glbnv`
+} Snapshot;
+
+Snapshot *snap_acquire(void);
+void snap_release(Snapshot *s);
+void snap_set_glbnv(char *buf, const ObjTable *t);
+struct glb_env_ *snap_hold_glb(void);
+void snap_use_glb(struct glb_env_ *g);
+void snap_free_glb(struct glb_env_ *g);
+void snap_set_libs(LibList *libs);
+void snap_drop_pkg(const PkgData *pd);
+void pkgs_wr_lock(void);
+void pkgs_wr_unlock(void);
+
+#endif
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+#include "logging.h"
+#include "threads.h"
+
+/*
+ * Hash index of the objects of all packages whose cache files were already
+ * read. The same name may be exported by more than one package; the entries
+ * are chained in the same bucket and the package with the lowest `rank`
+ * (position in R's search path) masks the others.
+ *
+ * The index is shared by all threads: lookups take a read lock and changes
+ * take a write lock.
+ */
+
+struct sym_entry_ {
+    const char *name;        // Name of the object (in the package table)
+    uint32_t hash;           // Hash of the name
+    uint32_t rec;            // Index of the record in `pkg->objs`
+    PkgData *pkg;            // Package of the object
+    struct sym_entry_ *next; // Next entry in the bucket
+};
+
+typedef struct sym_entry_ SymEntry;
+
+static SymEntry **buckets; // Hash table
+static uint32_t nbuckets;  // Number of buckets (a power of 2)
+static uint32_t nentries;  // Number of entries
+static RWLock sym_lock = RWLOCK_INIT;
+
+// FNV-1a
+static uint32_t hash_str(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+        s++;
+    }
+    return h;
+}
+
+static void grow_table(void) {
+    uint32_t nb = nbuckets ? nbuckets * 2 : 4096;
+    SymEntry **b = calloc(nb, sizeof(SymEntry *));
+    for (uint32_t i = 0; i < nbuckets; i++) {
+        SymEntry *e = buckets[i];
+        // Move the entries keeping their relative order
+        SymEntry *rev = NULL;
+        while (e) {
+            SymEntry *nxt = e->next;
+            e->next = rev;
+            rev = e;
+            e = nxt;
+        }
+        while (rev) {
+            SymEntry *nxt = rev->next;
+            uint32_t k = rev->hash & (nb - 1);
+            rev->next = b[k];
+            b[k] = rev;
+            rev = nxt;
+        }
+    }
+    free(buckets);
+    buckets = b;
+    nbuckets = nb;
+}
+
+/**
+ * @brief Add the objects of a package to the index.
+ * @param pd The package data. Its cache files must be already loaded.
+ */
+void sym_add_pkg(PkgData *pd) {
+    uint32_t n = pd->objs.n;
+    if (n == 0)
+        return;
+    Log("sym_add_pkg(%s): %u", pd->name, n);
+
+    wr_lock(&sym_lock);
+    while (nentries + n > nbuckets)
+        grow_table();
+
+    pd->syms = malloc(n * sizeof(SymEntry));
+    // Insert from last to first because seek_obj() finds the first
+    // occurrence of a name.
+    for (uint32_t i = n; i > 0; i--) {
+        SymEntry *e = &pd->syms[i - 1];
+        e->name = obj_field(&pd->objs, i - 1, OBJ_NAME);
+        e->hash = hash_str(e->name);
+        e->rec = i - 1;
+        e->pkg = pd;
+        uint32_t k = e->hash & (nbuckets - 1);
+        e->next = buckets[k];
+        buckets[k] = e;
+    }
+    nentries += n;
+    wr_unlock(&sym_lock);
+}
+
+/**
+ * @brief Remove the objects of a package from the index.
+ * @param pd The package data.
+ */
+void sym_del_pkg(PkgData *pd) {
+    if (!pd->syms)
+        return;
+    wr_lock(&sym_lock);
+    for (uint32_t i = 0; i < pd->objs.n; i++) {
+        SymEntry **pe = &buckets[pd->syms[i].hash & (nbuckets - 1)];
+        while (*pe && (*pe)->pkg != pd)
+            pe = &(*pe)->next;
+        // Entries of the same package are contiguous in the chain
+        while (*pe && (*pe)->pkg == pd)
+            *pe = (*pe)->next;
+    }
+    nentries -= pd->objs.n;
+    wr_unlock(&sym_lock);
+    free(pd->syms);
+    pd->syms = NULL;
+}
+
+/**
+ * @brief Set the rank of the packages according to their position in the
+ * list of loaded libraries.
+ * @param inst The installed packages.
+ * @param loaded The loaded libraries. The first one masks the others.
+ */
+void sym_set_ranks(LibList *inst, LibList *loaded) {
+    wr_lock(&sym_lock);
+    for (LibList *lib = inst; lib; lib = lib->next)
+        lib->pkg->rank = 0;
+    int rank = 1;
+    for (LibList *lib = loaded; lib; lib = lib->next)
+        lib->pkg->rank = rank++;
+    wr_unlock(&sym_lock);
+}
+
+/**
+ * @brief Look up an object in the index.
+ *
+ * @param nm Name of the object.
+ * @param pd Where to store the package of the object.
+ * @param loaded Only consider packages in the search path?
+ * @param fun Only consider functions?
+ * @return Index of the record in `(*pd)->objs` or -1 if not found.
+ */
+static int lookup(const char *nm, PkgData **pd, int loaded, int fun) {
+    uint32_t h = hash_str(nm);
+    const SymEntry *best = NULL;
+    rd_lock(&sym_lock);
+    if (!nbuckets) {
+        rd_unlock(&sym_lock);
+        return -1;
+    }
+    for (const SymEntry *e = buckets[h & (nbuckets - 1)]; e; e = e->next) {
+        if (e->hash != h || strcmp(e->name, nm) != 0)
+            continue;
+        if (loaded && e->pkg->rank == 0)
+            continue;
+        if (fun && e->pkg->objs.cls[e->rec] != 'F')
+            continue;
+        if (!best)
+            best = e;
+        else if (e->pkg->rank &&
+                 (best->pkg->rank == 0 || e->pkg->rank < best->pkg->rank))
+            best = e;
+    }
+    rd_unlock(&sym_lock);
+    if (!best)
+        return -1;
+    if (pd)
+        *pd = best->pkg;
+    return (int)best->rec;
+}
+
+/**
+ * @brief Find an object in the attached packages, respecting the search order.
+ * @param nm Name of the object.
+ * @param pd Where to store the package of the object.
+ * @return Index of the record in `(*pd)->objs` or -1 if not found.
+ */
+int sym_find(const char *nm, PkgData **pd) { return lookup(nm, pd, 1, 0); }
+
+/**
+ * @brief Same as `sym_find()`, but only functions are considered.
+ */
+int sym_find_fun(const char *nm, PkgData **pd) { return lookup(nm, pd, 1, 1); }
+
+/**
+ * @brief Find an object in any package whose cache files were already read,
+ * giving precedence to the attached packages.
+ */
+int sym_find_any(const char *nm, PkgData **pd) {
+    return lookup(nm, pd, 0, 0);
+}
+
+/**
+ * @brief Find an object in a specific package.
+ * @param pd The package data.
+ * @param nm Name of the object.
+ * @return Index of the record in `pd->objs` or -1 if not found.
+ */
+int sym_find_in(const PkgData *pd, const char *nm) {
+    if (!pd->syms)
+        return -1;
+    uint32_t h = hash_str(nm);
+    int i = -1;
+    rd_lock(&sym_lock);
+    for (const SymEntry *e = buckets[h & (nbuckets - 1)]; e; e = e->next) {
+        if (e->pkg == pd && e->hash == h && strcmp(e->name, nm) == 0) {
+            i = (int)e->rec;
+            break;
+        }
+    }
+    rd_unlock(&sym_lock);
+    return i;
+}
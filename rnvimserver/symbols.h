@@ -0,0 +1,14 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include "data_structures.h"
+
+void sym_add_pkg(PkgData *pd);
+void sym_del_pkg(PkgData *pd);
+void sym_set_ranks(LibList *inst, LibList *loaded);
+int sym_find(const char *nm, PkgData **pd);
+int sym_find_fun(const char *nm, PkgData **pd);
+int sym_find_any(const char *nm, PkgData **pd);
+int sym_find_in(const PkgData *pd, const char *nm);
+
+#endif
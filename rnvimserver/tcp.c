@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>  // Standard input/output definitions
 #include <stdlib.h> // Standard library
 #include <string.h> // String handling functions
@@ -14,12 +15,18 @@
 #include <winsock2.h>
 #include <windows.h>
 #else
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #endif
 
 #include "global_vars.h"
+#include "../nvimcom/src/common.h"
 #include "logging.h"
 #include "utilities.h"
 #include "complete.h"
@@ -29,83 +36,334 @@
 #include "obbr.h"
 #include "tcp.h"
 #include "lsp.h"
+#include "threads.h"
+#include "workers.h"
 
 #ifdef WIN32
+#define poll WSAPoll
 static HANDLE Tid; // Identifier of thread running TCP connection loop.
+#endif
+
+struct sockaddr_in servaddr; // Server address structure
+static int sockfd = -1;      // socket file descriptor
+static int port;             // TCP port
+static char *VimSecret;      // Secret for communication with Vim
+static int VimSecretLen;     // Length of Vim secret
+#ifndef WIN32
+static char *sock_path; // Path of the Unix-domain socket (NULL if TCP)
+#endif
+
+/*
+ * Each R session running nvimcom has its own connection. The listening
+ * socket and the connections are polled by the event loop of the server
+ * (see lsp_loop() in rnvimserver.c), together with the standard input, so a
+ * session may connect, disconnect and reconnect while the server keeps
+ * running and all messages are processed by the same thread. On Windows,
+ * where the standard input cannot be polled, a thread polls the sockets.
+ *
+ * Only one session is active: the messages to nvimcom are sent to it and its
+ * .GlobalEnv objects and loaded libraries are used for completion and in the
+ * Object Browser. A session becomes active when it connects and when it
+ * sends a new list of objects or libraries, that is, after R finishes a
+ * top-level command. The list of objects of the other sessions is kept to be
+ * used again when they become active.
+ */
+typedef struct session_ {
+    int fd;      // Connection (-1 if the slot is free)
+    unsigned id; // Number of the session, for the log
+    // Bytes received. Each message is the secret, its size (9 digits), its
+    // content and a final '\x11'.
+    struct {
+        char *b;      // Buffer
+        size_t sz;    // Allocated size of b
+        size_t start; // Beginning of the next message
+        size_t end;   // End of the received bytes
+        size_t need;  // Size of the incomplete message (0 if unknown)
+    } rx;
+#ifndef WIN32
+    // Memory region through which nvimcom sends large messages (see
+    // send_shm() in nvimcom.c)
+    struct {
+        const ShmHeader *h; // The region (NULL if not mapped)
+        size_t size;        // Mapped size
+        int fd;             // File descriptor
+    } shm;
+#endif
+    char *libs;           // Last list of loaded libraries
+    struct glb_env_ *glb; // .GlobalEnv objects while the session is inactive
+    int glbnv_seq;        // Edits applied to `glb`
+} Session;
+
+// The sessions are only changed by the thread receiving the messages, and
+// `active` is also read by the threads sending messages, under `send_lock`.
+static Session sessions[MAX_SESSIONS];
+static Session *active; // Session receiving the messages to nvimcom
+static unsigned last_id;
+static Session *polled[MAX_SESSIONS]; // Sessions passed to poll()
+
+static Mutex send_lock = MUTEX_INIT; // Serializes the messages to nvimcom
+
+static void close_socket(int fd) {
+#ifdef WIN32
+    closesocket(fd);
 #else
-static pthread_t Tid; // Thread ID
+    close(fd);
 #endif
+}
+
+// Send a message to a specific session
+static void send_to_session(Session *s, const char *msg) {
+    size_t len = strlen(msg);
+    mutex_lock(&send_lock);
+    ssize_t w = s->fd == -1 ? -1 : send(s->fd, msg, len, 0);
+    mutex_unlock(&send_lock);
+    if (w != (ssize_t)len) {
+        fprintf(stderr, "Partial/failed write.\n");
+        fflush(stderr);
+    }
+}
+
+#ifndef WIN32
+// Map the region offered by nvimcom. It is not accessible if R is running
+// in another machine; then, nvimcom keeps sending everything through TCP.
+static void shm_map(Session *s, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmHeader))
+        m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    const ShmHeader *h = m;
+    // The whole secret is compared (nvimcom does not offer a region if the
+    // secret does not fit in the header)
+    if (m == MAP_FAILED || h->secret_len != (uint64_t)VimSecretLen ||
+        (size_t)VimSecretLen >= sizeof(h->secret) ||
+        memcmp(h->secret, VimSecret, VimSecretLen) != 0) {
+        if (m != MAP_FAILED)
+            munmap(m, st.st_size);
+        close(fd);
+        return;
+    }
+    if (s->shm.h) {
+        munmap((void *)s->shm.h, s->shm.size);
+        close(s->shm.fd);
+    }
+    s->shm.h = h;
+    s->shm.size = st.st_size;
+    s->shm.fd = fd;
+    Log("shm_map: %s (%zu bytes)", path, s->shm.size);
+    send_to_session(s, "S");
+}
+
+/**
+ * @brief Copy the message number `seq` from the shared memory region.
+ * @return The message, to be freed by the caller, or NULL if it was
+ * overwritten by a newer one, whose notification is still to be received.
+ */
+static char *shm_read(Session *s, uint64_t seq) {
+    if (!s->shm.h)
+        return NULL;
+    if (__atomic_load_n(&s->shm.h->seq, __ATOMIC_ACQUIRE) != seq)
+        return NULL;
+
+    // nvimcom grows the region when needed
+    size_t size = __atomic_load_n(&s->shm.h->size, __ATOMIC_RELAXED);
+    if (size > s->shm.size) {
+        void *m = mmap(NULL, size, PROT_READ, MAP_SHARED, s->shm.fd, 0);
+        if (m == MAP_FAILED)
+            return NULL;
+        munmap((void *)s->shm.h, s->shm.size);
+        s->shm.h = m;
+        s->shm.size = size;
+    }
+
+    size_t len = s->shm.h->len;
+    if (len > s->shm.size - sizeof(ShmHeader))
+        return NULL;
+    char *b = malloc(len + 1);
+    memcpy(b, s->shm.h + 1, len);
+    b[len] = 0;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->shm.h->seq, __ATOMIC_RELAXED) != seq) {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+static void shm_unmap(Session *s) {
+    if (s->shm.h) {
+        munmap((void *)s->shm.h, s->shm.size);
+        close(s->shm.fd);
+        s->shm.h = NULL;
+    }
+}
+#endif
+
+// Use the last list of libraries sent by a session
+static void use_libs(Session *s) {
+    if (!s->libs)
+        return;
+    // update_loaded_libs() changes the string
+    char *l = malloc(strlen(s->libs) + 1);
+    strcpy(l, s->libs);
+    update_loaded_libs(l);
+    free(l);
+    if (auto_obbr)
+        lib2ob();
+}
+
+// Make a session the active one
+static void activate(Session *s) {
+    if (s == active)
+        return;
+    Log("activate: session %u", s->id);
+    Session *old = active;
+    if (old)
+        old->glb = save_glblenv(&old->glbnv_seq);
+    restore_glblenv(s->glb, s->glbnv_seq);
+    s->glb = NULL;
+    mutex_lock(&send_lock);
+    active = s;
+    mutex_unlock(&send_lock);
+    // A session does not know the lists requested from another one
+    reset_requested_elements();
+    // Even without a previous active session, the libraries of the closed
+    // one may still be in use (see close_session())
+    use_libs(s);
+    if (auto_obbr)
+        compl2ob();
+}
+
+// Process nvimcom's reply to a request of the language server
+static void reply_job(__attribute__((unused)) const char *unused, char *b) {
+    char code = *b;
+    char *id;
+    b++;
+    if (code == 'C') {
+        complete(b);
+        return;
+    }
+    if (code == 'S') {
+        id = b;
+        b = strstr(b, "|");
+        *b = 0;
+        b++;
+        const char *wrd = b;
+        b = strstr(b, "|");
+        *b = 0;
+        glbnv_signature(id, wrd, ++b);
+        return;
+    }
+    id = b;
+    b = strstr(b, "|");
+    *b = '\0';
+    if (code == 'R') {
+        send_item_doc(id, ++b);
+    } else if (code == 'H') {
+        send_hover_doc(id, ++b);
+    } else if (code == 's') {
+        sig_seek(id, ++b);
+    } else if (code == 'h') {
+        hov_seek(id, ++b);
+    }
+}
 
-struct sockaddr_in servaddr;  // Server address structure
-static int sockfd;            // socket file descriptor
-static int connfd;            // Connection file descriptor
-static size_t fb_size = 1024; // Final buffer size
-static int r_conn;            // R connection status flag
-static char *VimSecret;       // Secret for communication with Vim
-static int VimSecretLen;      // Length of Vim secret
-static char *finalbuffer;     // Final buffer for message processing
-
-// Parse the message from R
-static void ParseMsg(char *b) {
+// Copy the request ID at the beginning of a reply ("Xid|...")
+static const char *reply_id(const char *b, char *id) {
+    int i = 0;
+    b++;
+    while (i < 15 && b[i] >= '0' && b[i] <= '9') {
+        id[i] = b[i];
+        i++;
+    }
+    id[i] = '\0';
+    return id;
+}
+
+// Parse a message from a session
+static void ParseMsg(Session *s, char *b) {
+    char id[16];
 #ifdef Debug_NRS
     if (strlen(b) > 2000)
-        Log("\x1b[32mTCP_in\x1b[0m, strlen = %zu", strlen(b));
+        Log("\x1b[32mTCP_in\x1b[0m [%u], strlen = %zu", s->id, strlen(b));
     else
-        Log("\x1b[32mTCP in\x1b[0m: %s", b);
+        Log("\x1b[32mTCP in\x1b[0m [%u]: %s", s->id, b);
 #endif
 
     if (*b == '+') {
-        char code;
-        char *id;
         b++;
         switch (*b) {
         case 'G':
             b++;
+            activate(s);
             update_glblenv_buffer(b);
             if (auto_obbr)  // Update the Object Browser after sending the
                             // message to R.nvim to
                 compl2ob(); // avoid unnecessary delays in auto completion
             break;
-        case 'L':
+        case 'g':
             b++;
-            update_loaded_libs(b);
+            activate(s);
+            update_glblenv_edit(b);
             if (auto_obbr)
-                lib2ob();
+                compl2ob();
             break;
-        case 'C':
+        case 'L':
             b++;
-            complete(b);
+            free(s->libs);
+            s->libs = malloc(strlen(b) + 1);
+            strcpy(s->libs, b);
+            if (s == active)
+                use_libs(s);
+            else
+                activate(s);
+            break;
+        case 'C':
+            get_orig_id(b, id);
+            run_job(JOB_COMPLETE, reply_job, id, b);
             break;
         case 'R':
+            run_job(JOB_RESOLVE, reply_job, reply_id(b, id), b);
+            break;
         case 'H':
-        case 's':
         case 'h':
-            code = *b;
-            b++;
-            id = b;
-            b = strstr(b, "|");
-            *b = '\0';
-            if (code == 'R') {
-                send_item_doc(id, ++b);
-            } else if (code == 'H') {
-                send_hover_doc(id, ++b);
-            } else if (code == 's') {
-                sig_seek(id, ++b);
-            } else if (code == 'h') {
-                hov_seek(id, ++b);
-            }
+            run_job(JOB_HOVER, reply_job, reply_id(b, id), b);
             break;
+        case 's':
         case 'S':
-            b++;
-            id = b;
-            b = strstr(b, "|");
-            *b = 0;
-            b++;
-            const char *wrd = b;
-            b = strstr(b, "|");
-            *b = 0;
-            glbnv_signature(id, wrd, ++b);
+            run_job(JOB_SIGNATURE, reply_job, reply_id(b, id), b);
             break;
+#ifndef WIN32
+        case 'M': // nvimcom offers a shared memory region
+            shm_map(s, b + 1);
+            break;
+        case 'Z': // A message is in the shared memory region
+            b = shm_read(s, strtoull(b + 1, NULL, 10));
+            if (!b) {
+                Log("shm_read: message overwritten");
+                // It might have been a whole list of .GlobalEnv objects, and
+                // the next edits from nvimcom are based on it
+                if (s == active) {
+                    invalidate_glblenv();
+                } else {
+                    s->glbnv_seq = -1;
+                    send_to_session(s, "A");
+                }
+            } else if (str_here(b, "+G")) {
+                // The list of objects is used without being copied again
+                activate(s);
+                take_glblenv_buffer(b);
+                if (auto_obbr)
+                    compl2ob();
+            } else {
+                ParseMsg(s, b);
+                free(b);
+            }
+            break;
+#endif
         case 'D': // set max_depth of lists in the completion data
             b++;
             set_max_depth(atoi(b));
@@ -225,20 +483,27 @@ static void ParseMsg(char *b) {
     }
 }
 
-// Function to register port number to R
-static void RegisterPort(int bindportn) {
-    // Register the port:
-    char pcmd[128];
-    sprintf(pcmd, "require('r.run').set_rns_port('%d')", bindportn);
+// Tell R.nvim where nvimcom must connect to
+static void register_server(void) {
+    char pcmd[160];
+#ifndef WIN32
+    if (sock_path)
+        snprintf(pcmd, sizeof(pcmd), "require('r.run').set_rns_port('%s%s')",
+                 UNIX_SOCK_PREFIX, sock_path);
+    else
+#endif
+        snprintf(pcmd, sizeof(pcmd), "require('r.run').set_rns_port('%d')",
+                 port);
     send_cmd_to_nvim(pcmd);
 }
 
 /**
  * @brief Initializes the socket for the server.
  *
+ * @param family The address family (AF_INET or AF_UNIX).
  * @note For Windows, WSAStartup is called to start the Winsock API.
  */
-static void initialize_socket(void) {
+static void initialize_socket(int family) {
     if (!VimSecret) {
         if (!getenv("RNVIM_SECRET")) {
             fprintf(stderr, "RNVIM_SECRET not found\n");
@@ -261,7 +526,7 @@ static void initialize_socket(void) {
         exit(1);
     }
 #endif
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    sockfd = socket(family, SOCK_STREAM, 0);
     if (sockfd == -1) {
         fprintf(stderr, "socket creation failed...\n");
         fflush(stderr);
@@ -282,11 +547,10 @@ static void bind_to_port(void) {
     servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
 
     int res = 1;
-    for (int port = PORT_START; port <= PORT_END; port++) {
+    for (port = PORT_START; port <= PORT_END; port++) {
         servaddr.sin_port = htons(port);
         res = bind(sockfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
         if (res == 0) {
-            RegisterPort(port);
             Log("bind_to_port: Bind succeeded on port %d", port);
             break;
         }
@@ -302,6 +566,58 @@ static void bind_to_port(void) {
     }
 }
 
+#ifndef WIN32
+/**
+ * @brief Binds the server socket to a Unix-domain socket in RNVIM_TMPDIR if
+ * RNVIM_UNIX_SOCKET is set. The path is registered as RNVIM_PORT with the
+ * "unix:" prefix, and nvimcom authenticates with the secret as over TCP.
+ * The socket file is kept while the server runs, because a new R session
+ * connects to the same path, and is deleted by stop_server().
+ *
+ * @return 1 on success and 0 if the TCP port must be used.
+ */
+static int bind_to_path(void) {
+    const char *tmpdir = getenv("RNVIM_TMPDIR");
+    if (!getenv("RNVIM_UNIX_SOCKET") || !tmpdir)
+        return 0;
+    Log("bind_to_path()");
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    int len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/rns_%d.sock",
+                       tmpdir, getpid());
+    // The path must fit in sun_path and in the Lua string of register_server()
+    if (len < 0 || (size_t)len >= sizeof(addr.sun_path) ||
+        strpbrk(addr.sun_path, "'\\")) {
+        Log("bind_to_path: invalid path: %s", addr.sun_path);
+        return 0;
+    }
+
+    initialize_socket(AF_UNIX);
+    unlink(addr.sun_path);
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        Log("bind_to_path: bind failed: %s", strerror(errno));
+        close(sockfd);
+        return 0;
+    }
+    // Only the user can connect to the socket. Connections are refused until
+    // listen() is called, after the permissions were changed. The umask is
+    // not used because it is shared by all threads.
+    if (chmod(addr.sun_path, 0600) != 0) {
+        Log("bind_to_path: chmod failed: %s", strerror(errno));
+        close(sockfd);
+        unlink(addr.sun_path);
+        return 0;
+    }
+
+    sock_path = malloc(len + 1);
+    strcpy(sock_path, addr.sun_path);
+    Log("bind_to_path: Bind succeeded on %s", sock_path);
+    return 1;
+}
+#endif
+
 /**
  * @brief Sets the server to listen for incoming connections.
  */
@@ -316,8 +632,8 @@ static void listening_for_connections(void) {
 }
 
 /**
- * @brief Accepts an incoming connection on the listening socket.
- *
+ * @brief Accepts an incoming connection on the listening socket. The new
+ * session becomes the active one.
  */
 static void accept_connection(void) {
     Log("accept_connection()");
@@ -326,16 +642,36 @@ static void accept_connection(void) {
 #else
     socklen_t len;
 #endif
-    struct sockaddr_in cli;
+    struct sockaddr_storage cli;
 
     len = sizeof(cli);
-    connfd = accept(sockfd, (struct sockaddr *)&cli, &len);
-    if (connfd < 0) {
+    int fd = accept(sockfd, (struct sockaddr *)&cli, &len);
+    if (fd < 0) {
         fprintf(stderr, "server accept failed...\n");
         fflush(stderr);
-        exit(4);
+        return;
+    }
+
+    Session *s = NULL;
+    for (int i = 0; i < MAX_SESSIONS; i++)
+        if (sessions[i].fd == -1) {
+            s = &sessions[i];
+            break;
+        }
+    if (!s) {
+        fprintf(stderr, "Too many nvimcom connections\n");
+        fflush(stderr);
+        close_socket(fd);
+        return;
     }
-    r_conn = 1;
+    memset(s, 0, sizeof(Session));
+    s->id = ++last_id;
+    s->glbnv_seq = -1;
+    mutex_lock(&send_lock);
+    s->fd = fd;
+    mutex_unlock(&send_lock);
+    Log("accept_connection: session %u", s->id);
+    activate(s);
 }
 
 /**
@@ -346,120 +682,212 @@ static void accept_connection(void) {
  */
 static void setup_server_socket(void) {
     Log("setup_server_socket()");
-    initialize_socket();
-    bind_to_port();
+#ifndef WIN32
+    if (!bind_to_path())
+#endif
+    {
+        initialize_socket(AF_INET);
+        bind_to_port();
+    }
     listening_for_connections();
-    accept_connection();
+    for (int i = 0; i < MAX_SESSIONS; i++)
+        sessions[i].fd = -1;
 }
 
-// Get the whole message from the socket
-static void get_whole_msg(char *b) {
-    Log("get_whole_msg()");
-    char *p;
-    char tmp[1];
-    size_t msg_size;
-
-    if (strstr(b, VimSecret) != b) {
-        fprintf(stderr, "Strange string received {%s}: \"%s\"\n", VimSecret, b);
+// Close the connection with a session. If it was the active one, the most
+// recent of the remaining sessions becomes active.
+static void close_session(Session *s) {
+    Log("close_session: session %u", s->id);
+    if (s->rx.end != s->rx.start) {
+        fprintf(stderr, "Incomplete TCP message: %zu bytes\n",
+                s->rx.end - s->rx.start);
         fflush(stderr);
-        return;
     }
-    p = b + VimSecretLen;
+    mutex_lock(&send_lock);
+    close_socket(s->fd);
+    s->fd = -1;
+    if (active == s)
+        active = NULL;
+    mutex_unlock(&send_lock);
+#ifndef WIN32
+    shm_unmap(s);
+#endif
+    free(s->rx.b);
+    free(s->libs);
+    free_glblenv(s->glb);
+    memset(s, 0, sizeof(Session));
+    s->fd = -1;
 
-    // Get the message size
-    p[9] = 0;
-    msg_size = atoi(p);
+    if (active)
+        return;
+    Session *last = NULL;
+    for (int i = 0; i < MAX_SESSIONS; i++)
+        if (sessions[i].fd != -1 && (!last || sessions[i].id > last->id))
+            last = &sessions[i];
+    if (last)
+        activate(last);
+}
 
-    // Allocate enough memory to the final buffer
-    if (finalbuffer) {
-        memset(finalbuffer, 0, fb_size);
-        if (msg_size > fb_size)
-            finalbuffer =
-                grow_buffer(&finalbuffer, &fb_size, msg_size - fb_size + 1024);
-    } else {
-        if (msg_size > fb_size)
-            fb_size = msg_size + 1024;
-        finalbuffer = calloc(fb_size, sizeof(char));
+// Receive the bytes available on the connection with a session. Return 0 if
+// the connection was closed.
+static int rx_recv(Session *s) {
+    if (s->rx.start > 0) {
+        memmove(s->rx.b, s->rx.b + s->rx.start, s->rx.end - s->rx.start);
+        s->rx.end -= s->rx.start;
+        s->rx.start = 0;
+    }
+    // Room for the whole incomplete message, if its size is known
+    if (s->rx.need > s->rx.sz) {
+        s->rx.sz = s->rx.need + 65536;
+        s->rx.b = realloc(s->rx.b, s->rx.sz);
+    } else if (!s->rx.need && s->rx.sz - s->rx.end < 65536) {
+        s->rx.sz = 2 * s->rx.sz + 65536;
+        s->rx.b = realloc(s->rx.b, s->rx.sz);
+    }
+    ssize_t n = recv(s->fd, s->rx.b + s->rx.end, s->rx.sz - s->rx.end, 0);
+    if (n > 0) {
+        s->rx.end += n;
+        return 1;
     }
+    return n < 0 && errno == EINTR;
+}
 
-    p = finalbuffer;
+/**
+ * @brief Get the next complete message received from a session. The bytes
+ * are received in large chunks: a message may span several chunks and a
+ * chunk may have several messages.
+ * @return The content of the message, terminated by '\0', or NULL if more
+ * bytes are needed. The content is valid until the next call of `rx_recv()`
+ * and may be modified.
+ */
+static char *next_msg(Session *s) {
+    size_t hlen = VimSecretLen + 9;
     for (;;) {
-        if ((recv(connfd, tmp, 1, 0) == 1))
-            *p = *tmp;
-        else
-            break;
-        if (*p == '\x11')
-            break;
-        p++;
+        s->rx.need = 0;
+        if (s->rx.end - s->rx.start < hlen)
+            return NULL;
+
+        char *h = s->rx.b + s->rx.start;
+        char sz[10];
+        memcpy(sz, h + VimSecretLen, 9);
+        sz[9] = 0;
+        char *e;
+        size_t msg_size = strtoul(sz, &e, 10);
+        if (strncmp(h, VimSecret, VimSecretLen) != 0 || *e) {
+            fprintf(stderr, "Strange string received {%s}: \"%.*s\"\n",
+                    VimSecret, (int)hlen, h);
+            fflush(stderr);
+            // Skip the received bytes
+            s->rx.start = s->rx.end;
+            continue;
+        }
+
+        size_t total = hlen + msg_size + 1;
+        if (s->rx.end - s->rx.start < total) {
+            s->rx.need = total;
+            return NULL;
+        }
+        Log("TCP in (message header): %.*s", (int)hlen, h);
+
+        // Messages whose size does not match the position of the final
+        // '\x11' are delimited by the '\x11'
+        if (h[total - 1] != '\x11') {
+            char *m = memchr(h + hlen, '\x11', s->rx.end - s->rx.start - hlen);
+            if (!m)
+                return NULL;
+            fprintf(stderr, "Divergent TCP message size: %zu\n", msg_size);
+            fflush(stderr);
+            total = m - h + 1;
+        }
+
+        char *msg = h + hlen;
+        msg[total - hlen - 1] = '\0';
+        s->rx.start += total;
+        return msg;
     }
-    *p = 0;
+}
 
-    if (strlen(finalbuffer) != msg_size) {
-        fprintf(stderr, "Divergent TCP message size: %zu x %zu\n", strlen(p),
-                msg_size);
-        fflush(stderr);
+// Receive and parse the messages from a session
+static void read_session(Session *s) {
+    if (!rx_recv(s)) {
+        close_session(s);
+        return;
+    }
+    char *msg;
+    while ((msg = next_msg(s))) {
+        r_running = 1;
+        ParseMsg(s, msg);
+    }
+}
+
+/**
+ * @brief Add the listening socket and the connections to an array to be
+ * passed to poll().
+ * @param pfd The array, with room for MAX_SESSIONS + 1 elements.
+ * @return The number of elements added.
+ */
+int tcp_fds(struct pollfd *pfd) {
+    if (sockfd == -1)
+        return 0;
+    int n = 1;
+    pfd[0].fd = sockfd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (sessions[i].fd == -1)
+            continue;
+        polled[n - 1] = &sessions[i];
+        pfd[n].fd = sessions[i].fd;
+        pfd[n].events = POLLIN;
+        pfd[n].revents = 0;
+        n++;
     }
+    return n;
+}
 
-    r_running = 1;
-    ParseMsg(finalbuffer);
+/**
+ * @brief Receive the messages and connections signaled by poll().
+ * @param pfd The array filled by `tcp_fds()`.
+ * @param n The number of elements added by `tcp_fds()`.
+ */
+void tcp_events(const struct pollfd *pfd, int n) {
+    for (int i = 1; i < n; i++)
+        if (pfd[i].revents)
+            read_session(polled[i - 1]);
+    if (n > 0 && (pfd[0].revents & POLLIN))
+        accept_connection();
 }
 
 #ifdef WIN32
 // Thread function to receive messages on Windows
-static DWORD WINAPI receive_msg(__attribute__((unused)) void *arg)
-#else
-// Thread function to receive messages on Unix
-static void *receive_msg(void *v)
-#endif
-{
-    size_t blen = VimSecretLen + 9;
-    char b[32];
-    size_t rlen;
-
+static DWORD WINAPI receive_msg(__attribute__((unused)) void *arg) {
+    struct pollfd pfd[MAX_SESSIONS + 1];
     for (;;) {
-        bzero(b, 32);
-        rlen = recv(connfd, b, blen, 0);
-        if (rlen == blen) {
-            Log("TCP in (message header): %s", b);
-            get_whole_msg(b);
-        } else {
-            r_conn = 0;
-#ifdef WIN32
-            closesocket(sockfd);
-            WSACleanup();
-#else
-            close(sockfd);
-#endif
-            sockfd = -1;
-            if (rlen != -1 && rlen != 0) {
-                fprintf(stderr, "TCP socket -1: restarting...\n");
-                fprintf(stderr, "Wrong TCP data length: %zu x %zu\n", blen,
-                        rlen);
-                fflush(stderr);
-            }
+        int n = tcp_fds(pfd);
+        if (poll(pfd, n, -1) < 0) {
+            fprintf(stderr, "poll failed: %d\n", WSAGetLastError());
+            fflush(stderr);
             break;
         }
+        tcp_events(pfd, n);
     }
-#ifdef WIN32
     return 0;
-#else
-    return NULL;
-#endif
 }
+#endif
 
 // Function to send messages to R (nvimcom package)
 void send_to_nvimcom(char *msg) {
     Log("\x1b[35mTCP out\x1b[0m: %s", msg);
-    if (connfd && r_conn) {
-        size_t len = strlen(msg);
-        if (send(connfd, msg, len, 0) != (ssize_t)len) {
-            fprintf(stderr, "Partial/failed write.\n");
-            fflush(stderr);
-            return;
-        }
-    } else {
+    size_t len = strlen(msg);
+    mutex_lock(&send_lock);
+    ssize_t w = active ? send(active->fd, msg, len, 0) : -2;
+    mutex_unlock(&send_lock);
+    if (w == -2) {
         fprintf(stderr, "nvimcom is not connected");
         fflush(stderr);
+    } else if (w != (ssize_t)len) {
+        fprintf(stderr, "Partial/failed write.\n");
+        fflush(stderr);
     }
 }
 
@@ -469,21 +897,24 @@ void nvimcom_eval(const char *cmd) {
     send_to_nvimcom(buf);
 }
 
-// Start server and listen for connections
+// Start the server. It keeps running when R quits: if it is already
+// running, R.nvim is just told where nvimcom must connect to.
 void start_server(void) {
+    if (sockfd != -1) {
+        register_server();
+        return;
+    }
     setup_server_socket();
+    register_server();
 
-    // Receive messages from TCP and output them to stdout
 #ifdef WIN32
+    // Receive messages from TCP and output them to stdout
     DWORD ti;
     Tid = CreateThread(NULL, 0, receive_msg, NULL, 0, &ti);
-#else
-    pthread_create(&Tid, NULL, receive_msg, NULL);
 #endif
 }
 
-// Close the TCP connection and cancel the server thread.
-// Called during rnvimserver shutdown.
+// Close the TCP connections. Called during rnvimserver shutdown.
 void stop_server(void) {
 #ifdef WIN32
     closesocket(sockfd);
@@ -491,11 +922,10 @@ void stop_server(void) {
     TerminateThread(Tid, 0);
     CloseHandle(Tid);
 #else
-    if (sockfd > 0)
+    if (sockfd != -1)
         close(sockfd);
-    if (Tid) {
-        pthread_cancel(Tid);
-        pthread_join(Tid, NULL);
-    }
+    sockfd = -1;
+    if (sock_path)
+        unlink(sock_path);
 #endif
 }
@@ -1,9 +1,15 @@
 #ifndef TCP_H
 #define TCP_H
 
+#define MAX_SESSIONS 8 // Maximum number of simultaneous nvimcom connections
+
+struct pollfd;
+
 void send_to_nvimcom(char *msg);
 void nvimcom_eval(const char *cmd);
 void start_server(void);
 void stop_server(void);
+int tcp_fds(struct pollfd *pfd);
+void tcp_events(const struct pollfd *pfd, int n);
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+/*
+ * Minimal portable locks. On Windows, slim reader/writer locks are used both
+ * as mutexes and as read/write locks.
+ */
+
+#ifdef WIN32
+#include <windows.h>
+
+typedef SRWLOCK Mutex;
+typedef SRWLOCK RWLock;
+#define MUTEX_INIT SRWLOCK_INIT
+#define RWLOCK_INIT SRWLOCK_INIT
+
+static inline void mutex_lock(Mutex *m) { AcquireSRWLockExclusive(m); }
+static inline void mutex_unlock(Mutex *m) { ReleaseSRWLockExclusive(m); }
+static inline void rd_lock(RWLock *l) { AcquireSRWLockShared(l); }
+static inline void rd_unlock(RWLock *l) { ReleaseSRWLockShared(l); }
+static inline void wr_lock(RWLock *l) { AcquireSRWLockExclusive(l); }
+static inline void wr_unlock(RWLock *l) { ReleaseSRWLockExclusive(l); }
+#else
+#include <pthread.h>
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_rwlock_t RWLock;
+#define MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define RWLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+
+static inline void mutex_lock(Mutex *m) { pthread_mutex_lock(m); }
+static inline void mutex_unlock(Mutex *m) { pthread_mutex_unlock(m); }
+static inline void rd_lock(RWLock *l) { pthread_rwlock_rdlock(l); }
+static inline void rd_unlock(RWLock *l) { pthread_rwlock_unlock(l); }
+static inline void wr_lock(RWLock *l) { pthread_rwlock_wrlock(l); }
+static inline void wr_unlock(RWLock *l) { pthread_rwlock_unlock(l); }
+#endif
+
+#endif
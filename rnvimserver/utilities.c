@@ -3,28 +3,7 @@
 #include <string.h>
 
 #include "utilities.h"
-#ifdef Debug_NRS
-#include "logging.h"
-#endif
-
-/**
- * Grows a buffer to a new size.
- * @param b Pointer to the buffer.
- * @param sz Size of the buffer.
- * @param inc Amount to increase.
- * @return Pointer to the resized buffer.
- */
-char *grow_buffer(char **b, size_t *sz, size_t inc) {
-#ifdef Debug_NRS
-    Log("\x1b[31mgrow_buffer\x1b[0m: %zu, %zu", *sz, inc);
-#endif
-    *sz += inc;
-    char *tmp = calloc(*sz, sizeof(char));
-    strcpy(tmp, *b);
-    free(*b);
-    *b = tmp;
-    return tmp;
-}
+#include "json.h"
 
 /**
  * Replaces all instances of a specified character in a string with another
@@ -91,62 +70,11 @@ char *esc_json(const char *input) {
         return NULL;
     }
 
-    size_t ilen = strlen(input);
-    char *b = (char *)malloc(ilen * 6 + 1);
-    if (b == NULL) {
-        return NULL;
-    }
-
-    size_t j = 0;
-    for (size_t i = 0; i < ilen; i++) {
-        char c = input[i];
-        switch (c) {
-        case '\x14':
-            b[j++] = '\\';
-            b[j++] = 'n';
-            break;
-        case '\x13':
-            b[j++] = '\'';
-            break;
-        case '\x12':
-            b[j++] = '\\';
-            b[j++] = '\\';
-            break;
-        case '"':
-            b[j++] = '\\';
-            b[j++] = '"';
-            break;
-        case '\\':
-            b[j++] = '\\';
-            b[j++] = '\\';
-            break;
-        case '\n':
-            b[j++] = '\\';
-            b[j++] = 'n';
-            break;
-        case '\r':
-            b[j++] = '\\';
-            b[j++] = 'r';
-            break;
-        case '\t':
-            b[j++] = '\\';
-            b[j++] = 't';
-            break;
-        case '\b':
-            b[j++] = '\\';
-            b[j++] = 'b';
-            break;
-        case '\f':
-            b[j++] = '\\';
-            b[j++] = 'f';
-            break;
-        default:
-            b[j++] = c;
-            break;
-        }
-    }
-    b[j] = '\0';
-    return b;
+    JsonWriter w;
+    jw_init(&w, strlen(input));
+    jw_str(&w, input);
+    memmove(w.b, w.b + JSON_HEAD, w.len - JSON_HEAD + 1);
+    return w.b;
 }
 
 // Advance the pointer to the value and NULL terminate the string
@@ -160,6 +88,16 @@ void cut_json_int(char **str, unsigned len) {
     *p = '\0';
 }
 
+// Copy the ID of the request answered by a message ("orig_id") without
+// modifying the message. `id` must have room for 16 characters and is empty
+// if the message has no ID.
+void get_orig_id(const char *params, char *id) {
+    const char *p = strstr(params, "\"orig_id\":");
+    *id = '\0';
+    if (p)
+        snprintf(id, 16, "%ld", strtol(p + 10, NULL, 10));
+}
+
 // Advance the pointer to the value and NULL terminate the string
 void cut_json_str(char **str, unsigned len) {
     if (*str == NULL)
@@ -171,36 +109,6 @@ void cut_json_str(char **str, unsigned len) {
     *p = '\0';
 }
 
-// Advance the pointer to the opening bracket and NULL terminate the string
-// after the closing bracket
-void cut_json_bkt(char **str, unsigned len) {
-    char *p = *str + len;
-    *str = p;
-    size_t j = 1;
-    int n_braces = 1;
-    while (n_braces > 0 && p[j]) {
-        if (p[j] == '{')
-            n_braces++;
-        else if (p[j] == '}')
-            n_braces--;
-        j++;
-    }
-    p[j] = '\0';
-}
-
-char *seek_word(char *objls, const char *wrd) {
-    char *s = objls;
-    while (*s != 0) {
-        if (strcmp(s, wrd) == 0) {
-            return s;
-        }
-        while (*s != '\n')
-            s++;
-        s++;
-    }
-    return NULL;
-}
-
 /**
  * Checks if the string `b` can be found through string `a`.
  * @param a The string to be checked.
@@ -230,13 +138,125 @@ int fuzzy_find(const char *a, const char *b) {
         return 0;
 }
 
-int is_function(const char *obj) {
-    while (*obj)
-        obj++;
-    obj++;
-    if (*obj == 'F') {
+/**
+ * Gets the set of characters of a string as a bit mask. Letters are
+ * case-insensitive and rare characters share a single bit.
+ * @param s The string.
+ * @return The bit mask.
+ */
+uint64_t char_mask(const char *s) {
+    uint64_t m = 0;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 'a' && c <= 'z')
+            m |= (uint64_t)1 << (c - 'a');
+        else if (c >= 'A' && c <= 'Z')
+            m |= (uint64_t)1 << (c - 'A');
+        else if (c >= '0' && c <= '9')
+            m |= (uint64_t)1 << (26 + c - '0');
+        else if (c == '.')
+            m |= (uint64_t)1 << 36;
+        else if (c == '_')
+            m |= (uint64_t)1 << 37;
+        else
+            m |= (uint64_t)1 << (38 + c % 26);
+    }
+    return m;
+}
+
+#define FZ_MAX_NAME 256 // Longer names are truncated
+#define FZ_MAX_PAT 64   // Longer patterns are truncated
+#define FZ_MATCH 16     // Score of each matched character
+#define FZ_BOUNDARY 8   // Match at the beginning of the name or of a word
+#define FZ_CAMEL 6      // Match at an upper case letter after a lower case one
+#define FZ_CONSEC 4     // Match right after the previous match
+#define FZ_CASE 1       // Match with the same case
+#define FZ_GAP_START 3  // Penalty for starting a gap
+#define FZ_GAP_EXT 1    // Penalty for each character in a gap
+
+static int lower(int c) { return (c >= 'A' && c <= 'Z') ? c + 32 : c; }
+
+static int position_bonus(const char *s, int i) {
+    if (i == 0)
+        return FZ_BOUNDARY + 2;
+    char p = s[i - 1];
+    if (p == '.' || p == '_' || p == '$' || p == '@' || p == ':')
+        return FZ_BOUNDARY;
+    if (p >= 'a' && p <= 'z' && s[i] >= 'A' && s[i] <= 'Z')
+        return FZ_CAMEL;
+    return 0;
+}
+
+/**
+ * Scores how well the string `pat` matches `s` as a case-insensitive
+ * subsequence. Matches at word boundaries (start of the name, after '.',
+ * '_', '$' or '@' and at camelCase humps), contiguous matches and matches
+ * with the same case get bonuses; gaps are penalized.
+ * @param s The string to be checked.
+ * @param pat The pattern.
+ * @return 0 if `pat` is not a subsequence of `s`; otherwise a positive
+ * score, higher for better matches.
+ */
+int fuzzy_score(const char *s, const char *pat) {
+    int n = strlen(s);
+    int m = strlen(pat);
+    if (m == 0)
         return 1;
-    } else {
+    if (n > FZ_MAX_NAME)
+        n = FZ_MAX_NAME;
+    if (m > FZ_MAX_PAT)
+        m = FZ_MAX_PAT;
+    if (m > n)
         return 0;
+
+    // Smith-Waterman like dynamic programming with two rows: prv[i] is the
+    // best score of matching pat[0..j-1] with pat[j-1] at s[i].
+    const int NEG = -1000000;
+    int prv[FZ_MAX_NAME];
+    int cur[FZ_MAX_NAME];
+
+    for (int i = 0; i < n; i++) {
+        if (lower(s[i]) == lower(pat[0])) {
+            prv[i] = FZ_MATCH + position_bonus(s, i) - (i < 3 ? i : 3);
+            if (s[i] == pat[0])
+                prv[i] += FZ_CASE;
+        } else {
+            prv[i] = NEG;
+        }
     }
+
+    for (int j = 1; j < m; j++) {
+        int carry = NEG; // Best score from a previous match with a gap
+        int pc = lower(pat[j]);
+        for (int i = 0; i < n; i++) {
+            int best = NEG;
+            if (i > 0 && lower(s[i]) == pc) {
+                int b = position_bonus(s, i);
+                int sc = FZ_MATCH + (s[i] == pat[j] ? FZ_CASE : 0);
+                if (prv[i - 1] > NEG)
+                    best = prv[i - 1] + sc + (b > FZ_CONSEC ? b : FZ_CONSEC);
+                if (carry > NEG && carry + sc + b > best)
+                    best = carry + sc + b;
+            }
+            cur[i] = best;
+            if (i > 0) {
+                int c1 = carry > NEG ? carry - FZ_GAP_EXT : NEG;
+                int c2 = prv[i - 1] > NEG ? prv[i - 1] - FZ_GAP_START : NEG;
+                carry = c1 > c2 ? c1 : c2;
+            }
+        }
+        memcpy(prv, cur, n * sizeof(int));
+    }
+
+    int best = NEG;
+    for (int i = m - 1; i < n; i++)
+        if (prv[i] > best)
+            best = prv[i];
+    if (best <= NEG)
+        return 0;
+
+    // Prefer short names
+    int extra = (int)strlen(s) - m;
+    best -= extra < 16 ? extra / 2 : 8;
+    return best > 1 ? best : 1;
 }
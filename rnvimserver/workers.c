@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "workers.h"
+#include "logging.h"
+#include "threads.h"
+#include "lsp.h"
+
+/*
+ * Pool of threads running the requests that only read data (completion,
+ * hover, signature, resolve and definition), so that a slow request does not
+ * delay the others. The data is read from snapshots (see snapshot.c) and
+ * updates from nvimcom are applied by the thread that receives them.
+ *
+ * The jobs of each kind run in the order they were submitted and never at
+ * the same time because the modules keep static buffers. On Windows, the
+ * jobs run in the thread that submits them.
+ *
+ * Each kind of job has an arena (see buffers.c) for the temporary data of
+ * the request, which is released after the job returns.
+ *
+ * Jobs are cancelled either by the client ($/cancelRequest) or when a newer
+ * request of the same kind arrives (the user kept typing or moved the
+ * cursor). Queued jobs are simply discarded and running ones are flagged;
+ * long loops call `job_cancelled()` and return early.
+ */
+
+typedef struct job_ {
+    int kind;          // Kind of job (see workers.h)
+    JobFun fn;         // Function to run
+    char *id;          // Request ID (may be NULL)
+    char *msg;         // Message to process
+    int cancelled;     // Should the job stop?
+    struct job_ *next; // Next job in the queue
+} Job;
+
+// Is a job made obsolete by a newer request of the same kind? Definitions
+// are requested explicitly by the user and are never superseded.
+static const int supersede[JOB_NKINDS] = {
+    1, // JOB_COMPLETE
+    1, // JOB_HOVER
+    1, // JOB_SIGNATURE
+    1, // JOB_RESOLVE
+    0, // JOB_DEFINITION
+};
+
+static Job *first;                  // First job in the queue
+static Job *last;                   // Last job in the queue
+static Job *running[JOB_NKINDS];    // Job of each kind being run
+static int nworkers;                // Number of worker threads
+static Mutex kind_lock[JOB_NKINDS]; // Used when there are no workers
+static Mutex q_lock = MUTEX_INIT;   // Protects the queue and `running`
+static _Thread_local Job *cur_job;  // Job being run by this thread
+static Arena arenas[JOB_NKINDS];    // Temporary data of the jobs
+
+static char *copy_str(const char *s) {
+    if (!s)
+        return NULL;
+    char *c = malloc(strlen(s) + 1);
+    strcpy(c, s);
+    return c;
+}
+
+static void free_job(Job *j) {
+    free(j->id);
+    free(j->msg);
+    free(j);
+}
+
+/**
+ * @brief Check whether the job being run by the calling thread was
+ * cancelled.
+ * @return 1 if the job should stop and 0 otherwise (or if the thread is not
+ * running a job).
+ */
+int job_cancelled(void) {
+    return cur_job && __atomic_load_n(&cur_job->cancelled, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the arena of the job being run by the calling thread. Its
+ * memory is released when the job returns.
+ */
+Arena *job_arena(void) { return &arenas[cur_job->kind]; }
+
+// The job is freed by the caller after removing it from `running`
+static void exec_job(Job *j) {
+    cur_job = j;
+    if (!job_cancelled())
+        j->fn(j->id, j->msg);
+    arena_reset(&arenas[j->kind]);
+    cur_job = NULL;
+}
+
+// Does the job match the request `id` or, if `kind` is not negative, is it
+// of the same kind and answers an older request? The client numbers its
+// requests in increasing order, and a late reply from nvimcom must not cancel
+// the newer requests.
+static int job_match(const Job *j, int kind, const char *id) {
+    if (!j->id)
+        return 0;
+    if (kind < 0)
+        return strcmp(j->id, id) == 0;
+    return j->kind == kind && atol(j->id) < atol(id);
+}
+
+// Cancel the jobs that match `kind` and `id` (see job_match()). The queued
+// jobs are removed from the queue and returned as a list. Must be called
+// with q_lock held.
+static Job *cancel_jobs(int kind, const char *id) {
+    Job *dropped = NULL;
+    Job **pj = &first;
+    last = NULL;
+    while (*pj) {
+        Job *j = *pj;
+        int match = job_match(j, kind, id);
+        if (match) {
+            *pj = j->next;
+            j->next = dropped;
+            dropped = j;
+        } else {
+            last = j;
+            pj = &j->next;
+        }
+    }
+
+    for (int k = 0; k < JOB_NKINDS; k++) {
+        Job *j = running[k];
+        if (j && job_match(j, kind, id))
+            __atomic_store_n(&j->cancelled, 1, __ATOMIC_RELAXED);
+    }
+    return dropped;
+}
+
+// The client stops waiting for a request only when it gets a reply
+static void reply_cancelled(int kind, const char *id) {
+    if (kind == JOB_COMPLETE)
+        send_empty(id);
+    else
+        send_null(id);
+}
+
+/**
+ * @brief Cancel the jobs of a request (the client sent $/cancelRequest) and
+ * reply to it. The reply of a job that is still running will be discarded
+ * (see send_ls_response()). Requests that are waiting for nvimcom are not
+ * affected: they are answered when nvimcom replies.
+ * @param id The request ID.
+ */
+void cancel_request(const char *id) {
+    mutex_lock(&q_lock);
+    Job *dropped = cancel_jobs(-1, id);
+    int rkind = -1;
+    for (int k = 0; k < JOB_NKINDS; k++)
+        if (running[k] && job_match(running[k], -1, id))
+            rkind = k;
+    mutex_unlock(&q_lock);
+
+    if (rkind >= 0)
+        reply_cancelled(rkind, id);
+    while (dropped) {
+        Job *nxt = dropped->next;
+        Log("cancel_request: dropping job %s", id);
+        reply_cancelled(dropped->kind, id);
+        free_job(dropped);
+        dropped = nxt;
+    }
+}
+
+// Reply to the requests of jobs cancelled by a newer request. The replies of
+// the jobs that are still running will be discarded (see send_ls_response()).
+static void supersede_jobs(int kind, const char *id) {
+    mutex_lock(&q_lock);
+    Job *dropped = cancel_jobs(kind, id);
+    const Job *r = running[kind];
+    char rid[16] = {0};
+    if (r && job_match(r, kind, id))
+        strncpy(rid, r->id, 15);
+    mutex_unlock(&q_lock);
+
+    if (*rid)
+        reply_cancelled(kind, rid);
+    while (dropped) {
+        Job *nxt = dropped->next;
+        Log("supersede_jobs: dropping job %s", dropped->id);
+        reply_cancelled(kind, dropped->id);
+        free_job(dropped);
+        dropped = nxt;
+    }
+}
+
+#ifndef WIN32
+static pthread_cond_t q_cond = PTHREAD_COND_INITIALIZER;
+
+// Remove from the queue the first job whose kind is not running
+static Job *take_job(void) {
+    Job *prev = NULL;
+    for (Job *j = first; j; prev = j, j = j->next) {
+        if (running[j->kind])
+            continue;
+        if (prev)
+            prev->next = j->next;
+        else
+            first = j->next;
+        if (last == j)
+            last = prev;
+        return j;
+    }
+    return NULL;
+}
+
+static void *worker(__attribute__((unused)) void *arg) {
+    mutex_lock(&q_lock);
+    for (;;) {
+        Job *j = take_job();
+        if (!j) {
+            pthread_cond_wait(&q_cond, &q_lock);
+            continue;
+        }
+        int kind = j->kind;
+        running[kind] = j;
+        mutex_unlock(&q_lock);
+
+        exec_job(j);
+
+        mutex_lock(&q_lock);
+        running[kind] = NULL;
+        free_job(j);
+        // A job of the same kind might be waiting
+        pthread_cond_broadcast(&q_cond);
+    }
+    return NULL;
+}
+#endif
+
+/**
+ * @brief Start the worker threads. There is a thread for each CPU, up to the
+ * number of kinds of jobs.
+ */
+void start_workers(void) {
+    for (int k = 0; k < JOB_NKINDS; k++)
+        kind_lock[k] = (Mutex)MUTEX_INIT;
+#ifndef WIN32
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 2)
+        n = 2;
+    if (n > JOB_NKINDS)
+        n = JOB_NKINDS;
+    for (long i = 0; i < n; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, NULL) != 0)
+            break;
+        pthread_detach(tid);
+        nworkers++;
+    }
+    Log("start_workers: %d", nworkers);
+#endif
+}
+
+/**
+ * @brief Run a job in a worker thread.
+ * @param kind Kind of job (see workers.h).
+ * @param fn Function to run. It receives copies of `id` and `msg` and may
+ * modify them.
+ * @param id ID of the request answered by the job (NULL or empty if
+ * unknown).
+ * @param msg Message to process.
+ */
+void run_job(int kind, JobFun fn, const char *id, const char *msg) {
+    if (id && !*id)
+        id = NULL;
+    if (id && supersede[kind])
+        supersede_jobs(kind, id);
+
+    Job *j = calloc(1, sizeof(Job));
+    j->kind = kind;
+    j->fn = fn;
+    j->id = copy_str(id);
+    j->msg = copy_str(msg);
+
+    if (nworkers == 0) {
+        mutex_lock(&kind_lock[kind]);
+        mutex_lock(&q_lock);
+        running[kind] = j;
+        mutex_unlock(&q_lock);
+        exec_job(j);
+        mutex_lock(&q_lock);
+        running[kind] = NULL;
+        mutex_unlock(&q_lock);
+        mutex_unlock(&kind_lock[kind]);
+        free_job(j);
+        return;
+    }
+
+#ifndef WIN32
+    mutex_lock(&q_lock);
+    if (last)
+        last->next = j;
+    else
+        first = j;
+    last = j;
+    pthread_cond_signal(&q_cond);
+    mutex_unlock(&q_lock);
+#endif
+}
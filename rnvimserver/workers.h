@@ -0,0 +1,25 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "buffers.h"
+
+// Kinds of jobs. Jobs of the same kind share static buffers and, thus, run
+// one at a time; jobs of different kinds run in parallel.
+enum job_kind {
+    JOB_COMPLETE,
+    JOB_HOVER,
+    JOB_SIGNATURE,
+    JOB_RESOLVE,
+    JOB_DEFINITION,
+    JOB_NKINDS
+};
+
+typedef void (*JobFun)(const char *id, char *msg);
+
+void start_workers(void);
+void run_job(int kind, JobFun fn, const char *id, const char *msg);
+void cancel_request(const char *id);
+int job_cancelled(void);
+Arena *job_arena(void);
+
+#endif